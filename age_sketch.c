@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * age_sketch.c - Histogram and quantile sketch of file ages
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#include <sys/types.h>
+
+#include "mtime_utils.h"
+
+#include "age_sketch.h"
+
+#define SECONDS_PER_DAY  86400
+#define SECONDS_PER_WEEK ( SECONDS_PER_DAY * 7 )
+
+/* Growth between the bounds of consecutive bins, (1 + accuracy) / (1 - accuracy) */
+#define AGE_SKETCH_GAMMA ( (1.0 + AGE_SKETCH_ACCURACY) / (1.0 - AGE_SKETCH_ACCURACY) )
+
+static const int AGE_NUM_BUCKETS[] = { AGE_DAY_BUCKETS, AGE_WEEK_BUCKETS, AGE_LOG_BUCKETS };
+
+int getAgeBucketModeByName(const char *name)
+{
+    if ( strcmp("day", name) == 0 )
+        return AGE_BUCKETS_DAY;
+    if ( strcmp("week", name) == 0 )
+        return AGE_BUCKETS_WEEK;
+    if ( strcmp("log", name) == 0 )
+        return AGE_BUCKETS_LOG;
+
+    return -1;
+}
+
+void AgeSketch_Init(AgeSketch *sketch, int bucketMode, time_t now)
+{
+    memset(sketch, 0x0, sizeof(AgeSketch));
+
+    sketch->bucketMode = bucketMode;
+    sketch->now = now;
+}
+
+/*
+ * getBucket - Get the histogram bucket of #age seconds
+ */
+static inline int getBucket(int bucketMode, time_t age)
+{
+    time_t days;
+    int bucket;
+
+    switch( bucketMode )
+    {
+        case AGE_BUCKETS_DAY:
+            days = age / SECONDS_PER_DAY;
+            return days < AGE_DAY_BUCKETS - 1 ? (int)days : AGE_DAY_BUCKETS - 1;
+
+        case AGE_BUCKETS_WEEK:
+            days = age / SECONDS_PER_WEEK;
+            return days < AGE_WEEK_BUCKETS - 1 ? (int)days : AGE_WEEK_BUCKETS - 1;
+
+        default:
+            /* Bucket n (after 0) holds ages of [ 2^(n-1), 2^n ) days */
+            days = age / SECONDS_PER_DAY;
+            for( bucket=0; days > 0 && bucket < AGE_LOG_BUCKETS - 1; bucket++ )
+                days >>= 1;
+            return bucket;
+    }
+}
+
+/*
+ * getBin - Get the quantile sketch bin of #age seconds
+ */
+static inline int getBin(time_t age)
+{
+    int bin;
+
+    if ( age < 1 )
+        return 0;
+
+    /* Bin i (after 0) holds ages of ( gamma^(i-2), gamma^(i-1) ] */
+    bin = 1 + (int)ceil( log((double)age) / log(AGE_SKETCH_GAMMA) );
+
+    return bin < AGE_SKETCH_BINS ? bin : AGE_SKETCH_BINS - 1;
+}
+
+void AgeSketch_Add(AgeSketch *sketch, time_t fileTime)
+{
+    time_t age;
+
+    if ( unlikely( sketch->count == 0 ) )
+    {
+        sketch->oldest = fileTime;
+        sketch->newest = fileTime;
+    }
+    else if ( fileTime < sketch->oldest )
+    {
+        sketch->oldest = fileTime;
+    }
+    else if ( fileTime > sketch->newest )
+    {
+        sketch->newest = fileTime;
+    }
+
+    age = sketch->now - fileTime;
+    if ( unlikely( age < 0 ) )
+    {
+        sketch->numFuture += 1;
+        age = 0;
+    }
+
+    sketch->count += 1;
+    sketch->bins[ getBin(age) ] += 1;
+    sketch->buckets[ getBucket(sketch->bucketMode, age) ] += 1;
+}
+
+void AgeSketch_Merge(AgeSketch *into, const AgeSketch *from)
+{
+    int i;
+
+    if ( from->count == 0 )
+        return;
+
+    if ( into->count == 0 || from->oldest < into->oldest )
+        into->oldest = from->oldest;
+    if ( into->count == 0 || from->newest > into->newest )
+        into->newest = from->newest;
+
+    into->count += from->count;
+    into->numFuture += from->numFuture;
+
+    for( i=0; i < AGE_SKETCH_BINS; i++ )
+        into->bins[i] += from->bins[i];
+    for( i=0; i < AGE_MAX_BUCKETS; i++ )
+        into->buckets[i] += from->buckets[i];
+}
+
+double AgeSketch_Quantile(const AgeSketch *sketch, double q)
+{
+    uint64_t rank, seen;
+    int i;
+
+    if ( sketch->count == 0 )
+        return 0.0;
+
+    /* Rank (0-based) of the entry at #q, as "nearest rank" */
+    rank = (uint64_t)( q * (double)(sketch->count - 1) );
+
+    seen = 0;
+    for( i=0; i < AGE_SKETCH_BINS; i++ )
+    {
+        seen += sketch->bins[i];
+        if ( seen > rank )
+            break;
+    }
+
+    if ( i == 0 )
+        return 0.0;
+
+    /* Midpoint (in relative terms) of the bin, within AGE_SKETCH_ACCURACY of anything in it */
+    return 2.0 * pow(AGE_SKETCH_GAMMA, i - 1) / (1.0 + AGE_SKETCH_GAMMA);
+}
+
+/*
+ * printBucketRange - Print the range of ages (in days) of histogram #bucket
+ */
+static void printBucketRange(int bucketMode, int bucket, FILE *stream)
+{
+    long start, end;
+
+    switch( bucketMode )
+    {
+        case AGE_BUCKETS_DAY:
+            start = bucket;
+            end = bucket == AGE_DAY_BUCKETS - 1 ? -1 : bucket + 1;
+            break;
+        case AGE_BUCKETS_WEEK:
+            start = (long)bucket * 7;
+            end = bucket == AGE_WEEK_BUCKETS - 1 ? -1 : ( (long)bucket + 1 ) * 7;
+            break;
+        default:
+            start = bucket == 0 ? 0 : 1L << (bucket - 1);
+            end = bucket == AGE_LOG_BUCKETS - 1 ? -1 : 1L << bucket;
+            break;
+    }
+
+    if ( end < 0 )
+        fprintf(stream, "%ld+", start);
+    else
+        fprintf(stream, "%ld-%ld", start, end);
+}
+
+void AgeSketch_PrintReport(const AgeSketch *sketch, FILE *stream)
+{
+    uint64_t cumulative;
+    int i;
+
+    fprintf(stream, "files\t%llu\n", (unsigned long long)sketch->count);
+    if ( sketch->count == 0 )
+        return;
+
+    fprintf(stream, "oldest\t%ld\n", (long)sketch->oldest);
+    fprintf(stream, "newest\t%ld\n", (long)sketch->newest);
+    if ( sketch->numFuture > 0 )
+        fprintf(stream, "future\t%llu\n", (unsigned long long)sketch->numFuture);
+
+    fprintf(stream, "p50_age_days\t%.2f\n", AgeSketch_Quantile(sketch, 0.50) / SECONDS_PER_DAY);
+    fprintf(stream, "p90_age_days\t%.2f\n", AgeSketch_Quantile(sketch, 0.90) / SECONDS_PER_DAY);
+    fprintf(stream, "p99_age_days\t%.2f\n", AgeSketch_Quantile(sketch, 0.99) / SECONDS_PER_DAY);
+
+    fputs("\nage_days\tfiles\tcumulative_pct\n", stream);
+
+    cumulative = 0;
+    for( i=0; i < AGE_NUM_BUCKETS[sketch->bucketMode]; i++ )
+    {
+        if ( sketch->buckets[i] == 0 )
+            continue;
+
+        cumulative += sketch->buckets[i];
+
+        printBucketRange(sketch->bucketMode, i, stream);
+        fprintf(stream, "\t%llu\t%.2f\n", (unsigned long long)sketch->buckets[i], 100.0 * (double)cumulative / (double)sketch->count);
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * age_sketch.h - Header for age_sketch.c
+ *
+ */
+#ifndef __AGE_SKETCH_H
+#define __AGE_SKETCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+/*
+ * AGE_BUCKETS_* - How file ages are grouped into the histogram of an AgeSketch
+ */
+#define AGE_BUCKETS_DAY  0  /* One bucket per day of age, for a year */
+#define AGE_BUCKETS_WEEK 1  /* One bucket per week of age, for ten years */
+#define AGE_BUCKETS_LOG  2  /* Doubling ranges of days: under 1 day, 1-2, 2-4, 4-8, ... */
+
+/* Histogram buckets, the last of which holds everything older */
+#define AGE_DAY_BUCKETS  366
+#define AGE_WEEK_BUCKETS 521
+#define AGE_LOG_BUCKETS  18
+#define AGE_MAX_BUCKETS  AGE_WEEK_BUCKETS
+
+/*
+ * Relative accuracy of quantiles, and the number of (logarithmic) bins needed to cover
+ *   ages from 1 second to well over 100 years at that accuracy
+ */
+#define AGE_SKETCH_ACCURACY 0.01
+#define AGE_SKETCH_BINS     1280
+
+/*
+ * AgeSketch - Constant-memory summary of the ages of many files: a histogram of fixed
+ *   buckets, and a quantile sketch.
+ *
+ *   The quantile sketch holds counts of logarithmic bins (as DDSketch), so any quantile is
+ *     within AGE_SKETCH_ACCURACY of the true age, and sketches are merged exactly by
+ *     adding their counts.
+ */
+typedef struct {
+    int bucketMode;         /* One of AGE_BUCKETS_* */
+    time_t now;             /* Ages are relative to this */
+
+    uint64_t count;
+    time_t oldest;          /* Oldest and newest times seen, valid if count > 0 */
+    time_t newest;
+
+    uint64_t numFuture;     /* Times after #now, counted as age 0 */
+    uint64_t bins[AGE_SKETCH_BINS];         /* Bin 0 is ages under 1 second */
+    uint64_t buckets[AGE_MAX_BUCKETS];
+
+} AgeSketch;
+
+
+/**
+ * getAgeBucketModeByName - Get the AGE_BUCKETS_* named #name ("day", "week", or "log"), or -1 if unknown.
+ */
+extern int getAgeBucketModeByName(const char *name);
+
+/**
+ * AgeSketch_Init - Initialize an empty #sketch of ages relative to #now
+ */
+extern void AgeSketch_Init(AgeSketch *sketch, int bucketMode, time_t now);
+
+/**
+ * AgeSketch_Add - Add a file with time #fileTime to #sketch
+ */
+extern void AgeSketch_Add(AgeSketch *sketch, time_t fileTime);
+
+/**
+ * AgeSketch_Merge - Add everything in #from to #into. Both must have the same bucketMode and now.
+ */
+extern void AgeSketch_Merge(AgeSketch *into, const AgeSketch *from);
+
+/**
+ * AgeSketch_Quantile - Get the age, in seconds, at quantile #q (0.0 to 1.0) of #sketch
+ */
+extern double AgeSketch_Quantile(const AgeSketch *sketch, double q);
+
+/**
+ * AgeSketch_PrintReport - Print a summary, the p50/p90/p99 ages, and the non-empty
+ *   histogram buckets of #sketch to #stream, tab-separated.
+ */
+extern void AgeSketch_PrintReport(const AgeSketch *sketch, FILE *stream);
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * checkpoint.c - Save and restore the progress of a gather (see checkpoint.h)
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "mtime_utils.h"
+
+#include "gather_mtimes.h"
+#include "records.h"
+#include "checkpoint.h"
+
+size_t loadCheckpoint(const char *filename, NameStat *nameStats, char **names, size_t numLines, int timeField, int needFields, off_t *validSize)
+{
+    char *buf;
+    size_t numRecords, i;
+    NameStat *records;
+    RecordsHeader header;
+
+    *validSize = 0;
+
+    records = loadRecordsFile(filename, &header, &numRecords, &buf);
+    if ( buf == NULL )
+    {
+        if ( errno != ENOENT )
+            fprintf(stderr, "Err: Cannot read checkpoint %s: %s\n", filename, strerror(errno));
+        return 0;
+    }
+
+    if ( unlikely( records == NULL ) )
+    {
+        fprintf(stderr, "Err: %s is not a checkpoint, starting over.\n", filename);
+        free(buf);
+        return 0;
+    }
+
+    if ( unlikely( header.timeField != timeField || (header.fields & needFields) != needFields ) )
+    {
+        fprintf(stderr, "Err: Checkpoint %s was gathered with different options, starting over.\n", filename);
+        free(records);
+        free(buf);
+        return 0;
+    }
+
+    *validSize = RECORDS_HEADER_SIZE;
+
+    for( i=0; i < numRecords && i < numLines; i++ )
+    {
+        if ( unlikely( strcmp(records[i].fname, names[i]) != 0 ) )
+        {
+            fprintf(stderr, "Err: Input differs from checkpoint %s at line %zu, resuming from there.\n", filename, i + 1);
+            break;
+        }
+
+        nameStats[i].fname = names[i];
+        nameStats[i].statBuf = records[i].statBuf;
+        nameStats[i].fileTime = records[i].fileTime;
+
+        *validSize += RECORD_FIXED_SIZE + strlen(names[i]);
+    }
+
+    free(records);
+    free(buf);
+
+    return i;
+}
+
+FILE *openCheckpoint(const char *filename, int isResumeFile, off_t validSize, const NameStat *nameStats, size_t numRestored, int timeField)
+{
+    FILE *checkpoint;
+
+    if ( isResumeFile && validSize > 0 )
+    {
+        /* Drop anything past the restored records (e.x. a record cut short by a kill), and carry on */
+        checkpoint = fopen(filename, "r+");
+        if ( checkpoint != NULL )
+        {
+            if ( likely( ftruncate(fileno(checkpoint), validSize) == 0 && fseeko(checkpoint, validSize, SEEK_SET) == 0 ) )
+                return checkpoint;
+
+            fclose(checkpoint);
+        }
+    }
+
+    checkpoint = fopen(filename, "w");
+    if ( unlikely( checkpoint == NULL ) )
+    {
+        fprintf(stderr, "Err: Cannot write checkpoint %s: %s\n", filename, strerror(errno));
+        return NULL;
+    }
+
+    writeRecordsHeader(checkpoint, timeField, RECORD_FIELDS);
+
+    if ( unlikely( appendCheckpoint(checkpoint, nameStats, 0, numRestored) < 0 ) )
+    {
+        fclose(checkpoint);
+        return NULL;
+    }
+
+    return checkpoint;
+}
+
+int appendCheckpoint(FILE *checkpoint, const NameStat *nameStats, size_t start, size_t end)
+{
+    size_t i;
+
+    for( i=start; i < end; i++ )
+        writeRecord(checkpoint, &nameStats[i]);
+
+    if ( unlikely( fflush(checkpoint) != 0 || fdatasync(fileno(checkpoint)) != 0 ) )
+    {
+        fprintf(stderr, "Err: Cannot write checkpoint: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
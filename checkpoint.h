@@ -0,0 +1,67 @@
+/**
+ * checkpoint.h - Part of mtime_utils
+ *
+ *   Copyright (c) 2017 Timothy Savannah all rights reserved
+ *     Licensed under terms of the GNU General Purpose License (GPL) Version 3
+ *
+ *
+ * Checkpoint files
+ * ----------------
+ *
+ *   A checkpoint is a binary record stream (see records.h), holding one record for each
+ *     of the first N input files, in input order. N is the input position reached.
+ *
+ *   Unlike a records stream written for output, files which could not be stat'd are also
+ *     written (with a time_ns of 0) so that each record's position matches its input line.
+ *
+ *   Records are appended (and flushed to disk) after each interval of files is gathered,
+ *     so a killed run loses at most one interval.
+ */
+
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "gather_mtimes.h"
+
+/* Default number of files gathered between checkpoints */
+#define DEFAULT_CHECKPOINT_INTERVAL 100000
+
+/**
+ * loadCheckpoint - Restore the leading entries of #nameStats from the checkpoint #filename
+ *
+ *   Each record is matched against the input #names in order, and restoring stops at the
+ *     first path which differs (e.x. the input list has changed since the checkpoint).
+ *
+ *   The checkpoint must have been gathered with #timeField, and carry at least #needFields.
+ *
+ *   validSize - Filled with the number of bytes of the checkpoint file holding the header
+ *                 and restored records (where further records should be appended)
+ *
+ *   Returns the number of entries restored, which is 0 if the file is missing or unusable
+ *     (with a message printed to stderr)
+ */
+extern size_t loadCheckpoint(const char *filename, NameStat *nameStats, char **names, size_t numLines, int timeField, int needFields, off_t *validSize);
+
+/**
+ * openCheckpoint - Open the checkpoint #filename for writing, holding the first #numRestored
+ *   entries of #nameStats.
+ *
+ *   If #filename is the checkpoint those entries were loaded from (#isResumeFile),
+ *     it is truncated to #validSize and appended to. Otherwise it is rewritten.
+ *
+ *   Returns the stream to append to with appendCheckpoint, or NULL on error.
+ */
+extern FILE *openCheckpoint(const char *filename, int isResumeFile, off_t validSize, const NameStat *nameStats, size_t numRestored, int timeField);
+
+/**
+ * appendCheckpoint - Append entries [#start, #end) of #nameStats to #checkpoint,
+ *   and flush them through to disk.
+ *
+ *   Returns 0 on success, -1 on error.
+ */
+extern int appendCheckpoint(FILE *checkpoint, const NameStat *nameStats, size_t start, size_t end);
+
+#endif
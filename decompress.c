@@ -0,0 +1,464 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * decompress.c - Decompress gzip and zstd input in-process
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+
+#include "mtime_utils.h"
+
+#include "decompress.h"
+
+#if defined(HAVE_ZLIB)
+  #include <zlib.h>
+#endif
+
+#if defined(HAVE_ZSTD)
+  #include <zstd.h>
+#endif
+
+/* Output buffer grows from this many times the compressed size, when the size is not recorded */
+#define DECOMPRESS_INITIAL_RATIO 4
+
+/* Smallest output buffer */
+#define DECOMPRESS_MIN_SIZE (64 * 1024)
+
+int getCompressionKind(const char *buf, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)buf;
+
+    if ( size >= 2 && bytes[0] == 0x1F && bytes[1] == 0x8B )
+        return COMPRESSION_GZIP;
+
+    if ( size >= 4 && bytes[0] == 0x28 && bytes[1] == 0xB5 && bytes[2] == 0x2F && bytes[3] == 0xFD )
+        return COMPRESSION_ZSTD;
+
+    return COMPRESSION_NONE;
+}
+
+const char *getCompressionName(int kind)
+{
+    switch ( kind )
+    {
+        case COMPRESSION_GZIP:
+            return "gzip";
+        case COMPRESSION_ZSTD:
+            return "zstd";
+    }
+
+    return "none";
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+
+/*
+ * growOutput - Grow the output buffer *out of *capacity bytes (plus two spare) to double that
+ *
+ *   Returns 0 on success, or -1 (after printing why) if it cannot be grown.
+ */
+static int growOutput(char **out, size_t *capacity)
+{
+    char *grown;
+
+    grown = realloc(*out, *capacity * 2 + 2);
+    if ( unlikely( grown == NULL ) )
+    {
+        fputs("Err: Failed to allocate memory for decompressed input.\n", stderr);
+        return -1;
+    }
+
+    *out = grown;
+    *capacity *= 2;
+
+    return 0;
+}
+
+#endif
+
+#if defined(HAVE_ZLIB)
+
+/*
+ * decompressGzip - decompressBuffer for gzip, one member after another
+ */
+static char *decompressGzip(const char *buf, size_t size, size_t *outSize, size_t *numFrames)
+{
+    z_stream strm;
+    char *out;
+    size_t capacity, inPos, outPos;
+    int ret;
+
+    memset(&strm, 0x0, sizeof(z_stream));
+
+    /* 16 + window bits accepts only a gzip header */
+    if ( unlikely( inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK ) )
+    {
+        fputs("Err: Failed to initialize zlib.\n", stderr);
+        return NULL;
+    }
+
+    capacity = size * DECOMPRESS_INITIAL_RATIO;
+    if ( capacity < DECOMPRESS_MIN_SIZE )
+        capacity = DECOMPRESS_MIN_SIZE;
+
+    out = malloc( capacity + 2 );
+    inPos = 0;
+    outPos = 0;
+    *numFrames = 1;
+
+    for( ;; )
+    {
+        /* zlib counts in 32 bits, so give it at most that much at a time */
+        if ( strm.avail_in == 0 )
+        {
+            strm.next_in = (unsigned char *)buf + inPos;
+            strm.avail_in = ( size - inPos > UINT_MAX ) ? UINT_MAX : (unsigned int)(size - inPos);
+            inPos += strm.avail_in;
+        }
+
+        if ( outPos == capacity && growOutput(&out, &capacity) < 0 )
+            goto error_exit;
+
+        strm.next_out = (unsigned char *)out + outPos;
+        strm.avail_out = ( capacity - outPos > UINT_MAX ) ? UINT_MAX : (unsigned int)(capacity - outPos);
+
+        ret = inflate(&strm, Z_NO_FLUSH);
+        outPos = (char *)strm.next_out - out;
+
+        if ( ret == Z_STREAM_END )
+        {
+            /* Another member may follow (e.x. from pigz, or files cat'd together). Anything else is ignored */
+            if ( strm.avail_in == 0 && inPos < size )
+            {
+                strm.next_in = (unsigned char *)buf + inPos;
+                strm.avail_in = ( size - inPos > UINT_MAX ) ? UINT_MAX : (unsigned int)(size - inPos);
+                inPos += strm.avail_in;
+            }
+
+            if ( getCompressionKind((const char *)strm.next_in, strm.avail_in) != COMPRESSION_GZIP )
+                break;
+
+            inflateReset(&strm);
+            *numFrames += 1;
+            continue;
+        }
+
+        if ( ret == Z_BUF_ERROR && strm.avail_in == 0 && inPos == size )
+        {
+            fputs("Err: gzip input is truncated.\n", stderr);
+            goto error_exit;
+        }
+
+        if ( unlikely( ret != Z_OK && ret != Z_BUF_ERROR ) )
+        {
+            fprintf(stderr, "Err: Cannot decompress gzip input: %s\n", strm.msg != NULL ? strm.msg : "corrupt data");
+            goto error_exit;
+        }
+    }
+
+    inflateEnd(&strm);
+
+    out[outPos] = '\0';
+    *outSize = outPos;
+
+    return out;
+
+error_exit:
+
+    inflateEnd(&strm);
+    free(out);
+
+    return NULL;
+}
+
+#endif
+
+#if defined(HAVE_ZSTD)
+
+/*
+ * ZstdFrame - A single frame of zstd input, and where its content goes in the output
+ */
+typedef struct {
+    const char *src;
+    size_t srcSize;
+    size_t outOffset;
+    size_t contentSize;
+
+} ZstdFrame;
+
+/*
+ * ZstdWork - Frames shared by the threads of decompressZstdFrames
+ */
+typedef struct {
+    ZstdFrame *frames;
+    size_t numFrames;
+    char *out;
+
+    size_t nextFrame;   /* Next frame to be claimed */
+    int hasError;
+
+} ZstdWork;
+
+/*
+ * zstdFrameWorkerMain - Decompress frames of a ZstdWork, claiming one at a time, until none are left
+ */
+static void *zstdFrameWorkerMain(void *_work)
+{
+    ZstdWork *work = (ZstdWork *)_work;
+    ZstdFrame *frame;
+    ZSTD_DCtx *dctx;
+    size_t frameIdx, ret;
+
+    dctx = ZSTD_createDCtx();
+    if ( unlikely( dctx == NULL ) )
+    {
+        __atomic_store_n(&work->hasError, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    while ( (frameIdx = __atomic_fetch_add(&work->nextFrame, 1, __ATOMIC_RELAXED)) < work->numFrames )
+    {
+        frame = &work->frames[frameIdx];
+
+        ret = ZSTD_decompressDCtx(dctx, work->out + frame->outOffset, frame->contentSize, frame->src, frame->srcSize);
+        if ( unlikely( ZSTD_isError(ret) || ret != frame->contentSize ) )
+        {
+            fprintf(stderr, "Err: Cannot decompress zstd frame %zu: %s\n", frameIdx,
+                ZSTD_isError(ret) ? ZSTD_getErrorName(ret) : "size differs from its header");
+            __atomic_store_n(&work->hasError, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+
+    ZSTD_freeDCtx(dctx);
+
+    return NULL;
+}
+
+/*
+ * decompressZstdFrames - Decompress the #numFrames frames (each recording its content size)
+ *   into #out, on up to #numThreads threads
+ *
+ *   Returns 0 on success, or -1 (after printing why) on failure.
+ */
+static int decompressZstdFrames(ZstdFrame *frames, size_t numFrames, char *out, int numThreads)
+{
+    ZstdWork work;
+    pthread_t *threads;
+    int numStarted, i;
+
+    work.frames = frames;
+    work.numFrames = numFrames;
+    work.out = out;
+    work.nextFrame = 0;
+    work.hasError = 0;
+
+    if ( (size_t)numThreads > numFrames )
+        numThreads = (int)numFrames;
+
+    threads = malloc( sizeof(pthread_t) * numThreads );
+
+    /* The calling thread is one of the workers */
+    for( numStarted=0; numStarted < numThreads - 1; numStarted++ )
+    {
+        if ( unlikely( pthread_create(&threads[numStarted], NULL, zstdFrameWorkerMain, &work) != 0 ) )
+            break;
+    }
+
+    zstdFrameWorkerMain(&work);
+
+    for( i=0; i < numStarted; i++ )
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+
+    return work.hasError ? -1 : 0;
+}
+
+/*
+ * decompressZstdStream - Decompress all of #buf as a stream, for frames which do not record their size
+ */
+static char *decompressZstdStream(const char *buf, size_t size, size_t *outSize)
+{
+    ZSTD_DCtx *dctx;
+    ZSTD_inBuffer input;
+    ZSTD_outBuffer output;
+    char *out;
+    size_t capacity, ret;
+
+    dctx = ZSTD_createDCtx();
+    if ( unlikely( dctx == NULL ) )
+    {
+        fputs("Err: Failed to initialize zstd.\n", stderr);
+        return NULL;
+    }
+
+    capacity = size * DECOMPRESS_INITIAL_RATIO;
+    if ( capacity < DECOMPRESS_MIN_SIZE )
+        capacity = DECOMPRESS_MIN_SIZE;
+
+    out = malloc( capacity + 2 );
+
+    input.src = buf;
+    input.size = size;
+    input.pos = 0;
+
+    output.pos = 0;
+    ret = 0;
+
+    while ( input.pos < input.size || ret != 0 )
+    {
+        if ( output.pos == capacity && growOutput(&out, &capacity) < 0 )
+            goto error_exit;
+
+        output.dst = out;
+        output.size = capacity;
+
+        ret = ZSTD_decompressStream(dctx, &output, &input);
+        if ( unlikely( ZSTD_isError(ret) ) )
+        {
+            fprintf(stderr, "Err: Cannot decompress zstd input: %s\n", ZSTD_getErrorName(ret));
+            goto error_exit;
+        }
+
+        /* All input is in, but the frame is incomplete */
+        if ( ret != 0 && input.pos == input.size && output.pos < capacity )
+        {
+            fputs("Err: zstd input is truncated.\n", stderr);
+            goto error_exit;
+        }
+    }
+
+    ZSTD_freeDCtx(dctx);
+
+    out[output.pos] = '\0';
+    *outSize = output.pos;
+
+    return out;
+
+error_exit:
+
+    ZSTD_freeDCtx(dctx);
+    free(out);
+
+    return NULL;
+}
+
+/*
+ * decompressZstd - decompressBuffer for zstd.
+ *
+ *   When every frame records its content size, the frames are decompressed in parallel,
+ *     each straight to its place in the output. Otherwise, as a single stream.
+ */
+static char *decompressZstd(const char *buf, size_t size, int numThreads, size_t *outSize, size_t *numFrames)
+{
+    ZstdFrame *frames;
+    size_t framesCapacity, pos, frameSize, contentSize, total;
+    char *out;
+    int isSized;
+
+    framesCapacity = 64;
+    frames = malloc( sizeof(ZstdFrame) * framesCapacity );
+
+    *numFrames = 0;
+    total = 0;
+    isSized = 1;
+
+    for( pos=0; pos < size; pos += frameSize )
+    {
+        frameSize = ZSTD_findFrameCompressedSize(buf + pos, size - pos);
+        if ( unlikely( ZSTD_isError(frameSize) ) )
+        {
+            fprintf(stderr, "Err: Cannot decompress zstd input: %s\n", ZSTD_getErrorName(frameSize));
+            free(frames);
+            return NULL;
+        }
+
+        contentSize = ZSTD_getFrameContentSize(buf + pos, frameSize);
+        if ( contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR )
+            isSized = 0;
+
+        if ( unlikely( *numFrames == framesCapacity ) )
+        {
+            framesCapacity *= 2;
+            frames = realloc(frames, sizeof(ZstdFrame) * framesCapacity);
+        }
+
+        frames[*numFrames].src = buf + pos;
+        frames[*numFrames].srcSize = frameSize;
+        frames[*numFrames].outOffset = total;
+        frames[*numFrames].contentSize = contentSize;
+        *numFrames += 1;
+
+        if ( isSized )
+            total += contentSize;
+    }
+
+    if ( !isSized )
+    {
+        free(frames);
+        return decompressZstdStream(buf, size, outSize);
+    }
+
+    out = malloc( total + 2 );
+    if ( unlikely( out == NULL ) )
+    {
+        fputs("Err: Failed to allocate memory for decompressed input.\n", stderr);
+        free(frames);
+        return NULL;
+    }
+
+    if ( unlikely( decompressZstdFrames(frames, *numFrames, out, numThreads) < 0 ) )
+    {
+        free(out);
+        free(frames);
+        return NULL;
+    }
+
+    free(frames);
+
+    out[total] = '\0';
+    *outSize = total;
+
+    return out;
+}
+
+#endif
+
+char *decompressBuffer(int kind, const char *buf, size_t size, int numThreads, size_t *outSize, size_t *numFrames)
+{
+    *outSize = 0;
+    *numFrames = 0;
+
+    if ( numThreads < 1 )
+        numThreads = 1;
+
+    switch ( kind )
+    {
+        case COMPRESSION_GZIP:
+            #if defined(HAVE_ZLIB)
+              return decompressGzip(buf, size, outSize, numFrames);
+            #else
+              fputs("Err: Input is gzip compressed, but this was built without zlib (make WITH_ZLIB=1).\n", stderr);
+              return NULL;
+            #endif
+
+        case COMPRESSION_ZSTD:
+            #if defined(HAVE_ZSTD)
+              return decompressZstd(buf, size, numThreads, outSize, numFrames);
+            #else
+              fputs("Err: Input is zstd compressed, but this was built without libzstd (make WITH_ZSTD=1).\n", stderr);
+              return NULL;
+            #endif
+    }
+
+    fputs("Err: Unknown compression.\n", stderr);
+    return NULL;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * decompress.h - Header for decompress.c
+ *
+ */
+#ifndef __DECOMPRESS_H
+#define __DECOMPRESS_H
+
+#include <sys/types.h>
+
+/*
+ * COMPRESSION_* - How input is compressed, detected from its first bytes
+ */
+#define COMPRESSION_NONE 0
+#define COMPRESSION_GZIP 1  /* Needs zlib, make WITH_ZLIB=1 */
+#define COMPRESSION_ZSTD 2  /* Needs libzstd, make WITH_ZSTD=1 */
+
+/* Most bytes needed to detect compression */
+#define COMPRESSION_MAGIC_SIZE 4
+
+
+/**
+ * getCompressionKind - Get the COMPRESSION_* of the #size bytes at #buf, by their magic number
+ */
+extern int getCompressionKind(const char *buf, size_t size);
+
+/**
+ * getCompressionName - Get the name ("gzip" or "zstd") of #kind, one of COMPRESSION_*
+ */
+extern const char *getCompressionName(int kind);
+
+/**
+ * decompressBuffer - Decompress the #size bytes at #buf, compressed as #kind, into a new buffer
+ *
+ *   Concatenated gzip members, and multiple zstd frames, are all decompressed.
+ *     zstd frames which record their size are decompressed on up to #numThreads threads at once.
+ *
+ *   The returned buffer has two bytes to spare past *outSize (e.x. to add a newline), and is null terminated.
+ *
+ *   outSize   - Set to the size decompressed
+ *   numFrames - Set to the number of gzip members or zstd frames
+ *
+ *   Returns the buffer (to be released with free), or NULL (after printing why) on failure,
+ *     including if not built with support for #kind.
+ */
+extern char *decompressBuffer(int kind, const char *buf, size_t size, int numThreads, size_t *outSize, size_t *numFrames);
+
+#endif
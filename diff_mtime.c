@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * diff_mtime.c - Compares a list of files against a snapshot of their mtimes
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "mtime_utils.h"
+
+#include "gather_mtimes.h"
+#include "records.h"
+#include "path_index.h"
+
+#define ERROR_ALLOC_MEMORY 12
+
+/* Exit codes, as diff(1) */
+#define EXIT_NO_CHANGES 0
+#define EXIT_CHANGES    1
+#define EXIT_TROUBLE    2
+
+static const volatile char* APP_NAME = "diff_mtime";
+
+/*
+ * DiffMtimeOptions - Options parsed from the commandline
+ */
+typedef struct {
+    const char *snapshotFile;   /* Previous snapshot to compare against */
+    const char *saveFile;       /* If set, write a snapshot of the current files here */
+    int timeField;              /* One of TIME_FIELD_*, or -1 to use the snapshot's */
+    int inputFormat;            /* One of INPUT_FORMAT_* */
+    GatherOptions gather;
+
+} DiffMtimeOptions;
+
+/*
+ * printUsage - Prints usage information to stderr
+ */
+static void printUsage(void)
+{
+    fprintf(stderr, "Usage: %s (Options) [snapshot] [list files...]\n  Takes input of filenames on stdin (or [list files]), and compares their mtimes to those in [snapshot],\n", APP_NAME);
+    fputs("   printing a line for each change to stdout:\n\n", stderr);
+    fputs("     A<TAB>filename  - Added, not in the snapshot\n", stderr);
+    fputs("     M<TAB>filename  - Modified, the time differs from the snapshot\n", stderr);
+    fputs("     D<TAB>filename  - Deleted, in the snapshot but not in the input (or no longer exists)\n\n", stderr);
+    fputs("   Added and modified files are printed in input order, followed by deleted files in snapshot order.\n\n", stderr);
+    fputs("   [snapshot] is a binary record stream, as written by --save, or get_mtime --output=records.\n", stderr);
+    fputs("     If it does not exist yet, it is taken as empty, so every file is reported as added.\n\n", stderr);
+    fputs("    Options:\n\n", stderr);
+    fputs("      --save=FILE   Write a snapshot of the current files to FILE, for the next run.\n", stderr);
+    fputs("                      May be the same as [snapshot].\n\n", stderr);
+    fputs("      --time=X   Compare timestamp X instead of the one held in the snapshot. X is one of:\n", stderr);
+    fputs("                   mtime, atime, ctime, btime. Must match the snapshot.\n\n", stderr);
+    fputs("      --input=X  Input format. X is one of:\n", stderr);
+    fputs("                   list  - One filename per line, each of which is stat'd (default)\n", stderr);
+    fputs("                   epoch - An epoch time (with optional fraction), a space, then a filename\n", stderr);
+    fputs("                             per line, e.x. from find -printf '%T@ %p\\n'. Nothing is stat'd.\n\n", stderr);
+    printGatherUsage();
+    fputs("      --help     Print this help message.\n\n", stderr);
+    fputs("      --version  Show version information\n\n", stderr);
+    fputs("Exit code is 0 if nothing changed, 1 if anything changed, and 2 on error.\n\n", stderr);
+    fputs("Example:  find /data -type f | diff_mtime --save=data.snap data.snap\n\n", stderr);
+}
+
+
+/**
+ * handleArgs - Handle args on commandline, filling #options
+ *
+ *   Sets snapshotFile to the first positional argument, any after it are list files.
+ *
+ * If return is >= 0, the program should exit with that code.
+ */
+static inline int handleArgs(int argc, char **argv, DiffMtimeOptions *options)
+{
+    int i;
+    int gatherRet;
+
+    options->snapshotFile = NULL;
+    options->saveFile = NULL;
+    options->timeField = -1;
+    options->inputFormat = INPUT_FORMAT_LIST;
+    initGatherOptions(&options->gather);
+
+    for( i=1; i < argc; i++ )
+    {
+        if ( strcmp("--help", argv[i]) == 0 )
+        {
+            printUsage();
+            return 0;
+        }
+        else if ( strcmp("--version", argv[i]) == 0 )
+        {
+            printVersion(APP_NAME);
+            return 0;
+        }
+        else if ( strstr(argv[i], "--save=") == argv[i] && argv[i][7] != '\0' )
+        {
+            options->saveFile = argv[i] + 7;
+        }
+        else if ( strstr(argv[i], "--time=") == argv[i] )
+        {
+            options->timeField = getTimeFieldByName(argv[i] + 7);
+            if ( options->timeField < 0 )
+            {
+                fprintf(stderr, "Unknown or unsupported time field: %s\n\n", argv[i] + 7);
+                printUsage();
+                return EXIT_TROUBLE;
+            }
+        }
+        else if ( strstr(argv[i], "--input=") == argv[i] )
+        {
+            options->inputFormat = getInputFormatByName(argv[i] + 8);
+            if ( options->inputFormat < 0 )
+            {
+                fprintf(stderr, "Unknown input format: %s\n\n", argv[i] + 8);
+                printUsage();
+                return EXIT_TROUBLE;
+            }
+        }
+        else if ( (gatherRet = handleGatherArg(&options->gather, argv[i])) != 0 )
+        {
+            if ( gatherRet < 0 )
+            {
+                fputs("\n", stderr);
+                printUsage();
+                return EXIT_TROUBLE;
+            }
+        }
+        else if ( argv[i][0] != '-' && options->snapshotFile == NULL )
+        {
+            options->snapshotFile = argv[i];
+        }
+        else if ( options->snapshotFile != NULL && (argv[i][0] != '-' || strcmp("-", argv[i]) == 0) )
+        {
+            if ( addGatherInputFile(&options->gather, argv[i]) < 0 )
+                return EXIT_TROUBLE;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown argument: %s\n\n", argv[i]);
+            printUsage();
+            return EXIT_TROUBLE;
+        }
+    }
+
+    if ( options->snapshotFile == NULL )
+    {
+        fputs("No snapshot given.\n\n", stderr);
+        printUsage();
+        return EXIT_TROUBLE;
+    }
+
+    return -1;
+}
+
+/*
+ * timespecEqual - Check if two timespecs hold the same time
+ */
+static inline int timespecEqual(const struct timespec *ts1, const struct timespec *ts2)
+{
+    return ts1->tv_sec == ts2->tv_sec && ts1->tv_nsec == ts2->tv_nsec;
+}
+
+/**
+ * printDiff - Hash join the current #nameStats against the #snapshot, printing each change.
+ *
+ *   Returns the number of changes printed.
+ */
+static size_t printDiff(const NameStat *nameStats, size_t numEntries, const NameStat *snapshot, size_t numSnapshot)
+{
+    PathIndex *index;
+    char *isMatched;
+    size_t i, snapIdx, numChanges;
+
+    index = PathIndex_New(numSnapshot);
+    isMatched = calloc( numSnapshot + 1, 1 );
+
+    for( i=0; i < numSnapshot; i++ )
+    {
+        if ( likely( NAMESTAT_IS_VALID(&snapshot[i]) ) )
+            PathIndex_Insert(index, snapshot[i].fname, i);
+    }
+
+    numChanges = 0;
+
+    for( i=0; i < numEntries; i++ )
+    {
+        /* A file which can no longer be stat'd is reported as deleted */
+        if ( unlikely( !NAMESTAT_IS_VALID(&nameStats[i]) ) )
+            continue;
+
+        snapIdx = PathIndex_Find(index, nameStats[i].fname);
+        if ( snapIdx == PATH_INDEX_NOT_FOUND )
+        {
+            printf("A\t%s\n", nameStats[i].fname);
+            numChanges += 1;
+            continue;
+        }
+
+        /* Listed more than once, only compare the first */
+        if ( unlikely( isMatched[snapIdx] ) )
+            continue;
+
+        isMatched[snapIdx] = 1;
+
+        if ( !timespecEqual(&nameStats[i].fileTime, &snapshot[snapIdx].fileTime) )
+        {
+            printf("M\t%s\n", nameStats[i].fname);
+            numChanges += 1;
+        }
+    }
+
+    /* Walk the index rather than the snapshot, so paths listed twice in it are reported once */
+    for( i=0; i < index->numEntries; i++ )
+    {
+        snapIdx = index->entries[i].value;
+        if ( !isMatched[snapIdx] )
+        {
+            printf("D\t%s\n", snapshot[snapIdx].fname);
+            numChanges += 1;
+        }
+    }
+
+    free(isMatched);
+    PathIndex_Free(index);
+
+    return numChanges;
+}
+
+/**
+ * saveSnapshot - Write the valid entries of #nameStats as a records stream to #filename
+ *
+ *   The snapshot is written beside #filename and renamed over it once complete,
+ *     so #filename is never left partially written.
+ *
+ *   Returns 0 on success, -1 on error.
+ */
+static int saveSnapshot(const char *filename, const NameStat *nameStats, size_t numEntries, int timeField, int fields)
+{
+    FILE *snapshot;
+    char *tmpFilename;
+    size_t i;
+    int ret = 0;
+
+    tmpFilename = malloc( strlen(filename) + 5 );
+    sprintf(tmpFilename, "%s.tmp", filename);
+
+    snapshot = fopen(tmpFilename, "w");
+    if ( unlikely( snapshot == NULL ) )
+    {
+        fprintf(stderr, "Err: Cannot write snapshot %s: %s\n", tmpFilename, strerror(errno));
+        free(tmpFilename);
+        return -1;
+    }
+
+    writeRecordsHeader(snapshot, timeField, fields);
+    for( i=0; i < numEntries; i++ )
+    {
+        if ( likely( NAMESTAT_IS_VALID(&nameStats[i]) ) )
+            writeRecord(snapshot, &nameStats[i]);
+    }
+
+    if ( unlikely( fclose(snapshot) != 0 || rename(tmpFilename, filename) != 0 ) )
+    {
+        fprintf(stderr, "Err: Cannot write snapshot %s: %s\n", filename, strerror(errno));
+        unlink(tmpFilename);
+        ret = -1;
+    }
+
+    free(tmpFilename);
+
+    return ret;
+}
+
+/**
+ * Ya main' dog
+ */
+int main(int argc, char* argv[])
+{
+    ReadNameStatBuffers *buffers;
+    NameStat *nameStats = NULL;
+    NameStat *snapshot;
+    RecordsHeader header;
+    char *snapshotBuf;
+    size_t numEntries, numSnapshot, numChanges;
+    int ret;
+    DiffMtimeOptions options;
+
+    /* Parse args.
+     *  If return is >= 0, we should exit with that code.
+     */
+    if ( (ret = handleArgs ( argc, (char **)argv, &options ) ) >= 0 )
+        return ret;
+
+    snapshot = loadRecordsFile(options.snapshotFile, &header, &numSnapshot, &snapshotBuf);
+
+    /* No snapshot yet (the first run) is an empty one, so every file is added, and --save starts it */
+    if ( snapshot == NULL && snapshotBuf == NULL && errno == ENOENT )
+    {
+        numSnapshot = 0;
+        header.timeField = ( options.timeField >= 0 ) ? options.timeField : TIME_FIELD_MTIME;
+    }
+    else if ( snapshot == NULL )
+    {
+        if ( snapshotBuf == NULL )
+            fprintf(stderr, "Err: Cannot read snapshot %s: %s\n", options.snapshotFile, strerror(errno));
+        else
+            fprintf(stderr, "Err: %s is not a snapshot (binary record stream).\n", options.snapshotFile);
+
+        free(snapshotBuf);
+        return EXIT_TROUBLE;
+    }
+
+    if ( options.timeField < 0 )
+    {
+        options.timeField = header.timeField;
+    }
+    else if ( options.timeField != header.timeField )
+    {
+        fprintf(stderr, "Snapshot %s holds %s, which conflicts with --time=%s\n", options.snapshotFile,
+            getTimeFieldName(header.timeField), getTimeFieldName(options.timeField));
+        free(snapshot);
+        free(snapshotBuf);
+        return EXIT_TROUBLE;
+    }
+
+    buffers = initReadNameStatBuffers();
+    if ( buffers == NULL )
+        return ERROR_ALLOC_MEMORY;
+
+    buffers->timeField = options.timeField;
+    buffers->inputFormat = options.inputFormat;
+    buffers->options = options.gather;
+    if ( options.saveFile != NULL && options.inputFormat != INPUT_FORMAT_EPOCH )
+        buffers->needFields |= RECORD_FIELDS;
+
+    ret = EXIT_TROUBLE;
+
+    nameStats = readAndCreateNameStats(buffers, &numEntries, stdin);
+    if ( !nameStats )
+    {
+        if ( buffers->hasInputError )
+            goto cleanup_and_exit;
+
+        /* No files at all (e.x. every one was deleted) is an empty current set, not an error */
+        numEntries = 0;
+    }
+
+    numChanges = printDiff(nameStats, numEntries, snapshot, numSnapshot);
+
+    if ( options.gather.showStats )
+    {
+        printGatherStats(buffers);
+        fprintf(stderr, "stats: snapshot=%zu changes=%zu\n", numSnapshot, numChanges);
+    }
+
+    /* Make sure the changes are out before the snapshot which records them as seen */
+    fflush(stdout);
+
+    if ( options.saveFile != NULL && saveSnapshot(options.saveFile, nameStats, numEntries, options.timeField, buffers->gatheredFields) < 0 )
+        goto cleanup_and_exit;
+
+    ret = numChanges ? EXIT_CHANGES : EXIT_NO_CHANGES;
+
+cleanup_and_exit:
+
+    /* Final cleanup */
+    if ( nameStats != NULL )
+        free(nameStats);
+    destroyReadNameStatBuffers(buffers);
+
+    free(snapshot);
+    free(snapshotBuf);
+
+    return ret;
+}
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * dir_aggregate.c - Aggregate NameStats by directory prefix
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "mtime_utils.h"
+
+#include "gather_mtimes.h"
+#include "dir_aggregate.h"
+
+/* Initial number of hash slots and groups. Must be a power of 2 */
+#define DIR_AGGREGATE_INITIAL_SLOTS 1024
+
+/* Prefix used for files without any directory component */
+static const char DOT_PREFIX[] = ".";
+
+/*
+ * hashPrefix - FNV-1a hash of #len bytes at #str, hashing each run of slashes as one
+ */
+static inline uint64_t hashPrefix(const char *str, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i;
+
+    for( i=0; i < len; i++ )
+    {
+        if ( unlikely( str[i] == '/' && i > 0 && str[i - 1] == '/' ) )
+            continue;
+
+        hash ^= (unsigned char)str[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/*
+ * timespecCompare - Compare two timespecs, returning <0, 0, or >0
+ */
+static inline int timespecCompare(const struct timespec *ts1, const struct timespec *ts2)
+{
+    if ( ts1->tv_sec != ts2->tv_sec )
+        return ts1->tv_sec < ts2->tv_sec ? -1 : 1;
+
+    return (ts1->tv_nsec > ts2->tv_nsec) - (ts1->tv_nsec < ts2->tv_nsec);
+}
+
+/*
+ * prefixEqual - Check if the prefixes #str1 (of #len1 bytes) and #str2 (of #len2 bytes) name the
+ *   same directory, where each run of slashes is the same as one (e.x. "a//b" and "a/b")
+ */
+static inline int prefixEqual(const char *str1, size_t len1, const char *str2, size_t len2)
+{
+    size_t i1, i2;
+
+    if ( len1 == len2 && memcmp(str1, str2, len1) == 0 )
+        return 1;
+
+    i1 = 0;
+    i2 = 0;
+    while ( i1 < len1 && i2 < len2 )
+    {
+        if ( str1[i1] != str2[i2] )
+            return 0;
+
+        if ( str1[i1] == '/' )
+        {
+            while ( i1 < len1 && str1[i1] == '/' )
+                i1++;
+            while ( i2 < len2 && str2[i2] == '/' )
+                i2++;
+            continue;
+        }
+
+        i1++;
+        i2++;
+    }
+
+    return i1 == len1 && i2 == len2;
+}
+
+size_t getDirPrefixLen(const char *fname, int depth)
+{
+    const char *cur, *lastSlash, *dirEnd, *nextSlash;
+    int curDepth;
+
+    cur = fname;
+
+    /* Leading "/" or "./" are not counted as a component */
+    if ( *cur == '/' )
+    {
+        while ( *cur == '/' )
+            cur += 1;
+    }
+    else if ( cur[0] == '.' && cur[1] == '/' )
+    {
+        cur += 2;
+        while ( *cur == '/' )
+            cur += 1;
+    }
+
+    lastSlash = strrchr(cur, '/');
+    if ( lastSlash == NULL || depth <= 0 )
+    {
+        /* Group under the start directory, "/" or "." (same as no directory) */
+        return ( cur == fname ) ? 0 : 1;
+    }
+
+    /* The directory ends where the run of slashes before the file name starts */
+    dirEnd = lastSlash;
+    while ( dirEnd > cur && dirEnd[-1] == '/' )
+        dirEnd--;
+
+    for( curDepth=0; curDepth < depth; curDepth++ )
+    {
+        nextSlash = strchr(cur, '/');
+
+        /* File is within a directory shallower than #depth */
+        if ( nextSlash >= dirEnd )
+            return dirEnd - fname;
+
+        /* A run of slashes separates just two components */
+        cur = nextSlash;
+        while ( *cur == '/' )
+            cur += 1;
+    }
+
+    /* Consumed #depth components, and the run of slashes after the last starts just before #cur */
+    while ( cur[-1] == '/' )
+        cur -= 1;
+
+    return cur - fname;
+}
+
+DirAggregateTable *DirAggregateTable_New(int depth)
+{
+    DirAggregateTable *ret;
+
+    ret = malloc( sizeof(DirAggregateTable) );
+
+    ret->numSlots = DIR_AGGREGATE_INITIAL_SLOTS;
+    ret->slots = calloc( ret->numSlots, sizeof(size_t) );
+
+    ret->groupsCapacity = DIR_AGGREGATE_INITIAL_SLOTS / 2;
+    ret->groups = malloc( sizeof(DirAggregate) * ret->groupsCapacity );
+    ret->numGroups = 0;
+
+    ret->depth = depth;
+
+    return ret;
+}
+
+void DirAggregateTable_Free(DirAggregateTable *table)
+{
+    free(table->groups);
+    free(table->slots);
+    free(table);
+}
+
+/*
+ * DirAggregateTable_Grow - Double the number of slots, and rehash.
+ */
+static void DirAggregateTable_Grow(DirAggregateTable *table)
+{
+    size_t i, slot, mask;
+
+    free(table->slots);
+
+    table->numSlots *= 2;
+    table->slots = calloc( table->numSlots, sizeof(size_t) );
+
+    mask = table->numSlots - 1;
+
+    for( i=0; i < table->numGroups; i++ )
+    {
+        slot = hashPrefix(table->groups[i].prefix, table->groups[i].prefixLen) & mask;
+        while ( table->slots[slot] != 0 )
+            slot = (slot + 1) & mask;
+
+        table->slots[slot] = i + 1;
+    }
+
+    table->groupsCapacity = table->numSlots / 2;
+    table->groups = realloc(table->groups, sizeof(DirAggregate) * table->groupsCapacity);
+}
+
+void DirAggregateTable_Add(DirAggregateTable *table, const NameStat *nameStat)
+{
+    const char *prefix;
+    size_t prefixLen, slot, mask;
+    DirAggregate *group;
+
+    prefix = nameStat->fname;
+    prefixLen = getDirPrefixLen(prefix, table->depth);
+    if ( prefixLen == 0 )
+    {
+        prefix = DOT_PREFIX;
+        prefixLen = 1;
+    }
+
+    mask = table->numSlots - 1;
+    slot = hashPrefix(prefix, prefixLen) & mask;
+
+    while ( table->slots[slot] != 0 )
+    {
+        group = &table->groups[ table->slots[slot] - 1 ];
+        if ( prefixEqual(group->prefix, group->prefixLen, prefix, prefixLen) )
+        {
+            group->count += 1;
+            group->totalSize += nameStat->statBuf.st_size;
+
+            if ( timespecCompare(&nameStat->fileTime, &group->minTime) < 0 )
+                group->minTime = nameStat->fileTime;
+
+            if ( timespecCompare(&nameStat->fileTime, &group->maxTime) > 0 )
+            {
+                group->maxTime = nameStat->fileTime;
+                group->newestName = nameStat->fname;
+            }
+            return;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    /* New group */
+    group = &table->groups[table->numGroups];
+
+    group->prefix = prefix;
+    group->prefixLen = prefixLen;
+    group->count = 1;
+    group->totalSize = nameStat->statBuf.st_size;
+    group->minTime = nameStat->fileTime;
+    group->maxTime = nameStat->fileTime;
+    group->newestName = nameStat->fname;
+
+    table->numGroups += 1;
+    table->slots[slot] = table->numGroups;
+
+    /* Keep load factor at or below 1/2 */
+    if ( unlikely( table->numGroups == table->groupsCapacity ) )
+        DirAggregateTable_Grow(table);
+}
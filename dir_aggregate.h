@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * dir_aggregate.h - Header for dir_aggregate.c
+ *
+ */
+#ifndef __DIR_AGGREGATE_H
+#define __DIR_AGGREGATE_H
+
+#include <time.h>
+#include <sys/types.h>
+
+#include "gather_mtimes.h"
+
+/*
+ * DirAggregate - Totals for all files under a single directory prefix
+ */
+typedef struct {
+    const char *prefix;     /* Points into the fname of the first file seen, NOT null-terminated */
+    size_t prefixLen;
+
+    size_t count;
+    off_t totalSize;
+
+    struct timespec minTime;
+    struct timespec maxTime;
+
+    const char *newestName; /* fname of the (first seen) file with #maxTime */
+
+} DirAggregate;
+
+/*
+ * DirAggregateTable - Hash aggregation of NameStats by directory prefix.
+ *
+ *   groups are kept in the order each prefix was first seen.
+ */
+typedef struct {
+    DirAggregate *groups;
+    size_t numGroups;
+    size_t groupsCapacity;
+
+    size_t *slots;          /* Open-addressed hash table of (group index + 1), 0 is empty */
+    size_t numSlots;        /* Always a power of 2 */
+
+    int depth;
+
+} DirAggregateTable;
+
+
+/**
+ * DirAggregateTable_New - Create a new table, grouping by the first #depth
+ *   directory components of each path.
+ */
+extern DirAggregateTable *DirAggregateTable_New(int depth);
+
+/**
+ * DirAggregateTable_Free - Free a table created by DirAggregateTable_New
+ */
+extern void DirAggregateTable_Free(DirAggregateTable *table);
+
+/**
+ * DirAggregateTable_Add - Add a (valid) NameStat to the group for its directory prefix.
+ *
+ *   The NameStat's fname must remain allocated for the life of the table.
+ *
+ *   Requires statBuf.st_size to have been gathered (NEED_FIELD_SIZE)
+ */
+extern void DirAggregateTable_Add(DirAggregateTable *table, const NameStat *nameStat);
+
+/**
+ * getDirPrefixLen - Get the length of the directory prefix of #fname, which is the
+ *   directory containing #fname truncated to at most #depth components.
+ *
+ *   A leading "/" or "./" does not count towards the depth, and a run of slashes separates
+ *     just two components (so "a//b" is the same directory as "a/b"). Files directly within
+ *     a shallower directory are grouped under that directory, and files
+ *     without any directory are grouped under "."
+ *
+ *   Returns 0 if there is no directory component.
+ */
+extern size_t getDirPrefixLen(const char *fname, int depth);
+
+#endif
@@ -4,24 +4,409 @@
  * gather_mtimes.c - Gathers filenames and mtimes from stdin
  */
 
+#ifndef _GNU_SOURCE
+  /* For statx */
+  #define _GNU_SOURCE
+#endif
+
 #include <features.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/sysmacros.h>
+#include <limits.h>
 
 #include "mtime_utils.h"
 
 #include "gather_mtimes.h"
+#include "records.h"
+#include "checkpoint.h"
+#include "ring_buffer.h"
+#include "path_index.h"
+#include "inode_set.h"
+#include "ordered_output.h"
+#include "decompress.h"
+
+#if defined(STATX_BTIME) && defined(AT_STATX_SYNC_AS_STAT)
+  #define HAS_STATX
+#endif
+
+static const char *TIME_FIELD_NAMES[] = { "mtime", "atime", "ctime", "btime" };
+
+int getTimeFieldByName(const char *name)
+{
+    int i;
+
+    for( i=0; i < sizeof(TIME_FIELD_NAMES) / sizeof(TIME_FIELD_NAMES[0]); i++ )
+    {
+        if ( strcmp(TIME_FIELD_NAMES[i], name) == 0 )
+        {
+            #if !defined(HAS_STATX)
+              /* Birth time is only available through statx */
+              if ( i == TIME_FIELD_BTIME )
+                  return -1;
+            #endif
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+const char *getTimeFieldName(int timeField)
+{
+    return TIME_FIELD_NAMES[timeField];
+}
+
+void initGatherOptions(GatherOptions *options)
+{
+    options->numThreads = 1;
+    options->showStats = 0;
+    options->useDirGroups = 1;
+    options->autoTune = 0;
+    options->usePipeline = 1;
+    options->checkpointFile = NULL;
+    options->resumeFile = NULL;
+    options->checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+    options->expectLines = 0;
+    options->uniqueMode = UNIQUE_NONE;
+    options->dedupInodes = DEDUP_INODES_NONE;
+    options->filter = NULL;
+    options->inputFiles = NULL;
+    options->inputStreams = NULL;
+    options->numInputFiles = 0;
+}
+
+int addGatherInputFile(GatherOptions *options, const char *filename)
+{
+    FILE *listFile;
+    struct stat statBuf;
+    int i;
+
+    listFile = NULL;
+    if ( strcmp(filename, "-") == 0 )
+    {
+        /* Two readers of the one stream would each take an arbitrary part of it */
+        for( i=0; i < options->numInputFiles; i++ )
+        {
+            if ( options->inputStreams[i] == NULL )
+            {
+                fputs("Err: - (stdin) may only be given once as a list.\n", stderr);
+                return -1;
+            }
+        }
+    }
+    else
+    {
+        listFile = fopen(filename, "r");
+        if ( unlikely( listFile == NULL ) )
+        {
+            fprintf(stderr, "Err: Cannot open list %s: %s\n", filename, strerror(errno));
+            return -1;
+        }
+
+        /* A directory opens, but cannot be read */
+        if ( fstat(fileno(listFile), &statBuf) == 0 && S_ISDIR(statBuf.st_mode) )
+        {
+            fprintf(stderr, "Err: Cannot read list %s: %s\n", filename, strerror(EISDIR));
+            fclose(listFile);
+            return -1;
+        }
+    }
+
+    options->inputFiles = realloc(options->inputFiles, sizeof(char *) * (options->numInputFiles + 1));
+    options->inputStreams = realloc(options->inputStreams, sizeof(FILE *) * (options->numInputFiles + 1));
+    options->inputFiles[options->numInputFiles] = filename;
+    options->inputStreams[options->numInputFiles] = listFile;
+    options->numInputFiles += 1;
+
+    return 0;
+}
+
+int handleGatherArg(GatherOptions *options, const char *arg)
+{
+    char *endPtr;
+    long numThreads;
+    long long interval;
+    long long expectLines;
+
+    if ( strstr(arg, "--threads=") == arg )
+    {
+        numThreads = strtol(arg + 10, &endPtr, 10);
+        if ( *endPtr != '\0' || endPtr == arg + 10 || numThreads < 0 )
+        {
+            fprintf(stderr, "Invalid number of threads: %s\n", arg + 10);
+            return -1;
+        }
+
+        if ( numThreads > MAX_SHARDS )
+            numThreads = MAX_SHARDS;
+
+        options->numThreads = (int)numThreads;
+        return 1;
+    }
+    else if ( strcmp("--stats", arg) == 0 )
+    {
+        options->showStats = 1;
+        return 1;
+    }
+    else if ( strstr(arg, "--checkpoint=") == arg && arg[13] != '\0' )
+    {
+        options->checkpointFile = arg + 13;
+        return 1;
+    }
+    else if ( strstr(arg, "--resume=") == arg && arg[9] != '\0' )
+    {
+        options->resumeFile = arg + 9;
+        return 1;
+    }
+    else if ( strstr(arg, "--checkpoint-interval=") == arg )
+    {
+        interval = strtoll(arg + 22, &endPtr, 10);
+        if ( *endPtr != '\0' || endPtr == arg + 22 || interval < 1 )
+        {
+            fprintf(stderr, "Invalid checkpoint interval: %s\n", arg + 22);
+            return -1;
+        }
+
+        options->checkpointInterval = (size_t)interval;
+        return 1;
+    }
+    else if ( strstr(arg, "--expect-lines=") == arg )
+    {
+        expectLines = strtoll(arg + 15, &endPtr, 10);
+        if ( *endPtr != '\0' || endPtr == arg + 15 || expectLines < 0 )
+        {
+            fprintf(stderr, "Invalid number of expected lines: %s\n", arg + 15);
+            return -1;
+        }
+
+        options->expectLines = (size_t)expectLines;
+        return 1;
+    }
+    else if ( strcmp("--unique", arg) == 0 || strcmp("--unique=first", arg) == 0 )
+    {
+        options->uniqueMode = UNIQUE_FIRST;
+        return 1;
+    }
+    else if ( strcmp("--unique=all", arg) == 0 )
+    {
+        options->uniqueMode = UNIQUE_ALL;
+        return 1;
+    }
+    else if ( strstr(arg, "--unique=") == arg )
+    {
+        fprintf(stderr, "Unknown unique mode: %s\n", arg + 9);
+        return -1;
+    }
+    else if ( strcmp("--dedup-inodes", arg) == 0 || strcmp("--dedup-inodes=first", arg) == 0 )
+    {
+        options->dedupInodes = DEDUP_INODES_FIRST;
+        return 1;
+    }
+    else if ( strcmp("--dedup-inodes=names", arg) == 0 )
+    {
+        options->dedupInodes = DEDUP_INODES_NAMES;
+        return 1;
+    }
+    else if ( strstr(arg, "--dedup-inodes=") == arg )
+    {
+        fprintf(stderr, "Unknown inode dedup mode: %s\n", arg + 15);
+        return -1;
+    }
+    else if ( (strstr(arg, "--include=") == arg && arg[10] != '\0') || (strstr(arg, "--exclude=") == arg && arg[10] != '\0') )
+    {
+        if ( options->filter == NULL )
+            options->filter = PathFilter_New();
+
+        return PathFilter_Add(options->filter, arg + 10, arg[2] == 'e', 0) == 0 ? 1 : -1;
+    }
+    else if ( (strstr(arg, "--include-regex=") == arg && arg[16] != '\0') || (strstr(arg, "--exclude-regex=") == arg && arg[16] != '\0') )
+    {
+        if ( options->filter == NULL )
+            options->filter = PathFilter_New();
+
+        return PathFilter_Add(options->filter, arg + 16, arg[2] == 'e', 1) == 0 ? 1 : -1;
+    }
+    else if ( strcmp("--auto", arg) == 0 )
+    {
+        options->autoTune = 1;
+        return 1;
+    }
+    else if ( strcmp("--no-pipeline", arg) == 0 )
+    {
+        options->usePipeline = 0;
+        return 1;
+    }
+    else if ( strcmp("--no-dir-groups", arg) == 0 )
+    {
+        options->useDirGroups = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+int checkServeGatherOptions(const GatherOptions *options)
+{
+    /* Each batch is gathered on its own, there is no one gather to save or resume */
+    if ( options->checkpointFile != NULL || options->resumeFile != NULL )
+    {
+        fputs("--serve cannot be combined with --checkpoint or --resume\n", stderr);
+        return 0;
+    }
+
+    if ( options->numInputFiles > 0 )
+    {
+        fputs("--serve reads batches from stdin, so cannot be given list files\n", stderr);
+        return 0;
+    }
+
+    return 1;
+}
+
+void printGatherUsage(void)
+{
+    fputs("      [list files]  Read filenames from each of these files (- is stdin) instead of stdin.\n", stderr);
+    fputs("                      Each list is read and stat'd concurrently, sharing --threads, and\n", stderr);
+    fputs("                      the results are taken in the order the lists are given.\n", stderr);
+    fputs("                      Lists (and stdin) may be gzip or zstd compressed, if built with\n", stderr);
+    fputs("                      WITH_ZLIB=1 or WITH_ZSTD=1.\n\n", stderr);
+    fputs("      --threads=N   Stat files using N worker threads, each owning a shard of the results\n", stderr);
+    fputs("                      placed on its own NUMA node. 0 is one per cpu. Default is 1.\n\n", stderr);
+    fputs("      --auto        Choose the number of threads (overriding --threads) by timing the\n", stderr);
+    fputs("                      first files stat'd. Use with --stats to see the plan chosen.\n\n", stderr);
+    fputs("      --stats       Print timings and worker layout to stderr when done.\n\n", stderr);
+    fputs("      --checkpoint=FILE  Record progress to FILE every --checkpoint-interval=N files\n", stderr);
+    fputs("                           (default 100000), so a killed run can be resumed.\n\n", stderr);
+    fputs("      --resume=FILE  Restore progress from the checkpoint FILE, and only stat the\n", stderr);
+    fputs("                       files after it. Usually given with the same --checkpoint=FILE\n\n", stderr);
+    fputs("      --no-dir-groups  Stat every file by its full path, instead of opening each\n", stderr);
+    fputs("                         directory once and stat'ing the files within relative to it.\n\n", stderr);
+    fputs("      --unique[=X]     Stat each path listed more than once only once. X is one of:\n", stderr);
+    fputs("                         first - Keep only the first line of each path (default)\n", stderr);
+    fputs("                         all   - Keep every line, sharing the one result\n\n", stderr);
+    fputs("      --dedup-inodes[=X]  Treat hard links to the same file as one file. X is one of:\n", stderr);
+    fputs("                            first - Keep only the first name of each file (default)\n", stderr);
+    fputs("                            names - Keep every name, but count each file once in totals\n\n", stderr);
+    fputs("      --expect-lines=N  Expect about N lines of input, so a piped list can be read into\n", stderr);
+    fputs("                          a buffer allocated once (and backed by huge pages where available)\n", stderr);
+    fputs("                          instead of one grown as it is read. Input redirected from a\n", stderr);
+    fputs("                          file (< list) is always sized this way.\n\n", stderr);
+    fputs("      --include=GLOB   Only gather paths matching GLOB, where * matches any characters\n", stderr);
+    fputs("                         (including /), ? any one, and [...] one of a class. May be given\n", stderr);
+    fputs("                         more than once, to gather paths matching any. e.x. --include='*.log'\n\n", stderr);
+    fputs("      --exclude=GLOB   Drop paths matching GLOB. May be given more than once, and\n", stderr);
+    fputs("                         overrides --include. Paths are matched before they are stat'd.\n\n", stderr);
+    fputs("      --include-regex=RE  --exclude-regex=RE  As --include and --exclude, with a POSIX\n", stderr);
+    fputs("                         extended regular expression, matching anywhere in the path.\n\n", stderr);
+    fputs("      --no-pipeline    Read all input before stat'ing, and stat everything before output.\n", stderr);
+    fputs("                         By default get_mtime, get_owner and get_group overlap the three.\n\n", stderr);
+}
+
+static const char *LATENCY_CLASS_NAMES[] = { "cached", "disk", "remote" };
+
+void printGatherStats(const ReadNameStatBuffers *buffers)
+{
+    int i;
+
+    fprintf(stderr, "stats: entries=%zu read=%.6fs gather=%.6fs shards=%d numa_nodes=%d dir_groups=%zu\n",
+        buffers->stats.numEntries, buffers->stats.readSeconds, buffers->stats.statSeconds,
+        buffers->numShards, getNumNumaNodes(), buffers->stats.numDirGroups);
+
+    fprintf(stderr, "stats: faults: read=%ld gather=%ld major=%ld\n",
+        buffers->stats.readMinorFaults, buffers->stats.minorFaults - buffers->stats.readMinorFaults, buffers->stats.majorFaults);
+
+    if ( buffers->stats.inputBufferSize > 0 )
+    {
+        fprintf(stderr, "stats: input buffer: size=%zu backing=%s sized_from=%s\n", buffers->stats.inputBufferSize,
+            getHugeKindName(buffers->stats.inputBufferKind), buffers->stats.inputSizeSource);
+    }
+
+    if ( buffers->stats.compression != COMPRESSION_NONE )
+    {
+        fprintf(stderr, "stats: input: compression=%s compressed=%zu frames=%zu decompress=%.6fs\n",
+            getCompressionName(buffers->stats.compression), buffers->stats.compressedSize,
+            buffers->stats.numCompressedFrames, buffers->stats.decompressSeconds);
+    }
+
+    if ( buffers->stats.numBatches > 0 )
+    {
+        fprintf(stderr, "stats: pipeline: batches=%zu workers=%d (gather is the time after input ended)\n",
+            buffers->stats.numBatches, buffers->stats.numPipelineWorkers);
+    }
+
+    if ( buffers->options.uniqueMode != UNIQUE_NONE )
+        fprintf(stderr, "stats: unique: duplicates=%zu (not stat'd)\n", buffers->stats.numDuplicates);
+
+    if ( buffers->options.dedupInodes != DEDUP_INODES_NONE )
+        fprintf(stderr, "stats: inodes: repeated=%zu\n", buffers->stats.numRepeatedInodes);
+
+    if ( buffers->options.filter != NULL )
+        fprintf(stderr, "stats: filter: dropped=%zu (not stat'd)\n", buffers->stats.numFiltered);
+
+    if ( buffers->numSourceBuffers > 0 )
+    {
+        fprintf(stderr, "stats: lists=%d (each read and gathered concurrently)\n", buffers->numSourceBuffers);
+        for( i=0; i < buffers->numSourceBuffers; i++ )
+        {
+            fprintf(stderr, "stats:   list %s: entries=%zu read=%.6fs gather=%.6fs\n", buffers->options.inputFiles[i],
+                buffers->sourceBuffers[i]->stats.numEntries, buffers->sourceBuffers[i]->stats.readSeconds,
+                buffers->sourceBuffers[i]->stats.statSeconds);
+        }
+    }
+
+    if ( buffers->options.resumeFile != NULL )
+        fprintf(stderr, "stats: resumed=%zu from %s\n", buffers->stats.numResumed, buffers->options.resumeFile);
+
+    if ( buffers->plan.isAutoTuned )
+    {
+        fprintf(stderr, "stats: plan: auto sample=%zu latency=%.2fus class=%s backend=%s threads=%d\n",
+            buffers->plan.sampleSize, buffers->plan.sampleLatency * 1000000.0,
+            LATENCY_CLASS_NAMES[buffers->plan.latencyClass], buffers->plan.backend, buffers->plan.numThreads);
+    }
+
+    if ( buffers->numShards > 1 )
+    {
+        for( i=0; i < buffers->numShards; i++ )
+        {
+            fprintf(stderr, "stats:   shard %d: entries=%zu node=%d\n", i,
+                buffers->shards[i].end - buffers->shards[i].start, buffers->shards[i].node);
+        }
+    }
+}
+
+int getInputFormatByName(const char *name)
+{
+    if ( strcmp("list", name) == 0 )
+        return INPUT_FORMAT_LIST;
+    if ( strcmp("epoch", name) == 0 )
+        return INPUT_FORMAT_EPOCH;
+
+    return -1;
+}
 
 /*
  * BUF_SIZE - Number of bytes we read from stdin in a single block.
  */
 #define BUF_SIZE 65535
 
+/*
+ * Tuning for autoTuneThreads
+ */
+#define AUTO_SAMPLE_SIZE 2048                   /* Files stat'd to measure latency */
+#define AUTO_CACHED_LATENCY 0.000005            /* Mean seconds per stat below which stats are cached */
+#define AUTO_DISK_LATENCY 0.0005                /* Mean seconds per stat below which stats are local */
+#define AUTO_CACHED_ENTRIES_PER_THREAD 16384    /* Fewest remaining files worth a thread, when cached */
+#define AUTO_SLOW_ENTRIES_PER_THREAD 64         /* Fewest remaining files worth a thread, otherwise */
+
 /* 
  * getNumLines - Count the number of newline characters in buffer
  */
@@ -81,7 +466,7 @@ static char** splitLines(char *buf, size_t *numLines)
         return ret;
     }
 
-    ret = malloc( sizeof(char*) * (_numLines) );
+    ret = hugeMalloc( sizeof(char*) * (_numLines), 0 );
 
     /* Point first line to start of the buff */
     ret[0] = buf;
@@ -146,176 +531,2441 @@ static char** splitLines(char *buf, size_t *numLines)
     return ret;
 }
 
-/**
- * getNameStats - Take in a list of names (and a size),
- *   query the mtimes for each, and return a list of NameStat objects
- *   intended for sorting.
- *
- *   If a file cannot be lstat'd, a message will be printed to stderr,
- *   and the mtime will be set to 0. These items should not be printed.
+#if defined(HAS_STATX)
+
+/*
+ * getStatxMask - Get the statx mask of only the fields we need
  */
-static NameStat* getNameStats( char **names, size_t numLines )
+static unsigned int getStatxMask(int timeField, int needFields)
 {
-    NameStat *ret;
-    int i;
+    unsigned int mask = 0;
 
-    int statRet;
+    switch( timeField )
+    {
+        case TIME_FIELD_ATIME:
+            mask |= STATX_ATIME;
+            break;
+        case TIME_FIELD_CTIME:
+            mask |= STATX_CTIME;
+            break;
+        case TIME_FIELD_BTIME:
+            mask |= STATX_BTIME;
+            break;
+        default:
+            mask |= STATX_MTIME;
+            break;
+    }
 
-    ret = malloc( sizeof(NameStat) * (numLines + 1 ) );
+    if ( needFields & NEED_FIELD_UID )
+        mask |= STATX_UID;
+    if ( needFields & NEED_FIELD_GID )
+        mask |= STATX_GID;
+    if ( needFields & NEED_FIELD_SIZE )
+        mask |= STATX_SIZE;
+    if ( needFields & NEED_FIELD_MODE )
+        mask |= STATX_TYPE | STATX_MODE;
+    if ( needFields & NEED_FIELD_INO )
+        mask |= STATX_INO | STATX_NLINK;
+
+    return mask;
+}
 
-    for ( i=0; i < numLines; i++ )
+/*
+ * statxNameStat - statx a single file, asking only for the fields in #mask,
+ *   and fill in #nameStat
+ *
+ *   The file is #name relative to the directory #dirFd (or AT_FDCWD)
+ *
+ *   Returns 0 on success, -1 on error.
+ */
+static inline int statxNameStat(NameStat *nameStat, int dirFd, const char *name, int timeField, unsigned int mask)
+{
+    struct statx statxBuf;
+    struct stat *statBuf;
+    struct statx_timestamp *stamp;
+
+    if ( unlikely( statx(dirFd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, mask, &statxBuf) < 0 ) )
+        return -1;
+
+    statBuf = &nameStat->statBuf;
+    memset(statBuf, 0x0, sizeof(struct stat));
+
+    statBuf->st_dev = makedev(statxBuf.stx_dev_major, statxBuf.stx_dev_minor);
+    statBuf->st_ino = statxBuf.stx_ino;
+    statBuf->st_mode = statxBuf.stx_mode;
+    statBuf->st_nlink = statxBuf.stx_nlink;
+    statBuf->st_uid = statxBuf.stx_uid;
+    statBuf->st_gid = statxBuf.stx_gid;
+    statBuf->st_size = statxBuf.stx_size;
+    statBuf->st_blksize = statxBuf.stx_blksize;
+    statBuf->st_blocks = statxBuf.stx_blocks;
+    statBuf->st_atim.tv_sec = statxBuf.stx_atime.tv_sec;
+    statBuf->st_atim.tv_nsec = statxBuf.stx_atime.tv_nsec;
+    statBuf->st_mtim.tv_sec = statxBuf.stx_mtime.tv_sec;
+    statBuf->st_mtim.tv_nsec = statxBuf.stx_mtime.tv_nsec;
+    statBuf->st_ctim.tv_sec = statxBuf.stx_ctime.tv_sec;
+    statBuf->st_ctim.tv_nsec = statxBuf.stx_ctime.tv_nsec;
+
+    switch( timeField )
     {
-
-        ret[i].fname = names[i];
-        statRet = lstat(names[i], &ret[i].statBuf);
-        if ( unlikely( statRet < 0 ) )
-        {
-            fprintf(stderr, "Err: Cannot stat file: %s\n", ret[i].fname);
-            
-            memset(&ret[i].statBuf, 0x0, sizeof(struct stat));
-        }
+        case TIME_FIELD_ATIME:
+            stamp = &statxBuf.stx_atime;
+            break;
+        case TIME_FIELD_CTIME:
+            stamp = &statxBuf.stx_ctime;
+            break;
+        case TIME_FIELD_BTIME:
+            /* Not every filesystem records a birth time */
+            if ( unlikely( !(statxBuf.stx_mask & STATX_BTIME) ) )
+                return -1;
+            stamp = &statxBuf.stx_btime;
+            break;
+        default:
+            stamp = &statxBuf.stx_mtime;
+            break;
     }
 
-    return ret;
+    nameStat->fileTime.tv_sec = stamp->tv_sec;
+    nameStat->fileTime.tv_nsec = stamp->tv_nsec;
 
+    return 0;
 }
 
-ReadNameStatBuffers *initReadNameStatBuffers(void)
+#endif
+
+/*
+ * lstatNameStat - lstat a single file and fill in #nameStat
+ *
+ *   The file is #name relative to the directory #dirFd (or AT_FDCWD)
+ *
+ *   Returns 0 on success, -1 on error.
+ */
+static inline int lstatNameStat(NameStat *nameStat, int dirFd, const char *name, int timeField)
 {
-    ReadNameStatBuffers *buffers;
+    if ( unlikely( fstatat(dirFd, name, &nameStat->statBuf, AT_SYMLINK_NOFOLLOW) < 0 ) )
+        return -1;
 
-    buffers = malloc( sizeof(ReadNameStatBuffers) );
+    switch( timeField )
+    {
+        case TIME_FIELD_ATIME:
+            nameStat->fileTime = nameStat->statBuf.st_atim;
+            break;
+        case TIME_FIELD_CTIME:
+            nameStat->fileTime = nameStat->statBuf.st_ctim;
+            break;
+        default:
+            nameStat->fileTime = nameStat->statBuf.st_mtim;
+            break;
+    }
 
-    #if defined(HAS_MSTREAM)
-      /* Open an automatically-expanding memstream, into which we will write eveything on stdin */
-      buffers->inputStream = open_memstream( &(buffers->inputStreamBuf), &(buffers->inputStreamSize));
-      if ( unlikely( !(buffers->inputStream) ) )
-      {
-          fputs("Failed to allocate memory stream.\n", stderr);
-          return NULL;
-      }
-      /* fflush here to set inputStreamBuf to allocated buffer, and 0 inputStreamSize */
-      fflush(buffers->inputStream);
-    #else
-      /* Otherwise, use a tmpfile */
-      buffers->inputStream = tmpfile();
-      if ( unlikely( !(buffers->inputStream) ) )
-      {
-        fputs("Failed to create temp file.\n", stderr);
-        return NULL;
-      }
-      buffers->inputStreamBuf = NULL;
-      buffers->inputStreamSize = 0;
+    return 0;
+}
+
+/* Set once any worker finds the kernel lacks statx */
+static volatile int statxUnsupported = 0;
+
+/*
+ * getStatBackendName - Get the name of the call used to stat files
+ */
+static const char *getStatBackendName(void)
+{
+    #if defined(HAS_STATX)
+      if ( likely( !statxUnsupported ) )
+          return "statx";
     #endif
 
-    buffers->lines = NULL;
-    
-    return buffers;
+    return "lstat";
 }
 
-void destroyReadNameStatBuffers(ReadNameStatBuffers *buffers)
+/*
+ * getParentLen - Get the length of the directory portion of #path, including the final '/',
+ *   or 0 if #path has no directory portion (or names a directory itself, e.x. "dir/")
+ */
+static inline size_t getParentLen(const char *path)
 {
-    free(buffers->lines);
+    const char *lastSlash;
 
-    fclose(buffers->inputStream);
+    lastSlash = strrchr(path, '/');
+    if ( lastSlash == NULL || lastSlash[1] == '\0' )
+        return 0;
 
-    free(buffers->inputStreamBuf);
-    free(buffers);
+    return (size_t)(lastSlash - path) + 1;
 }
 
-
-NameStat* readAndCreateNameStats(ReadNameStatBuffers *buffers, size_t *numEntries, FILE *stream)
+/*
+ * openParentDir - Open the directory portion (#parentLen bytes) of #path, for use with *at calls
+ *
+ *   Returns the directory fd, or -1 on failure
+ */
+static int openParentDir(const char *path, size_t parentLen)
 {
-    size_t numBytesRead;
-    char *buf;
+    char dirName[PATH_MAX];
 
-    char **lines;
-    NameStat* nameTimes;
-    FILE *inputStream;
-    char *inputStreamBuf;
+    if ( unlikely( parentLen >= PATH_MAX ) )
+        return -1;
 
+    memcpy(dirName, path, parentLen);
+    dirName[parentLen] = '\0';
 
-    numBytesRead = 0;
-    buf = malloc( BUF_SIZE );
+    return open(dirName, O_PATH | O_DIRECTORY | O_CLOEXEC);
+}
 
-    inputStream = buffers->inputStream;
+/*
+ * statRange - Stat entries [#start, #end) of #names into the same entries of #nameStats
+ *
+ *   If #useDirGroups is set, when consecutive names share a parent directory
+ *     (as find outputs them), that directory is opened once and each file in the run
+ *     is stat'd by its basename relative to it, rather than walking the full path every time.
+ *
+ *   If a file cannot be lstat'd, a message will be printed to stderr,
+ *   and the mtime will be set to 0. These items should not be printed.
+ *
+ *   Returns the number of directories opened
+ */
+static size_t statRange( NameStat *nameStats, char **names, size_t start, size_t end, int timeField, int needFields, int useDirGroups )
+{
+    size_t i;
+    int statRet;
+    int dirFd;
+    size_t dirLen, parentLen, numDirGroups;
+    const char *dirPath;
+    const char *statName;
 
-    /* 
-     * Read from stream into a temp buff, then write the same
-     *   into the memstream
-     */
-    do {
-        numBytesRead = fread(buf, 1, BUF_SIZE, stream);
-        fwrite(buf, 1, numBytesRead, inputStream);
-        fflush(inputStream);
-    }while ( ! feof(stream) );
+    #if defined(HAS_STATX)
+      unsigned int statxMask;
+      int useStatx = 1;
 
-    free(buf);
+      statxMask = getStatxMask(timeField, needFields);
+    #endif
 
-    /* If we did not read any data, just exit */
-    if ( unlikely( numBytesRead == 0 ) )
-        return NULL;
+    dirFd = AT_FDCWD;
+    dirPath = NULL;
+    dirLen = 0;
+    numDirGroups = 0;
 
-    #if !defined(HAS_MSTREAM)
-      /* If we don't have mstream support, then we use a tmpfile, and must manually
-       *   set our sizes and read our data
-       */
-      struct stat statBuf;
-      fstat( fileno(inputStream), &statBuf);
+    for ( i=start; i < end; i++ )
+    {
 
-      if ( buffers->inputStreamBuf == NULL )
-      {
-          /* First read on this buffer */
-          buffers->inputStreamSize = statBuf.st_size;
-          buffers->inputStreamBuf = malloc( statBuf.st_size + 1 );
+        nameStats[i].fname = names[i];
+        statName = names[i];
 
-          rewind(inputStream);
-          read( fileno(inputStream), buffers->inputStreamBuf, buffers->inputStreamSize );
-      }
-      else
-      {
-        /* This function has been called before. Copy buffers and append */
-        size_t oldSize = buffers->inputStreamSize;
+        if ( useDirGroups )
+        {
+            parentLen = getParentLen(names[i]);
+
+            if ( dirPath == NULL || parentLen != dirLen || memcmp(dirPath, names[i], parentLen) != 0 )
+            {
+                /* Left the previous run */
+                if ( dirFd != AT_FDCWD )
+                    close(dirFd);
+
+                dirFd = AT_FDCWD;
+                dirPath = NULL;
+
+                /* Only worth opening the directory if the next file shares it */
+                if ( parentLen != 0 && i + 1 < end && strncmp(names[i], names[i+1], parentLen) == 0 && getParentLen(names[i+1]) == parentLen )
+                {
+                    dirFd = openParentDir(names[i], parentLen);
+                    if ( likely( dirFd >= 0 ) )
+                    {
+                        dirPath = names[i];
+                        dirLen = parentLen;
+                        numDirGroups += 1;
+                    }
+                    else
+                    {
+                        dirFd = AT_FDCWD;
+                    }
+                }
+            }
+
+            if ( dirPath != NULL )
+                statName = names[i] + dirLen;
+        }
 
-        buffers->inputStreamSize = statBuf.st_size;
-        buffers->inputStreamBuf = realloc(buffers->inputStreamBuf, statBuf.st_size + 1);
+        #if defined(HAS_STATX)
+          if ( likely( useStatx ) )
+          {
+              statRet = statxNameStat(&nameStats[i], dirFd, statName, timeField, statxMask);
+
+              /* Running on a kernel without statx, fall back to lstat (which cannot provide btime) */
+              if ( unlikely( statRet < 0 && errno == ENOSYS && timeField != TIME_FIELD_BTIME ) )
+              {
+                  useStatx = 0;
+                  statxUnsupported = 1;
+                  statRet = lstatNameStat(&nameStats[i], dirFd, statName, timeField);
+              }
+          }
+          else
+          {
+              statRet = lstatNameStat(&nameStats[i], dirFd, statName, timeField);
+          }
+        #else
+          statRet = lstatNameStat(&nameStats[i], dirFd, statName, timeField);
+        #endif
 
-        fseek( inputStream, oldSize, SEEK_SET );
-        read( fileno(inputStream), &buffers->inputStreamBuf[oldSize], buffers->inputStreamSize - oldSize );
-      }
-      buffers->inputStreamBuf[buffers->inputStreamSize] = '\0';
-    #endif
+        if ( unlikely( statRet < 0 ) )
+        {
+            fprintf(stderr, "Err: Cannot stat file: %s\n", nameStats[i].fname);
+            
+            memset(&nameStats[i].statBuf, 0x0, sizeof(struct stat));
+            nameStats[i].fileTime.tv_sec = 0;
+            nameStats[i].fileTime.tv_nsec = 0;
+        }
+    }
 
-    inputStreamBuf = buffers->inputStreamBuf;
+    if ( dirFd != AT_FDCWD )
+        close(dirFd);
 
-    /* Treat just newline same as no data */
-    if ( unlikely( numBytesRead == 1 && *inputStreamBuf == '\n' ) )
-        return NULL;
+    return numDirGroups;
+}
 
-    /* If we did not have a final newline, append one. */
-    if( inputStreamBuf[numBytesRead - 1] != '\n' )
+/*
+ * StatWorkerArgs - Shared arguments of each statShardWorker
+ */
+typedef struct {
+    NameStat *nameStats;
+    char **names;
+    int timeField;
+    int needFields;
+    int useDirGroups;
+
+    /* The first #sampleSize entries were already stat'd into #sample (see autoTuneThreads) */
+    NameStat *sample;
+    size_t sampleSize;
+
+    size_t numDirGroups[MAX_SHARDS];    /* Per shard, see statRange */
+
+} StatWorkerArgs;
+
+/*
+ * statShardWorker - Stat all the entries of a single shard
+ *   ( This thread is the first to touch the shard's memory )
+ */
+static void statShardWorker(int shardIdx, NameStatShard *shard, void *_args)
+{
+    StatWorkerArgs *args = (StatWorkerArgs *)_args;
+    size_t start;
+
+    start = shard->start;
+    if ( start < args->sampleSize )
+    {
+        start = shard->end < args->sampleSize ? shard->end : args->sampleSize;
+        memcpy(&args->nameStats[shard->start], &args->sample[shard->start], sizeof(NameStat) * (start - shard->start));
+    }
+
+    args->numDirGroups[shardIdx] = statRange(args->nameStats, args->names, start, shard->end,
+        args->timeField, args->needFields, args->useDirGroups);
+}
+
+/*
+ * statWithCheckpoints - Stat the entries of #args, restoring those already gathered from
+ *   buffers->options.resumeFile, and appending progress to buffers->options.checkpointFile
+ *   after every checkpointInterval files.
+ *
+ *   Each interval is split between #numThreads workers in turn, so unlike the usual
+ *     gather, shards are not first touched by the worker which owns them.
+ *
+ *   If the checkpoint cannot be written, the gather carries on without it.
+ */
+static void statWithCheckpoints(ReadNameStatBuffers *buffers, StatWorkerArgs *args, size_t numLines, int numThreads)
+{
+    GatherOptions *options = &buffers->options;
+    NameStatShard chunkShards[MAX_SHARDS];
+    FILE *checkpoint = NULL;
+    size_t numDone, chunkEnd;
+    off_t validSize = 0;
+    int numChunkShards, i;
+
+    numDone = 0;
+    if ( options->resumeFile != NULL )
+    {
+        numDone = loadCheckpoint(options->resumeFile, args->nameStats, args->names, numLines, buffers->timeField, buffers->needFields, &validSize);
+        buffers->stats.numResumed = numDone;
+    }
+
+    if ( options->checkpointFile != NULL )
+    {
+        checkpoint = openCheckpoint(options->checkpointFile,
+            options->resumeFile != NULL && strcmp(options->resumeFile, options->checkpointFile) == 0,
+            validSize, args->nameStats, numDone, buffers->timeField);
+    }
+
+    while ( numDone < numLines )
+    {
+        chunkEnd = numDone + options->checkpointInterval;
+        if ( chunkEnd > numLines )
+            chunkEnd = numLines;
+
+        numChunkShards = splitShards(chunkEnd - numDone, sizeof(NameStat), numThreads, chunkShards);
+        for( i=0; i < numChunkShards; i++ )
+        {
+            chunkShards[i].start += numDone;
+            chunkShards[i].end += numDone;
+        }
+
+        runShardWorkers(chunkShards, numChunkShards, statShardWorker, args);
+
+        for( i=0; i < numChunkShards; i++ )
+            buffers->stats.numDirGroups += args->numDirGroups[i];
+
+        if ( checkpoint != NULL && unlikely( appendCheckpoint(checkpoint, args->nameStats, numDone, chunkEnd) < 0 ) )
+        {
+            fclose(checkpoint);
+            checkpoint = NULL;
+        }
+
+        numDone = chunkEnd;
+    }
+
+    if ( checkpoint != NULL )
+        fclose(checkpoint);
+}
+
+/*
+ * autoTuneThreads - Stat a sample of the first files on this thread, and from their mean latency
+ *   choose how many workers to stat the rest with.
+ *
+ *   Cached stats are cpu-bound, so use up to one worker per cpu, and only when there are enough
+ *     files to pay for the threads. Stats which wait on a disk or the network gain from having
+ *     more requests in flight than there are cpus.
+ *
+ *   Fills buffers->plan, and returns the sample (of buffers->plan.sampleSize entries), or NULL on failure.
+ */
+static NameStat *autoTuneThreads( ReadNameStatBuffers *buffers, char **names, size_t numLines )
+{
+    NameStat *sample;
+    GatherPlan *plan = &buffers->plan;
+    size_t sampleSize, numRemaining, maxThreads;
+    double startTime;
+    int numCpus, numThreads;
+
+    sampleSize = numLines < AUTO_SAMPLE_SIZE ? numLines : AUTO_SAMPLE_SIZE;
+
+    sample = malloc( sizeof(NameStat) * (sampleSize + 1) );
+    if ( unlikely( sample == NULL ) )
+        return NULL;
+
+    startTime = getMonotonicSeconds();
+    buffers->stats.numDirGroups += statRange(sample, names, 0, sampleSize, buffers->timeField, buffers->needFields, buffers->options.useDirGroups);
+
+    plan->isAutoTuned = 1;
+    plan->sampleSize = sampleSize;
+    plan->sampleLatency = sampleSize ? (getMonotonicSeconds() - startTime) / sampleSize : 0.0;
+
+    numCpus = getNumCpus();
+    numRemaining = numLines - sampleSize;
+
+    if ( plan->sampleLatency < AUTO_CACHED_LATENCY )
+    {
+        plan->latencyClass = LATENCY_CLASS_CACHED;
+        numThreads = numCpus;
+        maxThreads = numRemaining / AUTO_CACHED_ENTRIES_PER_THREAD;
+    }
+    else if ( plan->sampleLatency < AUTO_DISK_LATENCY )
+    {
+        plan->latencyClass = LATENCY_CLASS_DISK;
+        numThreads = numCpus * 2;
+        maxThreads = numRemaining / AUTO_SLOW_ENTRIES_PER_THREAD;
+    }
+    else
+    {
+        plan->latencyClass = LATENCY_CLASS_REMOTE;
+        numThreads = numCpus * 8;
+        maxThreads = numRemaining / AUTO_SLOW_ENTRIES_PER_THREAD;
+    }
+
+    if ( (size_t)numThreads > maxThreads )
+        numThreads = (int)maxThreads;
+    if ( numThreads > MAX_SHARDS )
+        numThreads = MAX_SHARDS;
+    if ( numThreads < 1 )
+        numThreads = 1;
+
+    plan->numThreads = numThreads;
+
+    return sample;
+}
+
+/**
+ * getNameStats - Take in a list of names (and a size),
+ *   query the mtimes for each, and return a list of NameStat objects
+ *   intended for sorting.
+ *
+ *   The timestamp gathered into NameStat.fileTime is selected by timeField,
+ *     and only that plus the attributes in needFields are requested from the kernel.
+ *
+ *   The work is split between buffers->options.numThreads workers (or as many as
+ *     autoTuneThreads picks), each of which owns (and first touches) a page-aligned
+ *     shard of the returned array. The layout is recorded in buffers->shards.
+ *
+ *   Runs of files in the same directory are stat'd relative to that directory (see statRange),
+ *     so with multiple workers, directory groups are stat'd in parallel.
+ *
+ *   With a checkpoint or resume file, progress is saved and restored (see statWithCheckpoints)
+ *
+ *   If a file cannot be lstat'd, a message will be printed to stderr,
+ *   and the mtime will be set to 0. These items should not be printed.
+ */
+static NameStat* getNameStats( ReadNameStatBuffers *buffers, char **names, size_t numLines )
+{
+    NameStat *ret;
+    StatWorkerArgs args;
+    int numThreads, i;
+
+    args.sample = NULL;
+    args.sampleSize = 0;
+
+    /* Checkpoints hold every field a record can carry, so that any tool may resume from them */
+    if ( buffers->options.checkpointFile != NULL || buffers->options.resumeFile != NULL )
+    {
+        buffers->needFields |= RECORD_FIELDS;
+        buffers->gatheredFields |= RECORD_FIELDS;
+    }
+
+    if ( buffers->options.autoTune )
+    {
+        args.sample = autoTuneThreads(buffers, names, numLines);
+        if ( unlikely( args.sample == NULL ) )
+            return NULL;
+
+        args.sampleSize = buffers->plan.sampleSize;
+        numThreads = buffers->plan.numThreads;
+    }
+    else
+    {
+        numThreads = buffers->options.numThreads;
+        if ( numThreads == 0 )
+            numThreads = getNumCpus();
+    }
+
+    if ( numThreads <= 1 )
+    {
+        ret = malloc( sizeof(NameStat) * (numLines + 1 ) );
+        buffers->numShards = splitShards(numLines, sizeof(NameStat), 1, buffers->shards);
+    }
+    else
+    {
+        buffers->numShards = numThreads;
+        ret = allocShardedArray(numLines, sizeof(NameStat), &buffers->numShards, buffers->shards);
+    }
+
+    if ( unlikely( ret == NULL ) )
+    {
+        free(args.sample);
+        return NULL;
+    }
+
+    args.nameStats = ret;
+    args.names = names;
+    args.timeField = buffers->timeField;
+    args.needFields = buffers->needFields;
+    args.useDirGroups = buffers->options.useDirGroups;
+
+    if ( buffers->options.checkpointFile != NULL || buffers->options.resumeFile != NULL )
+    {
+        statWithCheckpoints(buffers, &args, numLines, buffers->numShards);
+    }
+    else
+    {
+        runShardWorkers(buffers->shards, buffers->numShards, statShardWorker, &args);
+
+        for( i=0; i < buffers->numShards; i++ )
+            buffers->stats.numDirGroups += args.numDirGroups[i];
+    }
+
+    free(args.sample);
+
+    buffers->plan.backend = getStatBackendName();
+    buffers->plan.numThreads = buffers->numShards;
+
+    return ret;
+
+}
+
+/*
+ * ExpandWorkerArgs - Shared arguments of each expandShardWorker
+ */
+typedef struct {
+    NameStat *nameStats;
+    NameStat *distinctStats;
+    size_t *distinctIdxs;
+    char **names;
+
+} ExpandWorkerArgs;
+
+/*
+ * expandShardWorker - Fill each entry of a single shard with the result of its distinct path
+ *   ( This thread is the first to touch the shard's memory )
+ */
+static void expandShardWorker(int shardIdx, NameStatShard *shard, void *_args)
+{
+    ExpandWorkerArgs *args = (ExpandWorkerArgs *)_args;
+    size_t i;
+
+    (void)shardIdx;
+
+    for( i=shard->start; i < shard->end; i++ )
+    {
+        args->nameStats[i] = args->distinctStats[ args->distinctIdxs[i] ];
+        args->nameStats[i].fname = args->names[i];
+    }
+}
+
+/*
+ * getUniqueNameStats - getNameStats, where each distinct path of #names is stat'd only once.
+ *
+ *   Lines are hashed where they lie in the input buffer, nothing is copied.
+ *
+ *   With UNIQUE_FIRST, repeats are removed from #names, and *numLines is updated to match.
+ *     With UNIQUE_ALL, every line is kept, with repeats given a copy of the first's result
+ *     (copied by the worker owning each shard, see expandShardWorker).
+ */
+static NameStat* getUniqueNameStats( ReadNameStatBuffers *buffers, char **names, size_t *numLines )
+{
+    PathIndex *index;
+    NameStat *ret, *distinctStats;
+    ExpandWorkerArgs args;
+    char **distinct;
+    size_t *distinctIdxs;
+    size_t i, idx, numDistinct;
+
+    index = PathIndex_New(*numLines);
+
+    if ( buffers->options.uniqueMode == UNIQUE_FIRST )
+    {
+        /* Compact #names in place, keeping the first of each */
+        numDistinct = 0;
+        for( i=0; i < *numLines; i++ )
+        {
+            if ( PathIndex_Insert(index, names[i], numDistinct) == numDistinct )
+                names[numDistinct++] = names[i];
+        }
+
+        PathIndex_Free(index);
+
+        buffers->stats.numDuplicates = *numLines - numDistinct;
+        *numLines = numDistinct;
+
+        return getNameStats(buffers, names, numDistinct);
+    }
+
+    distinct = malloc( sizeof(char *) * (*numLines + 1) );
+    distinctIdxs = malloc( sizeof(size_t) * (*numLines + 1) );
+
+    numDistinct = 0;
+    for( i=0; i < *numLines; i++ )
+    {
+        idx = PathIndex_Insert(index, names[i], numDistinct);
+        if ( idx == numDistinct )
+            distinct[numDistinct++] = names[i];
+
+        distinctIdxs[i] = idx;
+    }
+
+    PathIndex_Free(index);
+
+    buffers->stats.numDuplicates = *numLines - numDistinct;
+
+    distinctStats = getNameStats(buffers, distinct, numDistinct);
+    if ( unlikely( distinctStats == NULL ) )
+    {
+        ret = NULL;
+        goto cleanup_and_exit;
+    }
+
+    /* Spread every line over as many shards as the distinct paths were gathered with */
+    ret = allocShardedArray(*numLines, sizeof(NameStat), &buffers->numShards, buffers->shards);
+    if ( unlikely( ret == NULL ) )
+        goto cleanup_and_exit;
+
+    args.nameStats = ret;
+    args.distinctStats = distinctStats;
+    args.distinctIdxs = distinctIdxs;
+    args.names = names;
+
+    runShardWorkers(buffers->shards, buffers->numShards, expandShardWorker, &args);
+
+cleanup_and_exit:
+
+    free(distinctStats);
+    free(distinctIdxs);
+    free(distinct);
+
+    return ret;
+}
+
+#define NSEC_PER_SEC 1000000000L
+
+/*
+ * parseEpoch - Parse an epoch time with optional fractional seconds
+ *   (e.x. "1510872050.1234567890" or "-5.5") at the start of #str into #timeVal.
+ *
+ *   Fractional digits beyond nanoseconds are ignored.
+ *
+ *   Returns a pointer to the first character after the number, or NULL if #str does not start with a number
+ *     or the seconds do not fit in a time_t.
+ */
+static inline char *parseEpoch(char *str, struct timespec *timeVal)
+{
+    int isNegative = 0;
+    long long sec = 0;
+    long nsec = 0;
+    long scale;
+    char *start;
+
+    if ( *str == '-' )
+    {
+        isNegative = 1;
+        str += 1;
+    }
+
+    start = str;
+    while ( (unsigned int)(*str - '0') < 10 )
+    {
+        if ( unlikely( sec > (LLONG_MAX - (*str - '0')) / 10 ) )
+            return NULL;
+
+        sec = sec * 10 + (*str - '0');
+        str += 1;
+    }
+
+    if ( unlikely( str == start ) )
+        return NULL;
+
+    if ( *str == '.' )
+    {
+        str += 1;
+        for( scale = NSEC_PER_SEC / 10; (unsigned int)(*str - '0') < 10; str++ )
+        {
+            nsec += (*str - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    if ( isNegative )
+    {
+        sec = -sec;
+        if ( nsec != 0 )
+        {
+            sec -= 1;
+            nsec = NSEC_PER_SEC - nsec;
+        }
+    }
+
+    timeVal->tv_sec = (time_t)sec;
+    if ( unlikely( (long long)timeVal->tv_sec != sec ) )
+        return NULL;
+
+    timeVal->tv_nsec = nsec;
+
+    return str;
+}
+
+/**
+ * getEpochNameStats - Take in a list of lines (and a size), each of the form
+ *   "epoch path" (a single space or tab between), and return a list of NameStat objects
+ *   intended for sorting. No files are stat'd.
+ *
+ *   The fname of each points within the line. Only fileTime (and the matching
+ *     st_*tim of statBuf, if timeField is atime, mtime, or ctime) are filled.
+ *
+ *   If a line cannot be parsed, a message will be printed to stderr,
+ *   and the mtime will be set to 0. These items should not be printed.
+ */
+static NameStat* getEpochNameStats( char **lines, size_t numLines, int timeField )
+{
+    NameStat *ret;
+    size_t i;
+    char *afterEpoch;
+
+    ret = malloc( sizeof(NameStat) * (numLines + 1 ) );
+
+    for ( i=0; i < numLines; i++ )
+    {
+        memset(&ret[i].statBuf, 0x0, sizeof(struct stat));
+
+        afterEpoch = parseEpoch(lines[i], &ret[i].fileTime);
+        if ( unlikely( afterEpoch == NULL || (*afterEpoch != ' ' && *afterEpoch != '\t') ) )
+        {
+            fprintf(stderr, "Err: Cannot parse time from line: %s\n", lines[i]);
+
+            ret[i].fname = lines[i];
+            ret[i].fileTime.tv_sec = 0;
+            ret[i].fileTime.tv_nsec = 0;
+            continue;
+        }
+
+        ret[i].fname = afterEpoch + 1;
+
+        switch( timeField )
+        {
+            case TIME_FIELD_ATIME:
+                ret[i].statBuf.st_atim = ret[i].fileTime;
+                break;
+            case TIME_FIELD_CTIME:
+                ret[i].statBuf.st_ctim = ret[i].fileTime;
+                break;
+            case TIME_FIELD_MTIME:
+                ret[i].statBuf.st_mtim = ret[i].fileTime;
+                break;
+        }
+    }
+
+    return ret;
+}
+
+ReadNameStatBuffers *initReadNameStatBuffers(void)
+{
+    ReadNameStatBuffers *buffers;
+
+    buffers = malloc( sizeof(ReadNameStatBuffers) );
+
+    #if defined(HAS_MSTREAM)
+      /* Open an automatically-expanding memstream, into which we will write eveything on stdin */
+      buffers->inputStream = open_memstream( &(buffers->inputStreamBuf), &(buffers->inputStreamSize));
+      if ( unlikely( !(buffers->inputStream) ) )
+      {
+          fputs("Failed to allocate memory stream.\n", stderr);
+          return NULL;
+      }
+      /* fflush here to set inputStreamBuf to allocated buffer, and 0 inputStreamSize */
+      fflush(buffers->inputStream);
+    #else
+      /* Otherwise, use a tmpfile */
+      buffers->inputStream = tmpfile();
+      if ( unlikely( !(buffers->inputStream) ) )
+      {
+        fputs("Failed to create temp file.\n", stderr);
+        return NULL;
+      }
+      buffers->inputStreamBuf = NULL;
+      buffers->inputStreamSize = 0;
+    #endif
+
+    memset(&buffers->inputBuffer, 0x0, sizeof(HugeBuffer));
+    buffers->lines = NULL;
+
+    buffers->batchBuf = NULL;
+    buffers->batchBufSize = 0;
+    buffers->lineBuf = NULL;
+
+    buffers->decompressedBuf = NULL;
+    buffers->hasInputError = 0;
+    buffers->lineBufSize = 0;
+
+    buffers->sourceBuffers = NULL;
+    buffers->numSourceBuffers = 0;
+
+    buffers->timeField = TIME_FIELD_MTIME;
+    buffers->needFields = NEED_FIELD_NONE;
+    buffers->inputFormat = INPUT_FORMAT_LIST;
+    buffers->gatheredFields = NEED_FIELD_NONE;
+
+    initGatherOptions(&buffers->options);
+
+    buffers->numShards = 0;
+    memset(&buffers->stats, 0x0, sizeof(GatherStats));
+    memset(&buffers->plan, 0x0, sizeof(GatherPlan));
+    
+    return buffers;
+}
+
+void destroyReadNameStatBuffers(ReadNameStatBuffers *buffers)
+{
+    int i;
+
+    free(buffers->lines);
+    free(buffers->batchBuf);
+    free(buffers->lineBuf);
+
+    for( i=0; i < buffers->numSourceBuffers; i++ )
+        destroyReadNameStatBuffers(buffers->sourceBuffers[i]);
+    free(buffers->sourceBuffers);
+    free(buffers->options.inputFiles);
+    for( i=0; i < buffers->options.numInputFiles; i++ )
+    {
+        if ( buffers->options.inputStreams[i] != NULL )
+            fclose(buffers->options.inputStreams[i]);
+    }
+    free(buffers->options.inputStreams);
+    if ( buffers->options.filter != NULL )
+        PathFilter_Free(buffers->options.filter);
+
+    fclose(buffers->inputStream);
+
+    free(buffers->inputStreamBuf);
+    free(buffers->decompressedBuf);
+    HugeBuffer_Free(&buffers->inputBuffer);
+    free(buffers);
+}
+
+
+/*
+ * readRecordNameStats - Create the NameStats from a binary records stream (see records.h)
+ *   held in the #inputSize bytes at #inputBuf
+ *
+ *   The attributes carried in the records are trusted, and no files are stat'd,
+ *     unless the records hold a different time field or lack some of the needed fields,
+ *     in which case the paths are stat'd again.
+ */
+static NameStat *readRecordNameStats(ReadNameStatBuffers *buffers, size_t *numEntries, char *inputBuf, size_t inputSize)
+{
+    RecordsHeader header;
+    NameStat *nameStats;
+    char **lines;
+    size_t i, numKept;
+
+    nameStats = parseRecords(inputBuf, inputSize, &header, numEntries);
+    if ( unlikely( nameStats == NULL ) )
+    {
+        buffers->hasInputError = 1;
+        return NULL;
+    }
+
+    if ( buffers->options.filter != NULL )
+    {
+        for( i=0, numKept=0; i < *numEntries; i++ )
+        {
+            if ( PathFilter_Keep(buffers->options.filter, nameStats[i].fname) )
+                nameStats[numKept++] = nameStats[i];
+        }
+
+        buffers->stats.numFiltered += *numEntries - numKept;
+        *numEntries = numKept;
+    }
+
+    if ( likely( header.timeField == buffers->timeField && (header.fields & buffers->needFields) == buffers->needFields ) )
+    {
+        buffers->gatheredFields = header.fields;
+        return nameStats;
+    }
+
+    /* Records do not carry what we need, so fall back to stat'ing each path */
+    lines = malloc( sizeof(char *) * (*numEntries + 1) );
+    for( i=0; i < *numEntries; i++ )
+        lines[i] = nameStats[i].fname;
+
+    free(nameStats);
+
+    buffers->lines = lines;
+    buffers->gatheredFields = buffers->needFields;
+
+    return getNameStats(buffers, lines, *numEntries);
+}
+
+/*
+ * EXPECTED_BYTES_PER_LINE - Bytes reserved per line of --expect-lines.
+ *   Generous, as untouched pages of a mapped buffer are never faulted in.
+ */
+#define EXPECTED_BYTES_PER_LINE 256
+
+/*
+ * getInputSizeHint - Get the number of bytes expected on #stream (after #prefixSize bytes
+ *   already read from it), for sizing the input buffer up front.
+ *
+ *   Returns 0 if unknown, in which case input is read into the growing memstream.
+ */
+static size_t getInputSizeHint(ReadNameStatBuffers *buffers, FILE *stream, size_t prefixSize)
+{
+    struct stat statBuf;
+    off_t offset;
+
+    if ( fstat(fileno(stream), &statBuf) == 0 && S_ISREG(statBuf.st_mode) )
+    {
+        offset = lseek(fileno(stream), 0, SEEK_CUR);
+        if ( offset >= 0 && statBuf.st_size > offset )
+        {
+            buffers->stats.inputSizeSource = "file";
+            return prefixSize + (size_t)(statBuf.st_size - offset);
+        }
+    }
+
+    if ( buffers->options.expectLines > 0 )
+    {
+        buffers->stats.inputSizeSource = "lines";
+        return prefixSize + buffers->options.expectLines * EXPECTED_BYTES_PER_LINE;
+    }
+
+    return 0;
+}
+
+/*
+ * readSizedInput - Read all of #stream (after the #prefixSize bytes at #prefix, which were
+ *   already read from it) into buffers->inputBuffer, already allocated for the expected size.
+ *
+ *   The buffer is grown should the hint prove too small, and always has room for
+ *     two more bytes (a final newline and terminator) after the input.
+ *
+ *   Returns the number of bytes read, or -1 on allocation failure.
+ */
+static ssize_t readSizedInput(ReadNameStatBuffers *buffers, FILE *stream, const char *prefix, size_t prefixSize)
+{
+    HugeBuffer *inputBuffer = &buffers->inputBuffer;
+    size_t used;
+    ssize_t numRead;
+    int fd;
+
+    memcpy(inputBuffer->ptr, prefix, prefixSize);
+    used = prefixSize;
+
+    fd = fileno(stream);
+
+    for( ;; )
+    {
+        if ( unlikely( used + 2 >= inputBuffer->size ) )
+        {
+            if ( unlikely( HugeBuffer_Grow(inputBuffer, inputBuffer->size * 2) < 0 ) )
+                return -1;
+        }
+
+        numRead = read(fd, inputBuffer->ptr + used, inputBuffer->size - 2 - used);
+        if ( numRead < 0 && errno == EINTR )
+            continue;
+
+        if ( numRead <= 0 )
+        {
+            if ( unlikely( numRead < 0 ) )
+            {
+                fprintf(stderr, "Err: Failed reading input: %s\n", strerror(errno));
+                buffers->hasInputError = 1;
+            }
+            break;
+        }
+
+        used += numRead;
+    }
+
+    inputBuffer->ptr[used] = '\0';
+
+    buffers->stats.inputBufferSize = inputBuffer->size;
+    buffers->stats.inputBufferKind = inputBuffer->kind;
+
+    return used;
+}
+
+/*
+ * markReadDone - Record the time (relative to #startTime) and page faults taken once input
+ *   has been read and split
+ */
+static inline void markReadDone(ReadNameStatBuffers *buffers, double startTime)
+{
+    buffers->stats.readSeconds = getMonotonicSeconds() - startTime;
+    getPageFaults(&buffers->stats.readMinorFaults, &buffers->stats.readMajorFaults);
+}
+
+/*
+ * filterLines - Drop the lines of #lines (in place) which GatherOptions.filter does not keep,
+ *   updating *numLines to match.
+ *
+ *   With epoch input, the path after the time is matched.
+ */
+static void filterLines(ReadNameStatBuffers *buffers, char **lines, size_t *numLines)
+{
+    const PathFilter *filter = buffers->options.filter;
+    const char *path;
+    size_t i, numKept;
+
+    numKept = 0;
+    for( i=0; i < *numLines; i++ )
+    {
+        path = lines[i];
+        if ( buffers->inputFormat == INPUT_FORMAT_EPOCH )
+        {
+            /* A line without a time is kept, for getEpochNameStats to report */
+            path = strpbrk(lines[i], " \t");
+            path = ( path != NULL ) ? path + 1 : lines[i];
+        }
+
+        if ( PathFilter_Keep(filter, path) )
+            lines[numKept++] = lines[i];
+    }
+
+    buffers->stats.numFiltered += *numLines - numKept;
+    *numLines = numKept;
+}
+
+/*
+ * createNameStatsFromLines - Split the newline-terminated input at #inputBuf (in place) into
+ *   non-empty lines, and gather a NameStat for each.
+ *
+ *   Sets buffers->stats.readSeconds (relative to #startTime) once split
+ */
+static NameStat *createNameStatsFromLines(ReadNameStatBuffers *buffers, size_t *numEntries, char *inputBuf, double startTime)
+{
+    char **lines;
+    NameStat *nameTimes;
+
+    /*
+     * Split up the input stream into non-empty lines
+     */
+    lines = splitLines(inputBuf, numEntries);
+
+    free(buffers->lines);
+    buffers->lines = lines;
+
+    if ( buffers->options.filter != NULL )
+        filterLines(buffers, lines, numEntries);
+
+    markReadDone(buffers, startTime);
+
+    if ( buffers->inputFormat == INPUT_FORMAT_EPOCH )
+    {
+        /* Times are given in the input, nothing else is available */
+        if ( unlikely( buffers->needFields != NEED_FIELD_NONE ) )
+        {
+            fputs("Err: Epoch input only provides a time, but other attributes are required.\n", stderr);
+            buffers->hasInputError = 1;
+            *numEntries = 0;
+            return NULL;
+        }
+
+        buffers->gatheredFields = NEED_FIELD_NONE;
+        return getEpochNameStats(lines, *numEntries, buffers->timeField);
+    }
+
+    /*
+     * Stat the files, return a NameStats array, with non-zero mtime for
+     *  files that could be stat'd
+     */
+    buffers->gatheredFields = buffers->needFields;
+    if ( buffers->options.uniqueMode != UNIQUE_NONE )
+        nameTimes = getUniqueNameStats(buffers, lines, numEntries);
+    else
+        nameTimes = getNameStats(buffers, lines, *numEntries);
+
+    return nameTimes;
+}
+
+/*
+ * decompressInput - Decompress the *inputSize bytes of compressed input at #inputBuf
+ *   into buffers->decompressedBuf, setting *inputSize to the decompressed size
+ *
+ *   Returns the decompressed input, or NULL (after printing why, and setting buffers->hasInputError) on failure.
+ */
+static char *decompressInput(ReadNameStatBuffers *buffers, const char *inputBuf, size_t *inputSize)
+{
+    double startTime;
+
+    startTime = getMonotonicSeconds();
+
+    buffers->stats.compressedSize = *inputSize;
+
+    free(buffers->decompressedBuf);
+    buffers->decompressedBuf = decompressBuffer(buffers->stats.compression, inputBuf, *inputSize,
+        getGatherNumThreads(buffers), inputSize, &buffers->stats.numCompressedFrames);
+
+    buffers->stats.decompressSeconds = getMonotonicSeconds() - startTime;
+
+    if ( unlikely( buffers->decompressedBuf == NULL ) )
+        buffers->hasInputError = 1;
+
+    return buffers->decompressedBuf;
+}
+
+/*
+ * doReadAndCreateNameStats - The work of readAndCreateNameStats
+ *
+ *   The #prefixSize bytes at #prefix were already read from the start of #stream
+ *
+ *   Sets buffers->stats.readSeconds (relative to #startTime) once input has been read and split
+ */
+static NameStat* doReadAndCreateNameStats(ReadNameStatBuffers *buffers, size_t *numEntries, FILE *stream, double startTime, const char *prefix, size_t prefixSize)
+{
+    size_t numBytesRead, totalBytesRead, sizeHint;
+    ssize_t sizedBytesRead;
+    char *buf;
+    int isMemStream;
+
+    FILE *inputStream;
+    char *inputStreamBuf;
+    size_t inputSize;
+
+
+    inputStream = buffers->inputStream;
+
+    /* If we know about how much is coming, read it all into one buffer, without growing or copying */
+    sizeHint = getInputSizeHint(buffers, stream, prefixSize);
+
+    /*
+     * One more byte than the hint, so reaching the end of a file of exactly that size needs no growth.
+     *   A hint too large to allocate (e.x. an overestimated --expect-lines) falls back to the memstream.
+     */
+    if ( sizeHint > 0 && unlikely( HugeBuffer_Alloc(&buffers->inputBuffer, sizeHint + 3) < 0 ) )
+        sizeHint = 0;
+
+    if ( sizeHint > 0 )
+    {
+        sizedBytesRead = readSizedInput(buffers, stream, prefix, prefixSize);
+        if ( unlikely( sizedBytesRead < 0 ) )
+        {
+            fputs("Err: Failed to allocate memory for input.\n", stderr);
+            buffers->hasInputError = 1;
+            return NULL;
+        }
+
+        if ( unlikely( sizedBytesRead == 0 ) )
+            return NULL;
+
+        inputStreamBuf = buffers->inputBuffer.ptr;
+        inputSize = sizedBytesRead;
+    }
+    else
+    {
+        totalBytesRead = 0;
+        buf = malloc( BUF_SIZE );
+
+        if ( prefixSize > 0 )
+        {
+            fwrite(prefix, 1, prefixSize, inputStream);
+            fflush(inputStream);
+
+            totalBytesRead += prefixSize;
+        }
+
+        /* 
+         * Read from stream into a temp buff, then write the same
+         *   into the memstream
+         */
+        do {
+            numBytesRead = fread(buf, 1, BUF_SIZE, stream);
+            fwrite(buf, 1, numBytesRead, inputStream);
+            fflush(inputStream);
+
+            totalBytesRead += numBytesRead;
+        }while ( ! feof(stream) && ! ferror(stream) );
+
+        free(buf);
+
+        if ( unlikely( ferror(stream) ) )
+        {
+            fprintf(stderr, "Err: Failed reading input: %s\n", strerror(errno));
+            buffers->hasInputError = 1;
+            return NULL;
+        }
+
+        /* If we did not read any data, just exit */
+        if ( unlikely( totalBytesRead == 0 ) )
+            return NULL;
+
+        #if !defined(HAS_MSTREAM)
+          /* If we don't have mstream support, then we use a tmpfile, and must manually
+           *   set our sizes and read our data
+           */
+          struct stat statBuf;
+          fstat( fileno(inputStream), &statBuf);
+
+          if ( buffers->inputStreamBuf == NULL )
+          {
+              /* First read on this buffer */
+              buffers->inputStreamSize = statBuf.st_size;
+              buffers->inputStreamBuf = malloc( statBuf.st_size + 2 );
+
+              rewind(inputStream);
+              read( fileno(inputStream), buffers->inputStreamBuf, buffers->inputStreamSize );
+          }
+          else
+          {
+            /* This function has been called before. Copy buffers and append */
+            size_t oldSize = buffers->inputStreamSize;
+
+            buffers->inputStreamSize = statBuf.st_size;
+            buffers->inputStreamBuf = realloc(buffers->inputStreamBuf, statBuf.st_size + 2);
+
+            fseek( inputStream, oldSize, SEEK_SET );
+            read( fileno(inputStream), &buffers->inputStreamBuf[oldSize], buffers->inputStreamSize - oldSize );
+          }
+          buffers->inputStreamBuf[buffers->inputStreamSize] = '\0';
+        #endif
+
+        inputStreamBuf = buffers->inputStreamBuf;
+        inputSize = buffers->inputStreamSize;
+    }
+
+    /* Whether input is held by the memstream, which must be written through */
+    isMemStream = ( sizeHint == 0 );
+
+    /* Compressed input is decompressed here, and split from the result */
+    buffers->stats.compression = getCompressionKind(inputStreamBuf, inputSize);
+    if ( buffers->stats.compression != COMPRESSION_NONE )
+    {
+        inputStreamBuf = decompressInput(buffers, inputStreamBuf, &inputSize);
+        if ( unlikely( inputStreamBuf == NULL ) )
+            return NULL;
+
+        isMemStream = 0;
+        if ( unlikely( inputSize == 0 ) )
+            return NULL;
+    }
+
+    /* Binary record streams carry their own attributes */
+    if ( isRecordsStream(inputStreamBuf, inputSize) )
+    {
+        markReadDone(buffers, startTime);
+        return readRecordNameStats(buffers, numEntries, inputStreamBuf, inputSize);
+    }
+
+    /* Treat just newline same as no data */
+    if ( unlikely( inputSize == 1 && *inputStreamBuf == '\n' ) )
+        return NULL;
+
+    /* If we did not have a final newline, append one. */
+    if( inputStreamBuf[inputSize - 1] != '\n' )
+    {
+        #if defined(HAS_MSTREAM)
+          if ( isMemStream )
+          {
+              fputc('\n', inputStream);
+              fflush(inputStream);
+
+              /* The memstream may have been reallocated */
+              inputStreamBuf = buffers->inputStreamBuf;
+              inputSize = buffers->inputStreamSize;
+          }
+          else
+        #endif
+        {
+            /* A sized buffer, the tmpfile copy and decompressed input all have room for two more bytes */
+            inputStreamBuf[inputSize] = '\n';
+            inputStreamBuf[inputSize + 1] = '\0';
+            inputSize += 1;
+
+            if ( isMemStream )
+                buffers->inputStreamSize = inputSize;
+        }
+    }
+
+    return createNameStatsFromLines(buffers, numEntries, inputStreamBuf, startTime);
+}
+
+/*
+ * isRepeatedInode - Check if #nameStat is a file already added to #inodes under another name,
+ *   adding it if not. With DEDUP_INODES_NAMES, repeats are also marked (see NAMESTAT_IS_REPEATED_INODE).
+ */
+static inline int isRepeatedInode(InodeSet *inodes, NameStat *nameStat, int dedupInodes)
+{
+    /* A file with a single link has no other names, so need not be remembered */
+    if ( !NAMESTAT_IS_VALID(nameStat) || nameStat->statBuf.st_nlink <= 1 )
+        return 0;
+
+    if ( InodeSet_Add(inodes, nameStat->statBuf.st_dev, nameStat->statBuf.st_ino) )
+        return 0;
+
+    if ( dedupInodes == DEDUP_INODES_NAMES )
+        nameStat->statBuf.st_nlink = 0;
+
+    return 1;
+}
+
+/*
+ * dedupInodes - Apply buffers->options.dedupInodes to the #numEntries gathered #nameStats.
+ *
+ *   With DEDUP_INODES_FIRST, later names of each file are removed, updating *numEntries,
+ *     and shards are split again over what remains.
+ */
+static void dedupInodes(ReadNameStatBuffers *buffers, NameStat *nameStats, size_t *numEntries)
+{
+    InodeSet *inodes;
+    size_t i, numKept;
+    int mode;
+
+    mode = buffers->options.dedupInodes;
+    inodes = InodeSet_New();
+
+    numKept = 0;
+    for( i=0; i < *numEntries; i++ )
+    {
+        if ( isRepeatedInode(inodes, &nameStats[i], mode) )
+        {
+            buffers->stats.numRepeatedInodes += 1;
+            if ( mode == DEDUP_INODES_FIRST )
+                continue;
+        }
+
+        if ( numKept != i )
+            nameStats[numKept] = nameStats[i];
+        numKept += 1;
+    }
+
+    InodeSet_Free(inodes);
+
+    if ( numKept != *numEntries )
+    {
+        *numEntries = numKept;
+        if ( buffers->numShards > 0 )
+            buffers->numShards = splitShards(numKept, sizeof(NameStat), buffers->numShards, buffers->shards);
+    }
+}
+
+/*
+ * InputFileArgs - Arguments to a thread gathering one list of GatherOptions.inputFiles
+ */
+typedef struct {
+    ReadNameStatBuffers *buffers;
+    FILE *stream;
+    NameStat *nameStats;
+    size_t numEntries;
+    pthread_t thread;
+    int isThreaded;
+
+} InputFileArgs;
+
+/*
+ * inputFileMain - Thread which reads and gathers a single list
+ */
+static void *inputFileMain(void *_args)
+{
+    InputFileArgs *args = (InputFileArgs *)_args;
+
+    args->nameStats = readAndCreateNameStats(args->buffers, &args->numEntries, args->stream);
+
+    return NULL;
+}
+
+/*
+ * readInputFiles - Read and gather each of the list files in buffers->options.inputFiles,
+ *   each with its own ReadNameStatBuffers on its own thread (splitting the threads between them),
+ *   and join the results in the order the lists were given.
+ *
+ *   "-" reads #stream. The others were opened by addGatherInputFile.
+ *
+ *   The per-list buffers (which hold the names) are kept in buffers->sourceBuffers.
+ */
+static NameStat *readInputFiles(ReadNameStatBuffers *buffers, size_t *numEntries, FILE *stream, double startTime)
+{
+    InputFileArgs *args;
+    ReadNameStatBuffers *source;
+    NameStat *ret;
+    PathIndex *index;
+    size_t total, i, numKept;
+    int numSources, numThreads, srcIdx, numShards;
+
+    numSources = buffers->options.numInputFiles;
+
+    if ( buffers->options.checkpointFile != NULL || buffers->options.resumeFile != NULL )
+        fputs("Warning: --checkpoint and --resume are ignored when reading list files.\n", stderr);
+
+    /* --threads=0 is one per cpu, shared between the lists like any other count */
+    numThreads = getGatherNumThreads(buffers) / numSources;
+    if ( numThreads < 1 )
+        numThreads = 1;
+
+    args = calloc( numSources, sizeof(InputFileArgs) );
+    buffers->sourceBuffers = calloc( numSources, sizeof(ReadNameStatBuffers *) );
+    if ( unlikely( args == NULL || buffers->sourceBuffers == NULL ) )
+    {
+        fputs("Err: Failed to allocate memory for list files.\n", stderr);
+        buffers->hasInputError = 1;
+        free(args);
+        return NULL;
+    }
+
+    buffers->numSourceBuffers = numSources;
+
+    for( srcIdx=0; srcIdx < numSources; srcIdx++ )
+    {
+        source = initReadNameStatBuffers();
+        if ( unlikely( source == NULL ) )
+        {
+            fputs("Err: Failed to allocate memory for list files.\n", stderr);
+            buffers->hasInputError = 1;
+            buffers->numSourceBuffers = srcIdx;
+            ret = NULL;
+            goto cleanup_and_exit;
+        }
+
+        buffers->sourceBuffers[srcIdx] = source;
+
+        source->timeField = buffers->timeField;
+        source->needFields = buffers->needFields;
+        source->inputFormat = buffers->inputFormat;
+        source->options = buffers->options;
+        source->options.numThreads = numThreads;
+        source->options.dedupInodes = DEDUP_INODES_NONE;
+        source->options.checkpointFile = NULL;
+        source->options.resumeFile = NULL;
+        source->options.inputFiles = NULL;
+        source->options.inputStreams = NULL;
+        source->options.numInputFiles = 0;
+
+        args[srcIdx].buffers = source;
+
+        args[srcIdx].stream = buffers->options.inputStreams[srcIdx];
+        if ( args[srcIdx].stream == NULL )
+            args[srcIdx].stream = stream;
+    }
+
+    for( srcIdx=0; srcIdx < numSources; srcIdx++ )
+    {
+        /* On failure to start a thread, gather the list here */
+        if ( unlikely( pthread_create(&args[srcIdx].thread, NULL, inputFileMain, &args[srcIdx]) != 0 ) )
+        {
+            inputFileMain(&args[srcIdx]);
+            continue;
+        }
+
+        args[srcIdx].isThreaded = 1;
+    }
+
+    total = 0;
+    for( srcIdx=0; srcIdx < numSources; srcIdx++ )
+    {
+        if ( args[srcIdx].isThreaded )
+            pthread_join(args[srcIdx].thread, NULL);
+
+        if ( args[srcIdx].nameStats != NULL )
+            total += args[srcIdx].numEntries;
+
+        if ( buffers->sourceBuffers[srcIdx]->hasInputError )
+            buffers->hasInputError = 1;
+    }
+
+    /* A list which could not be read fails the whole gather, rather than giving partial output */
+    if ( unlikely( buffers->hasInputError ) )
+    {
+        ret = NULL;
+        goto cleanup_and_exit;
+    }
+
+    /* Lists are read alongside one another's gathers, so count reading as done when the slowest was */
+    markReadDone(buffers, startTime);
+    buffers->stats.readSeconds = 0;
+    for( srcIdx=0; srcIdx < numSources; srcIdx++ )
+    {
+        if ( buffers->sourceBuffers[srcIdx]->stats.readSeconds > buffers->stats.readSeconds )
+            buffers->stats.readSeconds = buffers->sourceBuffers[srcIdx]->stats.readSeconds;
+    }
+
+    numShards = numSources < MAX_SHARDS ? numSources : MAX_SHARDS;
+    ret = allocShardedArray(total, sizeof(NameStat), &numShards, buffers->shards);
+    if ( unlikely( ret == NULL ) )
+    {
+        fputs("Err: Failed to allocate memory for list files.\n", stderr);
+        buffers->hasInputError = 1;
+        goto cleanup_and_exit;
+    }
+
+    buffers->numShards = numShards;
+
+    /* Only what every list filled in. If none were gathered, what was asked for is (trivially) filled */
+    buffers->gatheredFields = buffers->needFields;
+    for( srcIdx=0; srcIdx < numSources; srcIdx++ )
+    {
+        if ( args[srcIdx].nameStats != NULL )
+        {
+            buffers->gatheredFields = NEED_FIELD_ALL;
+            break;
+        }
+    }
+
+    total = 0;
+    for( srcIdx=0; srcIdx < numSources; srcIdx++ )
+    {
+        source = buffers->sourceBuffers[srcIdx];
+        if ( args[srcIdx].nameStats == NULL )
+            continue;
+
+        memcpy(&ret[total], args[srcIdx].nameStats, sizeof(NameStat) * args[srcIdx].numEntries);
+        total += args[srcIdx].numEntries;
+
+        buffers->gatheredFields &= source->gatheredFields;
+        buffers->stats.numDirGroups += source->stats.numDirGroups;
+        buffers->stats.numDuplicates += source->stats.numDuplicates;
+        buffers->stats.numFiltered += source->stats.numFiltered;
+    }
+
+    /* Each list was made unique on its own, now drop paths repeated from an earlier list */
+    if ( buffers->options.uniqueMode == UNIQUE_FIRST && numSources > 1 )
+    {
+        index = PathIndex_New(total);
+
+        numKept = 0;
+        for( i=0; i < total; i++ )
+        {
+            if ( PathIndex_Insert(index, ret[i].fname, numKept) != numKept )
+                continue;
+
+            if ( numKept != i )
+                ret[numKept] = ret[i];
+            numKept += 1;
+        }
+
+        PathIndex_Free(index);
+
+        buffers->stats.numDuplicates += total - numKept;
+        if ( numKept != total )
+            buffers->numShards = splitShards(numKept, sizeof(NameStat), buffers->numShards, buffers->shards);
+
+        total = numKept;
+    }
+
+    *numEntries = total;
+
+cleanup_and_exit:
+
+    /* The filter is shared with (and freed by) these buffers */
+    for( srcIdx=0; srcIdx < buffers->numSourceBuffers; srcIdx++ )
+        buffers->sourceBuffers[srcIdx]->options.filter = NULL;
+
+    for( srcIdx=0; srcIdx < numSources; srcIdx++ )
+        free(args[srcIdx].nameStats);
+
+    free(args);
+
+    return ret;
+}
+
+/*
+ * readAndCreateNameStatsAfter - readAndCreateNameStats, where the #prefixSize bytes at #prefix
+ *   have already been read from the start of #stream
+ *
+ *   If #stream is NULL, the input is instead the batch already read into buffers->batchBuf (see readNextBatch)
+ */
+static NameStat* readAndCreateNameStatsAfter(ReadNameStatBuffers *buffers, size_t *numEntries, FILE *stream, const char *prefix, size_t prefixSize)
+{
+    NameStat *ret;
+    double startTime;
+    long startMinorFaults, startMajorFaults;
+
+    startTime = getMonotonicSeconds();
+    getPageFaults(&startMinorFaults, &startMajorFaults);
+
+    *numEntries = 0;
+    buffers->numShards = 0;
+    memset(&buffers->stats, 0x0, sizeof(GatherStats));
+    memset(&buffers->plan, 0x0, sizeof(GatherPlan));
+
+    /* Until input has been read, as if it took no time */
+    buffers->stats.readMinorFaults = startMinorFaults;
+    buffers->stats.readMajorFaults = startMajorFaults;
+
+    if ( buffers->options.dedupInodes != DEDUP_INODES_NONE )
+        buffers->needFields |= NEED_FIELD_INO;
+
+    if ( stream != NULL && buffers->options.numInputFiles > 0 )
+        ret = readInputFiles(buffers, numEntries, stream, startTime);
+    else if ( stream != NULL )
+        ret = doReadAndCreateNameStats(buffers, numEntries, stream, startTime, prefix, prefixSize);
+    else
+        ret = createNameStatsFromLines(buffers, numEntries, buffers->batchBuf, startTime);
+
+    if ( ret != NULL && buffers->options.dedupInodes != DEDUP_INODES_NONE )
+        dedupInodes(buffers, ret, numEntries);
+
+    buffers->stats.statSeconds = getMonotonicSeconds() - startTime - buffers->stats.readSeconds;
+    buffers->stats.numEntries = ( ret != NULL ) ? *numEntries : 0;
+
+    getPageFaults(&buffers->stats.minorFaults, &buffers->stats.majorFaults);
+    buffers->stats.minorFaults -= startMinorFaults;
+    buffers->stats.majorFaults -= startMajorFaults;
+    buffers->stats.readMinorFaults -= startMinorFaults;
+    buffers->stats.readMajorFaults -= startMajorFaults;
+
+    /* Records and epoch input are not gathered by workers, they are a single shard */
+    if ( buffers->numShards == 0 )
+        buffers->numShards = splitShards(buffers->stats.numEntries, sizeof(NameStat), 1, buffers->shards);
+
+    return ret;
+}
+
+NameStat* readAndCreateNameStats(ReadNameStatBuffers *buffers, size_t *numEntries, FILE *stream)
+{
+    return readAndCreateNameStatsAfter(buffers, numEntries, stream, NULL, 0);
+}
+
+NameStat *readNextBatch(ReadNameStatBuffers *buffers, size_t *numEntries, FILE *stream, int *isEnd)
+{
+    ssize_t lineLen;
+    size_t used;
+
+    *numEntries = 0;
+    *isEnd = 0;
+    used = 0;
+
+    for( ;; )
+    {
+        lineLen = getline(&buffers->lineBuf, &buffers->lineBufSize, stream);
+        if ( lineLen <= 0 )
+        {
+            if ( unlikely( ferror(stream) ) )
+            {
+                fprintf(stderr, "Err: Failed reading input: %s\n", strerror(errno));
+                buffers->hasInputError = 1;
+            }
+
+            *isEnd = 1;
+            break;
+        }
+
+        /* An empty line ends the batch */
+        if ( buffers->lineBuf[0] == '\n' )
+            break;
+
+        /* Batches are answered as they arrive, so cannot be decompressed as a whole */
+        if ( unlikely( used == 0 && getCompressionKind(buffers->lineBuf, lineLen) != COMPRESSION_NONE ) )
+        {
+            fputs("Err: --serve input must not be compressed.\n", stderr);
+            buffers->hasInputError = 1;
+            *isEnd = 1;
+            return NULL;
+        }
+
+        /* Room for the line, a newline if it lacks one, and the terminating null */
+        if ( unlikely( used + lineLen + 2 > buffers->batchBufSize ) )
+        {
+            buffers->batchBufSize = buffers->batchBufSize ? buffers->batchBufSize : BUF_SIZE;
+            while ( used + lineLen + 2 > buffers->batchBufSize )
+                buffers->batchBufSize *= 2;
+
+            buffers->batchBuf = realloc(buffers->batchBuf, buffers->batchBufSize);
+            if ( unlikely( buffers->batchBuf == NULL ) )
+            {
+                fputs("Err: Failed to allocate memory for input.\n", stderr);
+                buffers->batchBufSize = 0;
+                buffers->hasInputError = 1;
+                *isEnd = 1;
+                return NULL;
+            }
+        }
+
+        memcpy(buffers->batchBuf + used, buffers->lineBuf, lineLen);
+        used += lineLen;
+        if ( buffers->batchBuf[used - 1] != '\n' )
+            buffers->batchBuf[used++] = '\n';
+    }
+
+    if ( used == 0 )
+        return NULL;
+
+    buffers->batchBuf[used] = '\0';
+
+    return readAndCreateNameStatsAfter(buffers, numEntries, NULL, NULL, 0);
+}
+
+/*
+ * Pipeline tuning, see streamNameStats
+ */
+#define PIPELINE_BATCH_SIZE 65536           /* Initial bytes of input held by each batch */
+#define PIPELINE_BATCHES_PER_WORKER 4       /* Batches in flight per stat worker */
+
+/* Pushed to the stat workers (once per worker) after the final batch */
+static char PIPELINE_END_MARKER;
+#define PIPELINE_END ( (void *)&PIPELINE_END_MARKER )
+
+/*
+ * PipelineBatch - A run of consecutive input lines, passed from the reader, to a stat worker,
+ *   to the emitter, and then back to the reader to be reused.
+ */
+typedef struct {
+    size_t seq;             /* Position of this batch in the input */
+
+    char *buf;              /* Input lines, split in place */
+    size_t bufSize;
+
+    char **names;
+    NameStat *nameStats;
+    size_t numNames;
+    size_t namesCapacity;
+
+    size_t numDirGroups;
+
+    OutBuffer out;          /* With NameStatSink.formatFunc, the formatted entries */
+
+} PipelineBatch;
+
+/*
+ * NameStatSink - Where the entries of runNameStatStream go. Exactly one of
+ *   #emitFunc, #reduceFunc or #formatFunc is set.
+ */
+typedef struct {
+    NameStatEmitFunc emitFunc;
+    NameStatReduceFunc reduceFunc;
+    NameStatFormatFunc formatFunc;  /* Formatted output is written to #outStream */
+    FILE *outStream;
+    void *arg;
+
+} NameStatSink;
+
+/*
+ * Pipeline - State shared by the stages of streamNameStats
+ *
+ *   Batches circulate  freeRing -> reader -> statRing -> workers -> emitRing -> emitter -> freeRing
+ *     Every ring can hold every batch (and the end markers), so a push never waits.
+ */
+typedef struct {
+    ReadNameStatBuffers *buffers;
+    int fd;
+
+    PipelineBatch *batches;
+    size_t numBatches;
+
+    RingBuffer freeRing;
+    RingBuffer statRing;
+    RingBuffer emitRing;
+
+    int numWorkers;
+
+    InodeSet *inodes;       /* Files seen so far, with --dedup-inodes */
+
+    /* With sink->reduceFunc, workers pass each entry there (see reduceNameStats), and nothing is emitted.
+     *   With sink->formatFunc, workers format each batch (unless #inodes), and the emitter writes it.
+     */
+    const NameStatSink *sink;
+
+    /* The batch (holding #firstBatchUsed bytes) read before the reader was started */
+    PipelineBatch *firstBatch;
+    size_t firstBatchUsed;
+
+    /* Set by the reader once it reaches the end of input. #totalBatches is valid once #readerDone */
+    size_t totalBatches;
+    size_t numEntries;
+    size_t numFiltered;
+    double readerDoneTime;
+    long readerDoneMinorFaults;
+    long readerDoneMajorFaults;
+    int readerDone;
+
+} Pipeline;
+
+/*
+ * PipelineWorker - A stat worker of a Pipeline
+ */
+typedef struct {
+    Pipeline *pipeline;
+    int workerIdx;
+    pthread_t thread;
+
+    size_t numDirGroups;    /* With a reduceFunc, the dir groups of the batches this worker stat'd */
+
+} PipelineWorker;
+
+/*
+ * splitBatch - Split the first #size bytes of batch->buf into non-empty lines,
+ *   dropping any which #filter (if not NULL) does not keep, counted in *numFiltered
+ */
+static int splitBatch(PipelineBatch *batch, size_t size, const PathFilter *filter, size_t *numFiltered)
+{
+    char *cur, *end, *lineEnd;
+
+    batch->numNames = 0;
+
+    cur = batch->buf;
+    end = batch->buf + size;
+
+    while ( cur < end )
     {
-        fputc('\n', inputStream);
-        fflush(inputStream);
+        lineEnd = memchr(cur, '\n', end - cur);
+        if ( lineEnd == NULL )
+            lineEnd = end;
+
+        *lineEnd = '\0';
+
+        if ( filter != NULL && lineEnd != cur && !PathFilter_Keep(filter, cur) )
+        {
+            *numFiltered += 1;
+        }
+        else if ( lineEnd != cur )
+        {
+            if ( unlikely( batch->numNames == batch->namesCapacity ) )
+            {
+                batch->namesCapacity *= 2;
+                batch->names = realloc(batch->names, sizeof(char *) * batch->namesCapacity);
+                batch->nameStats = realloc(batch->nameStats, sizeof(NameStat) * batch->namesCapacity);
+                if ( unlikely( batch->names == NULL || batch->nameStats == NULL ) )
+                    return -1;
+            }
+
+            batch->names[batch->numNames++] = cur;
+        }
+
+        cur = lineEnd + 1;
     }
 
-    /*
-     * -- Process Data
-     */
+    return 0;
+}
 
-    /*
-     * Split up the input stream into non-empty lines
-     */
-    lines = splitLines(inputStreamBuf, numEntries);
+/*
+ * readIntoBatch - Read from #fd into #batch after the #used bytes it holds, growing it if full.
+ *
+ *   One byte is always left free, to terminate the final line.
+ *
+ *   Returns the number of bytes read, 0 at end of input, or -1 on error.
+ */
+static ssize_t readIntoBatch(int fd, PipelineBatch *batch, size_t used)
+{
+    ssize_t numRead;
 
-    buffers->lines = lines;
+    if ( unlikely( used + 1 >= batch->bufSize ) )
+    {
+        /* A single line longer than the batch */
+        batch->bufSize *= 2;
+        batch->buf = realloc(batch->buf, batch->bufSize);
+        if ( unlikely( batch->buf == NULL ) )
+            return -1;
+    }
 
-    /*
-     * Stat the files, return a NameStats array, with non-zero mtime for
-     *  files that could be stat'd
+    do {
+        numRead = read(fd, batch->buf + used, batch->bufSize - 1 - used);
+    } while ( unlikely( numRead < 0 && errno == EINTR ) );
+
+    return numRead;
+}
+
+/*
+ * pipelineReaderMain - Reader stage. Reads input into batches, and splits each
+ *   at its final newline (carrying any partial line over to the next batch)
+ */
+static void *pipelineReaderMain(void *_pipeline)
+{
+    Pipeline *pipeline = (Pipeline *)_pipeline;
+    PipelineBatch *batch, *nextBatch;
+    size_t used, lineEnd, carry, seq;
+    ssize_t numRead;
+    char *lastNewline;
+    int i, isEnd;
+
+    batch = pipeline->firstBatch;
+    used = pipeline->firstBatchUsed;
+    seq = 0;
+    isEnd = 0;
+
+    while ( !isEnd )
+    {
+        numRead = readIntoBatch(pipeline->fd, batch, used);
+        if ( unlikely( numRead < 0 ) )
+        {
+            fprintf(stderr, "Err: Failed reading input: %s\n", strerror(errno));
+            pipeline->buffers->hasInputError = 1;
+            numRead = 0;
+        }
+
+        if ( numRead == 0 )
+        {
+            /* Whatever remains is the final line */
+            isEnd = 1;
+            lineEnd = used;
+        }
+        else
+        {
+            used += numRead;
+
+            lastNewline = memrchr(batch->buf, '\n', used);
+            if ( lastNewline == NULL )
+                continue;
+
+            lineEnd = (lastNewline - batch->buf) + 1;
+        }
+
+        nextBatch = NULL;
+        if ( !isEnd )
+        {
+            /* Carry the partial final line over to the next batch */
+            nextBatch = RingBuffer_Pop(&pipeline->freeRing);
+
+            carry = used - lineEnd;
+            if ( unlikely( carry + 1 >= nextBatch->bufSize ) )
+            {
+                nextBatch->bufSize = batch->bufSize;
+                nextBatch->buf = realloc(nextBatch->buf, nextBatch->bufSize);
+            }
+            memcpy(nextBatch->buf, batch->buf + lineEnd, carry);
+            used = carry;
+        }
+
+        if ( unlikely( splitBatch(batch, lineEnd, pipeline->buffers->options.filter, &pipeline->numFiltered) < 0 ) )
+        {
+            fputs("Err: Failed to allocate memory for input.\n", stderr);
+            pipeline->buffers->hasInputError = 1;
+            batch->numNames = 0;
+        }
+
+        if ( batch->numNames > 0 )
+        {
+            batch->seq = seq++;
+            pipeline->numEntries += batch->numNames;
+            RingBuffer_Push(&pipeline->statRing, batch);
+        }
+        else
+        {
+            RingBuffer_Push(&pipeline->freeRing, batch);
+        }
+
+        batch = nextBatch;
+    }
+
+    pipeline->readerDoneTime = getMonotonicSeconds();
+    getPageFaults(&pipeline->readerDoneMinorFaults, &pipeline->readerDoneMajorFaults);
+    pipeline->totalBatches = seq;
+    __atomic_store_n(&pipeline->readerDone, 1, __ATOMIC_RELEASE);
+
+    for( i=0; i < pipeline->numWorkers; i++ )
+        RingBuffer_Push(&pipeline->statRing, PIPELINE_END);
+
+    return NULL;
+}
+
+/*
+ * pipelineWorkerMain - Stat stage. Stats each batch, and passes it to the emitter.
+ */
+static void *pipelineWorkerMain(void *_worker)
+{
+    PipelineWorker *worker = (PipelineWorker *)_worker;
+    Pipeline *pipeline = worker->pipeline;
+    ReadNameStatBuffers *buffers = pipeline->buffers;
+    const NameStatSink *sink = pipeline->sink;
+    PipelineBatch *batch;
+    size_t i;
+
+    for( ;; )
+    {
+        batch = RingBuffer_Pop(&pipeline->statRing);
+        if ( batch == PIPELINE_END )
+            break;
+
+        batch->numDirGroups = statRange(batch->nameStats, batch->names, 0, batch->numNames,
+            buffers->timeField, buffers->needFields, buffers->options.useDirGroups);
+
+        if ( sink->reduceFunc != NULL )
+        {
+            /* Order does not matter, so hand the batch straight back to the reader */
+            for( i=0; i < batch->numNames; i++ )
+                sink->reduceFunc(worker->workerIdx, &batch->nameStats[i], sink->arg);
+
+            worker->numDirGroups += batch->numDirGroups;
+
+            RingBuffer_Push(&pipeline->freeRing, batch);
+        }
+        else
+        {
+            /* Which inodes repeat depends on what came before, so those are only known to the emitter */
+            if ( sink->formatFunc != NULL && pipeline->inodes == NULL )
+            {
+                batch->out.len = 0;
+                for( i=0; i < batch->numNames; i++ )
+                    sink->formatFunc(&batch->nameStats[i], &batch->out, sink->arg);
+            }
+
+            RingBuffer_Push(&pipeline->emitRing, batch);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * runPipelineEmitter - Emit stage, on the calling thread. Puts the stat'd batches back into
+ *   input order, and calls sink->emitFunc for each entry (or writes the entries sink->formatFunc formatted).
+ */
+static void runPipelineEmitter(Pipeline *pipeline)
+{
+    const NameStatSink *sink = pipeline->sink;
+    PipelineBatch **pending;
+    PipelineBatch *batch;
+    void *item;
+    size_t nextSeq, i;
+    unsigned int numAttempts;
+
+    /* At most #numBatches are in flight, all at or after #nextSeq, so each has its own slot */
+    pending = calloc( pipeline->numBatches, sizeof(PipelineBatch *) );
+
+    nextSeq = 0;
+    numAttempts = 0;
+
+    for( ;; )
+    {
+        if ( !RingBuffer_TryPop(&pipeline->emitRing, &item) )
+        {
+            if ( __atomic_load_n(&pipeline->readerDone, __ATOMIC_ACQUIRE) && nextSeq == pipeline->totalBatches )
+                break;
+
+            ringBackoff(numAttempts++);
+            continue;
+        }
+
+        numAttempts = 0;
+
+        batch = (PipelineBatch *)item;
+        pending[batch->seq % pipeline->numBatches] = batch;
+
+        while ( (batch = pending[nextSeq % pipeline->numBatches]) != NULL )
+        {
+            if ( sink->formatFunc != NULL && pipeline->inodes == NULL )
+            {
+                /* Formatted by the worker */
+                fwrite(batch->out.data, 1, batch->out.len, sink->outStream);
+            }
+            else
+            {
+                batch->out.len = 0;
+
+                for( i=0; i < batch->numNames; i++ )
+                {
+                    if ( pipeline->inodes != NULL && isRepeatedInode(pipeline->inodes, &batch->nameStats[i], pipeline->buffers->options.dedupInodes) )
+                    {
+                        pipeline->buffers->stats.numRepeatedInodes += 1;
+                        if ( pipeline->buffers->options.dedupInodes == DEDUP_INODES_FIRST )
+                            continue;
+                    }
+
+                    if ( sink->formatFunc != NULL )
+                        sink->formatFunc(&batch->nameStats[i], &batch->out, sink->arg);
+                    else
+                        sink->emitFunc(&batch->nameStats[i], sink->arg);
+                }
+
+                if ( batch->out.len > 0 )
+                    fwrite(batch->out.data, 1, batch->out.len, sink->outStream);
+            }
+
+            pipeline->buffers->stats.numDirGroups += batch->numDirGroups;
+
+            pending[nextSeq % pipeline->numBatches] = NULL;
+            nextSeq += 1;
+
+            RingBuffer_Push(&pipeline->freeRing, batch);
+        }
+    }
+
+    free(pending);
+}
+
+/*
+ * allocPipeline - Allocate the batches and rings of #pipeline, for #numWorkers workers
+ *
+ *   Returns 0 on success, -1 on allocation failure.
+ */
+static int allocPipeline(Pipeline *pipeline, int numWorkers)
+{
+    PipelineBatch *batch;
+    size_t i, ringSize;
+
+    /* One more than the workers can hold for the reader to fill, and one for the emitter */
+    pipeline->numBatches = (size_t)numWorkers * PIPELINE_BATCHES_PER_WORKER + 2;
+    pipeline->batches = calloc( pipeline->numBatches, sizeof(PipelineBatch) );
+    if ( unlikely( pipeline->batches == NULL ) )
+        return -1;
+
+    ringSize = pipeline->numBatches + numWorkers;
+    if ( unlikely( RingBuffer_Init(&pipeline->freeRing, ringSize) < 0 ||
+                   RingBuffer_Init(&pipeline->statRing, ringSize) < 0 ||
+                   RingBuffer_Init(&pipeline->emitRing, ringSize) < 0 ) )
+        return -1;
+
+    for( i=0; i < pipeline->numBatches; i++ )
+    {
+        batch = &pipeline->batches[i];
+
+        batch->bufSize = PIPELINE_BATCH_SIZE;
+        batch->buf = malloc( batch->bufSize );
+        batch->namesCapacity = PIPELINE_BATCH_SIZE / 64;
+        batch->names = malloc( sizeof(char *) * batch->namesCapacity );
+        batch->nameStats = malloc( sizeof(NameStat) * batch->namesCapacity );
+        if ( unlikely( batch->buf == NULL || batch->names == NULL || batch->nameStats == NULL ) )
+            return -1;
+
+        RingBuffer_Push(&pipeline->freeRing, batch);
+    }
+
+    return 0;
+}
+
+/*
+ * freePipeline - Free everything allocated by allocPipeline
+ */
+static void freePipeline(Pipeline *pipeline)
+{
+    size_t i;
+
+    if ( pipeline->batches != NULL )
+    {
+        for( i=0; i < pipeline->numBatches; i++ )
+        {
+            free(pipeline->batches[i].buf);
+            free(pipeline->batches[i].names);
+            free(pipeline->batches[i].nameStats);
+            OutBuffer_Free(&pipeline->batches[i].out);
+        }
+        free(pipeline->batches);
+    }
+
+    RingBuffer_Destroy(&pipeline->freeRing);
+    RingBuffer_Destroy(&pipeline->statRing);
+    RingBuffer_Destroy(&pipeline->emitRing);
+
+    if ( pipeline->inodes != NULL )
+        InodeSet_Free(pipeline->inodes);
+}
+
+/*
+ * FormatAllState - Passed to formatAllItem by passAll
+ */
+typedef struct {
+    const NameStat *nameStats;
+    const NameStatSink *sink;
+
+} FormatAllState;
+
+/*
+ * formatAllItem - Format entry #idx, for writeFormattedInOrder
+ */
+static void formatAllItem(size_t idx, OutBuffer *out, void *_state)
+{
+    FormatAllState *state = (FormatAllState *)_state;
+
+    state->sink->formatFunc(&state->nameStats[idx], out, state->sink->arg);
+}
+
+/*
+ * passAll - Pass each of #numEntries entries of #nameStats to #sink. Reduced entries are
+ *   all passed as worker 0, and formatted entries are formatted on the gather workers.
+ */
+static void passAll(ReadNameStatBuffers *buffers, NameStat *nameStats, size_t numEntries, const NameStatSink *sink)
+{
+    FormatAllState formatState;
+    size_t i;
+
+    if ( sink->emitFunc != NULL )
+    {
+        for( i=0; i < numEntries; i++ )
+            sink->emitFunc(&nameStats[i], sink->arg);
+    }
+    else if ( sink->reduceFunc != NULL )
+    {
+        for( i=0; i < numEntries; i++ )
+            sink->reduceFunc(0, &nameStats[i], sink->arg);
+    }
+    else
+    {
+        formatState.nameStats = nameStats;
+        formatState.sink = sink;
+
+        fflush(sink->outStream);
+        writeFormattedInOrder(sink->outStream, numEntries, getGatherNumThreads(buffers), formatAllItem, &formatState);
+    }
+}
+
+/*
+ * readAndPassAll - Read and gather everything up front, then pass each entry as passAll.
+ *
+ *   The #prefixSize bytes at #prefix were already read from the start of #stream
+ *
+ *   Returns the number of entries passed.
+ */
+static size_t readAndPassAll(ReadNameStatBuffers *buffers, FILE *stream, const char *prefix, size_t prefixSize, const NameStatSink *sink)
+{
+    NameStat *nameStats;
+    size_t numEntries;
+
+    nameStats = readAndCreateNameStatsAfter(buffers, &numEntries, stream, prefix, prefixSize);
+    if ( nameStats == NULL )
+        return 0;
+
+    passAll(buffers, nameStats, numEntries, sink);
+    free(nameStats);
+
+    return numEntries;
+}
+
+int getGatherNumThreads(const ReadNameStatBuffers *buffers)
+{
+    if ( buffers->options.numThreads == 0 )
+        return getNumCpus();
+
+    return buffers->options.numThreads;
+}
+
+/*
+ * runNameStatStream - The work of streamNameStats, reduceNameStats and formatNameStats, passing to #sink
+ */
+static size_t runNameStatStream(ReadNameStatBuffers *buffers, FILE *stream, const NameStatSink *sink)
+{
+    Pipeline pipeline;
+    pthread_t readerThread;
+    PipelineWorker *workers;
+    size_t numEntries;
+    ssize_t numRead;
+    double startTime;
+    long startMinorFaults, startMajorFaults;
+    int numWorkers, i;
+
+    /* Only a plain list is streamed. Everything else needs the whole input before it starts.
+     *   Workers reduce out of order, so inodes cannot be deduplicated as they go.
+     *   List files are each gathered concurrently, then joined.
      */
-    nameTimes = getNameStats(lines, *numEntries);
+    if ( !buffers->options.usePipeline || buffers->inputFormat != INPUT_FORMAT_LIST || buffers->options.autoTune ||
+         buffers->options.numInputFiles > 0 ||
+         buffers->options.uniqueMode != UNIQUE_NONE || buffers->options.checkpointFile != NULL || buffers->options.resumeFile != NULL ||
+         ( sink->reduceFunc != NULL && buffers->options.dedupInodes != DEDUP_INODES_NONE ) )
+    {
+        return readAndPassAll(buffers, stream, NULL, 0, sink);
+    }
 
-    return nameTimes;
+    startTime = getMonotonicSeconds();
+    getPageFaults(&startMinorFaults, &startMajorFaults);
+
+    memset(&pipeline, 0x0, sizeof(Pipeline));
+    memset(&buffers->plan, 0x0, sizeof(GatherPlan));
+    memset(&buffers->stats, 0x0, sizeof(GatherStats));
+    buffers->numShards = 0;
+
+    numWorkers = getGatherNumThreads(buffers);
+
+    pipeline.buffers = buffers;
+    pipeline.fd = fileno(stream);
+    pipeline.sink = sink;
+
+    workers = calloc( numWorkers, sizeof(PipelineWorker) );
+    if ( unlikely( workers == NULL || allocPipeline(&pipeline, numWorkers) < 0 ) )
+    {
+        fputs("Err: Failed to allocate memory for pipeline.\n", stderr);
+        free(workers);
+        freePipeline(&pipeline);
+        return 0;
+    }
+
+    /* Read enough to tell if this is a records stream or compressed, which are not a plain list of files */
+    pipeline.firstBatch = RingBuffer_Pop(&pipeline.freeRing);
+    while ( pipeline.firstBatchUsed < RECORDS_HEADER_SIZE )
+    {
+        numRead = readIntoBatch(pipeline.fd, pipeline.firstBatch, pipeline.firstBatchUsed);
+        if ( numRead <= 0 )
+            break;
+
+        pipeline.firstBatchUsed += numRead;
+    }
+
+    /* Records, and compressed input (which is decompressed whole), are not lists to stream */
+    if ( isRecordsStream(pipeline.firstBatch->buf, pipeline.firstBatchUsed) ||
+         getCompressionKind(pipeline.firstBatch->buf, pipeline.firstBatchUsed) != COMPRESSION_NONE )
+    {
+        numEntries = readAndPassAll(buffers, stream, pipeline.firstBatch->buf, pipeline.firstBatchUsed, sink);
+
+        free(workers);
+        freePipeline(&pipeline);
+
+        return numEntries;
+    }
+
+    if ( buffers->options.dedupInodes != DEDUP_INODES_NONE )
+    {
+        buffers->needFields |= NEED_FIELD_INO;
+        pipeline.inodes = InodeSet_New();
+    }
+
+    buffers->gatheredFields = buffers->needFields;
+
+    for( i=0; i < numWorkers; i++ )
+    {
+        workers[i].pipeline = &pipeline;
+        workers[i].workerIdx = i;
+
+        if ( unlikely( pthread_create(&workers[i].thread, NULL, pipelineWorkerMain, &workers[i]) != 0 ) )
+            break;
+    }
+    pipeline.numWorkers = i;
+
+    if ( unlikely( pipeline.numWorkers == 0 || pthread_create(&readerThread, NULL, pipelineReaderMain, &pipeline) != 0 ) )
+    {
+        /* Could not start the pipeline, read and stat everything up front instead */
+        for( i=0; i < pipeline.numWorkers; i++ )
+            RingBuffer_Push(&pipeline.statRing, PIPELINE_END);
+        for( i=0; i < pipeline.numWorkers; i++ )
+            pthread_join(workers[i].thread, NULL);
+
+        numEntries = readAndPassAll(buffers, stream, pipeline.firstBatch->buf, pipeline.firstBatchUsed, sink);
+
+        free(workers);
+        freePipeline(&pipeline);
+
+        return numEntries;
+    }
+
+    if ( sink->reduceFunc == NULL )
+        runPipelineEmitter(&pipeline);
+
+    pthread_join(readerThread, NULL);
+    for( i=0; i < pipeline.numWorkers; i++ )
+    {
+        pthread_join(workers[i].thread, NULL);
+        buffers->stats.numDirGroups += workers[i].numDirGroups;
+    }
+
+    buffers->stats.numEntries = pipeline.numEntries;
+    buffers->stats.numFiltered = pipeline.numFiltered;
+    buffers->stats.readSeconds = pipeline.readerDoneTime - startTime;
+    buffers->stats.statSeconds = getMonotonicSeconds() - pipeline.readerDoneTime;
+    buffers->stats.numBatches = pipeline.totalBatches;
+    buffers->stats.numPipelineWorkers = pipeline.numWorkers;
+
+    getPageFaults(&buffers->stats.minorFaults, &buffers->stats.majorFaults);
+    buffers->stats.minorFaults -= startMinorFaults;
+    buffers->stats.majorFaults -= startMajorFaults;
+    buffers->stats.readMinorFaults = pipeline.readerDoneMinorFaults - startMinorFaults;
+    buffers->stats.readMajorFaults = pipeline.readerDoneMajorFaults - startMajorFaults;
+
+    free(workers);
+    freePipeline(&pipeline);
+
+    return pipeline.numEntries;
+}
+
+size_t streamNameStats(ReadNameStatBuffers *buffers, FILE *stream, NameStatEmitFunc emitFunc, void *arg)
+{
+    NameStatSink sink = { emitFunc, NULL, NULL, NULL, arg };
+
+    return runNameStatStream(buffers, stream, &sink);
+}
+
+size_t reduceNameStats(ReadNameStatBuffers *buffers, FILE *stream, NameStatReduceFunc reduceFunc, void *arg)
+{
+    NameStatSink sink = { NULL, reduceFunc, NULL, NULL, arg };
+
+    return runNameStatStream(buffers, stream, &sink);
+}
+
+size_t formatNameStats(ReadNameStatBuffers *buffers, FILE *stream, NameStatFormatFunc formatFunc, void *arg, FILE *outStream)
+{
+    NameStatSink sink = { NULL, NULL, formatFunc, outStream, arg };
+
+    /* Anything already printed must come first */
+    fflush(outStream);
+
+    return runNameStatStream(buffers, stream, &sink);
+}
+
+size_t serveNameStats(ReadNameStatBuffers *buffers, FILE *stream, NameStatEmitFunc emitFunc, NameStatFormatFunc formatFunc, void *arg, FILE *outStream)
+{
+    NameStatSink sink = { emitFunc, NULL, formatFunc, outStream, arg };
+    NameStat *nameStats;
+    size_t numEntries, numBatches;
+    int isEnd;
+
+    numBatches = 0;
+
+    do {
+        nameStats = readNextBatch(buffers, &numEntries, stream, &isEnd);
+
+        /* Nothing after the last batch (not even an empty line) is not a batch */
+        if ( isEnd && nameStats == NULL )
+            break;
+
+        if ( nameStats != NULL )
+        {
+            fflush(outStream);
+            passAll(buffers, nameStats, numEntries, &sink);
+            free(nameStats);
+
+            if ( buffers->options.showStats )
+                printGatherStats(buffers);
+        }
+
+        /* An empty line ends each answer */
+        fputc('\n', outStream);
+        fflush(outStream);
+
+        numBatches += 1;
+
+    } while ( !isEnd );
 
+    return numBatches;
 }
@@ -9,18 +9,175 @@
 #define _GATHER_MTIMES_H
 
 #include <stdio.h>
+#include <time.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+
+#include "shards.h"
+#include "huge_alloc.h"
+#include "ordered_output.h"
+#include "path_filter.h"
+
+/* Maximum number of worker threads (and thus shards) */
+#define MAX_SHARDS 256
+
+/*
+ * Time fields - Which timestamp is gathered into NameStat.fileTime
+ */
+#define TIME_FIELD_MTIME 0
+#define TIME_FIELD_ATIME 1
+#define TIME_FIELD_CTIME 2
+#define TIME_FIELD_BTIME 3
+
+/*
+ * Need fields - Bitmask of attributes (beyond the selected time field) which
+ *   must be filled in NameStat.statBuf. Anything not requested may be left as 0,
+ *   which allows the stat backend to skip retrieving them.
+ */
+#define NEED_FIELD_NONE  0x00
+#define NEED_FIELD_UID   0x01
+#define NEED_FIELD_GID   0x02
+#define NEED_FIELD_SIZE  0x04
+#define NEED_FIELD_MODE  0x08
+#define NEED_FIELD_INO   0x10  /* st_dev, st_ino and st_nlink */
+#define NEED_FIELD_ALL   0x1F
+
+/*
+ * Input formats - How lines of text input are interpreted.
+ *
+ *   A binary records stream (see records.h) is always detected and accepted, regardless of format.
+ */
+#define INPUT_FORMAT_LIST  0  /* One filename per line, each of which is stat'd */
+#define INPUT_FORMAT_EPOCH 1  /* "epoch path" per line (e.x. from find -printf '%T@ %p\n'), nothing is stat'd */
+
+/*
+ * UNIQUE_* - How paths listed more than once are handled, see GatherOptions.uniqueMode
+ */
+#define UNIQUE_NONE  0  /* Stat every line, even repeats */
+#define UNIQUE_FIRST 1  /* Keep only the first line of each path */
+#define UNIQUE_ALL   2  /* Keep every line, but stat each path once and share the result */
+
+/*
+ * DEDUP_INODES_* - How hard links to the same file are handled, see GatherOptions.dedupInodes
+ */
+#define DEDUP_INODES_NONE  0    /* Every name is a separate file */
+#define DEDUP_INODES_FIRST 1    /* Keep only the first name of each file */
+#define DEDUP_INODES_NAMES 2    /* Keep every name, but mark the later ones (see NAMESTAT_IS_REPEATED_INODE) */
 
 /* 
  * NameStat - A struct of provided-filename, and mtime associated.
  *   This is the object that will be sorted.
+ *
+ *   fileTime is the timestamp selected by ReadNameStatBuffers.timeField (mtime by default).
+ *     It is 0 if the file could not be stat'd, or the selected time is not available.
+ *
+ *   Only the fields of statBuf requested by ReadNameStatBuffers.needFields are guaranteed to be filled.
  */
 typedef struct {
     char        *fname;
     struct stat statBuf;
+    struct timespec fileTime;
 
 } NameStat;
 
+/*
+ * NAMESTAT_IS_VALID - Check if a NameStat was successfully stat'd, and should be printed.
+ */
+#define NAMESTAT_IS_VALID(_nameStat) ( (_nameStat)->fileTime.tv_sec != 0 )
+
+/*
+ * NAMESTAT_IS_REPEATED_INODE - With DEDUP_INODES_NAMES, check if a NameStat is a later name
+ *   of a file already seen, which totals should not count again. (Its st_nlink is cleared)
+ */
+#define NAMESTAT_IS_REPEATED_INODE(_nameStat) ( (_nameStat)->statBuf.st_nlink == 0 )
+
+/*
+ * GatherOptions - Options common to all tools, parsed by handleGatherArg
+ */
+typedef struct {
+    int numThreads;     /* Number of stat workers (and NameStat shards), default 1. 0 is one per cpu */
+    int showStats;      /* Print timings and layout to stderr when done */
+    int useDirGroups;   /* Stat runs of files sharing a directory relative to that directory, default 1 */
+    int autoTune;       /* Choose numThreads from the latency of a sample of stats (see GatherPlan) */
+    int usePipeline;    /* Overlap reading, stat'ing and output in streamNameStats, default 1 */
+
+    const char *checkpointFile;     /* If set, record progress here (see checkpoint.h) */
+    const char *resumeFile;         /* If set, restore progress from this checkpoint */
+    size_t checkpointInterval;      /* Files gathered between checkpoints */
+
+    size_t expectLines;     /* Expected number of input lines, to size the input buffer up front. 0 if unknown */
+
+    int uniqueMode;         /* One of UNIQUE_*, default UNIQUE_NONE */
+    int dedupInodes;        /* One of DEDUP_INODES_*, default DEDUP_INODES_NONE */
+
+    PathFilter *filter;     /* If set, lines it does not keep are dropped before anything is stat'd */
+
+    /* List files (see addGatherInputFile) read instead of the tool's input stream. "-" is that stream */
+    const char **inputFiles;
+    FILE **inputStreams;    /* Each list, opened by addGatherInputFile. NULL for "-" */
+    int numInputFiles;
+
+} GatherOptions;
+
+/*
+ * GatherStats - Statistics of the work done by readAndCreateNameStats, see printGatherStats
+ */
+typedef struct {
+    double readSeconds;     /* Reading and splitting input */
+    double statSeconds;     /* Gathering attributes (stat, or parsing) */
+    size_t numEntries;
+    size_t numDirGroups;    /* Directories opened to stat the files within them */
+    size_t numResumed;      /* Entries restored from a checkpoint rather than stat'd */
+    size_t numDuplicates;   /* Lines repeating an earlier path, which were not stat'd (see uniqueMode) */
+    size_t numRepeatedInodes;   /* Names of files already seen under another name (see dedupInodes) */
+    size_t numFiltered;     /* Lines dropped by GatherOptions.filter, which were not stat'd */
+
+    /* When streamed through the pipeline, readSeconds is until the end of input,
+     *   and statSeconds is the time after (the stages overlap)
+     */
+    size_t numBatches;
+    int numPipelineWorkers;
+
+    /* Input buffer, when sized up front (see GatherOptions.expectLines), else inputBufferSize is 0 */
+    size_t inputBufferSize;
+    int inputBufferKind;            /* One of HUGE_KIND_* */
+    const char *inputSizeSource;    /* "file" (size of stdin) or "lines" (from expectLines) */
+
+    /* Compressed input, if it was (see decompress.h), else compression is COMPRESSION_NONE */
+    int compression;
+    size_t compressedSize;
+    size_t numCompressedFrames;
+    double decompressSeconds;
+
+    /* Page faults taken while reading input, and in total */
+    long readMinorFaults;
+    long readMajorFaults;
+    long minorFaults;
+    long majorFaults;
+
+} GatherStats;
+
+/*
+ * Latency classes of a stat sample, see GatherPlan
+ */
+#define LATENCY_CLASS_CACHED 0  /* Served from the inode / dentry cache, stat is cpu-bound */
+#define LATENCY_CLASS_DISK   1  /* Reading inodes from local storage */
+#define LATENCY_CLASS_REMOTE 2  /* Network filesystem, or otherwise very slow */
+
+/*
+ * GatherPlan - How the gather was carried out, as chosen by GatherOptions.autoTune
+ *   (or as given on the commandline otherwise)
+ */
+typedef struct {
+    int isAutoTuned;
+    size_t sampleSize;          /* Number of files stat'd (on a single thread) to measure latency */
+    double sampleLatency;       /* Mean seconds per stat of the sample */
+    int latencyClass;           /* One of LATENCY_CLASS_* */
+    const char *backend;        /* "statx" or "lstat" */
+    int numThreads;             /* Workers used for the rest of the files */
+
+} GatherPlan;
+
 /*
  * ReadNameStatBuffers - Some "worker" data used for producting the NameStat data.
  *   Created once by initReadNameStatBuffers,
@@ -29,12 +186,40 @@ typedef struct {
  *   Destroying this buffer will free data pointed-to by NameStat objects,
  *     so do it only when you are done with the data.
  */
-typedef struct {
+typedef struct ReadNameStatBuffers {
     FILE *inputStream;
     char *inputStreamBuf;
     size_t inputStreamSize;
+    HugeBuffer inputBuffer;     /* Holds input instead of inputStream when its size is known up front */
+    char *decompressedBuf;      /* Compressed input, decompressed (see decompress.h) */
     char **lines;
 
+    /* Input of readNextBatch, kept between batches */
+    char *batchBuf;
+    size_t batchBufSize;
+    char *lineBuf;
+    size_t lineBufSize;
+
+    /* With GatherOptions.inputFiles, the buffers each list was gathered into (which hold its names) */
+    struct ReadNameStatBuffers **sourceBuffers;
+    int numSourceBuffers;
+
+    /* Options - Set after initReadNameStatBuffers, before readAndCreateNameStats */
+    int timeField;      /* One of TIME_FIELD_*, default TIME_FIELD_MTIME */
+    int needFields;     /* Bitmask of NEED_FIELD_*, default NEED_FIELD_NONE */
+    int inputFormat;    /* One of INPUT_FORMAT_*, default INPUT_FORMAT_LIST */
+    GatherOptions options;
+
+    /* Results - Set by readAndCreateNameStats */
+    int gatheredFields; /* Bitmask of NEED_FIELD_* which are actually filled in the NameStats */
+    int hasInputError;  /* Input could not be read (e.x. corrupt compressed input), rather than being empty */
+
+    NameStatShard shards[MAX_SHARDS];   /* How the NameStat array is split between workers */
+    int numShards;
+
+    GatherStats stats;
+    GatherPlan plan;
+
 } ReadNameStatBuffers;
 
 
@@ -60,12 +245,172 @@ extern void destroyReadNameStatBuffers(ReadNameStatBuffers *buffers);
  *   numEntries - A pointer which will be filled with the number of valid entries in return value
  *
  *   stream  - Stream from whence to read data (like stdin)
+ *
+ *   Returns NULL if there was nothing to gather, or if input could not be read (which also sets
+ *     buffers->hasInputError, so the tool can fail the run).
  */
 extern NameStat* readAndCreateNameStats(ReadNameStatBuffers *buffers, size_t *numEntries, FILE *stream);
 
+/**
+ * readNextBatch - For --serve, read the next batch of filenames from #stream, and gather them
+ *   as readAndCreateNameStats.
+ *
+ *   A batch is one filename per line, ended by an empty line (or the end of input), so a
+ *     long-running process can answer many requests without being started for each.
+ *     Buffers (and anything the caller caches) stay warm between batches.
+ *
+ *   numEntries - Filled with the number of entries in the batch, which may be 0
+ *
+ *   isEnd      - Set to 1 once the end of input is reached (after this batch)
+ *
+ *   Returns the NameStats of the batch, which the caller frees before the next batch,
+ *     or NULL if empty.
+ */
+extern NameStat *readNextBatch(ReadNameStatBuffers *buffers, size_t *numEntries, FILE *stream, int *isEnd);
+
+/*
+ * NameStatEmitFunc - Called by streamNameStats with each entry, in input order.
+ *
+ *   #nameStat (and its fname) is only valid for the duration of the call.
+ *     Entries which could not be stat'd are also passed, check NAMESTAT_IS_VALID.
+ */
+typedef void (*NameStatEmitFunc)(const NameStat *nameStat, void *arg);
+
+/**
+ * streamNameStats - Like readAndCreateNameStats, but calls #emitFunc with each entry in
+ *   input order instead of returning them all at once.
+ *
+ *   A list of files is streamed through a pipeline: a reader thread splits input into batches of
+ *     lines, buffers->options.numThreads workers stat each batch, and the calling thread puts the
+ *     batches back in order and emits them. Stages are connected by lock-free rings (see ring_buffer.h),
+ *     so reading input, stat'ing, and writing output all overlap.
+ *
+ *   Other input (records, epoch) or options which need the whole input (--auto, --unique, checkpoints)
+ *     are read up front with readAndCreateNameStats, then emitted.
+ *
+ *   #stream must not have been read from yet.
+ *
+ *   Returns the number of entries emitted.
+ */
+extern size_t streamNameStats(ReadNameStatBuffers *buffers, FILE *stream, NameStatEmitFunc emitFunc, void *arg);
+
+/*
+ * NameStatReduceFunc - Called by reduceNameStats with each entry, from the worker numbered #workerIdx
+ *
+ *   Calls with the same #workerIdx never overlap, so per-worker state needs no locking.
+ *     #nameStat is only valid for the duration of the call, and may be invalid (check NAMESTAT_IS_VALID)
+ */
+typedef void (*NameStatReduceFunc)(int workerIdx, const NameStat *nameStat, void *arg);
+
+/**
+ * getGatherNumThreads - Get the number of workers gathering for #buffers,
+ *   so workerIdx passed to a NameStatReduceFunc is always below this.
+ */
+extern int getGatherNumThreads(const ReadNameStatBuffers *buffers);
+
+/**
+ * reduceNameStats - Like streamNameStats, but #reduceFunc is called with each entry on the
+ *   stat worker which gathered it, in no particular order. For folding every entry into
+ *   per-worker totals (e.x. a histogram), merged once this returns.
+ *
+ *   Returns the number of entries reduced.
+ */
+extern size_t reduceNameStats(ReadNameStatBuffers *buffers, FILE *stream, NameStatReduceFunc reduceFunc, void *arg);
+
+/**
+ * getTimeFieldByName - Get the TIME_FIELD_* value associated with a name
+ *    ( "mtime", "atime", "ctime", or "btime" )
+ *
+ *   Returns -1 if name is not a known time field, or the time field
+ *     is not supported on this platform.
+ */
+extern int getTimeFieldByName(const char *name);
+
+/**
+ * initGatherOptions - Set #options to the defaults
+ */
+extern void initGatherOptions(GatherOptions *options);
+
+/**
+ * handleGatherArg - Handle a commandline argument common to all tools (see printGatherUsage)
+ *
+ *   Returns 1 if #arg was handled, 0 if it is not a common argument,
+ *     or -1 if it is invalid (and a message has been printed)
+ */
+extern int handleGatherArg(GatherOptions *options, const char *arg);
+
+/**
+ * addGatherInputFile - Add the list file #filename ("-" for the input stream) to be read instead of
+ *   the input stream. Each list is read and stat'd concurrently, and the results are joined in order.
+ *
+ *   The list is opened now, so a missing list fails before anything is gathered. "-" may only be given once.
+ *
+ *   Returns 0 on success, or -1 (after printing why) if it cannot be read.
+ */
+extern int addGatherInputFile(GatherOptions *options, const char *filename);
+
+/**
+ * checkServeGatherOptions - Check #options can be used with --serve, printing why not if they cannot.
+ *
+ *   Returns 1 if they can, otherwise 0.
+ */
+extern int checkServeGatherOptions(const GatherOptions *options);
+
+/**
+ * printGatherUsage - Print usage of the arguments handled by handleGatherArg to stderr
+ */
+extern void printGatherUsage(void);
+
+/**
+ * printGatherStats - Print the statistics of the last readAndCreateNameStats to stderr
+ */
+extern void printGatherStats(const ReadNameStatBuffers *buffers);
+
+/**
+ * getInputFormatByName - Get the INPUT_FORMAT_* value associated with a name ( "list" or "epoch" )
+ *
+ *   Returns -1 if name is not a known input format.
+ */
+extern int getInputFormatByName(const char *name);
+
+/**
+ * getTimeFieldName - Get the name associated with a TIME_FIELD_* value
+ */
+extern const char *getTimeFieldName(int timeField);
+
 #if defined __USE_XOPEN2K8 || __GLIBC_USE (LIB_EXT2)
 #define HAS_MSTREAM
 #endif
 
 
+/*
+ * NameStatFormatFunc - Called by formatNameStats to append the output for #nameStat to #out
+ *
+ *   Called from several threads at once, so must not share any state it changes.
+ *     #nameStat may be invalid (check NAMESTAT_IS_VALID)
+ */
+typedef void (*NameStatFormatFunc)(const NameStat *nameStat, OutBuffer *out, void *arg);
+
+/**
+ * formatNameStats - Like streamNameStats, but each batch of entries is formatted by #formatFunc
+ *   on the stat worker which gathered it, and the formatted batches are written to #outStream
+ *   in input order. Input gathered up front is formatted in chunks across the workers.
+ *
+ *   Output is byte-identical to calling #formatFunc for each entry in order, on one thread.
+ *
+ *   Returns the number of entries formatted.
+ */
+extern size_t formatNameStats(ReadNameStatBuffers *buffers, FILE *stream, NameStatFormatFunc formatFunc, void *arg, FILE *outStream);
+
+/**
+ * serveNameStats - The --serve loop. Reads batches from #stream (see readNextBatch) until the end
+ *   of input, and answers each by passing its entries in order to #emitFunc, or if NULL,
+ *   formatting them with #formatFunc, then writing an empty line to #outStream and flushing it.
+ *
+ *   With --stats, stats are printed after each batch.
+ *
+ *   Returns the number of batches answered.
+ */
+extern size_t serveNameStats(ReadNameStatBuffers *buffers, FILE *stream, NameStatEmitFunc emitFunc, NameStatFormatFunc formatFunc, void *arg, FILE *outStream);
+
 #endif
@@ -18,6 +18,7 @@
 #include "mtime_utils.h"
 
 #include "gather_mtimes.h"
+#include "id_aggregate.h"
 
 #define __INCLUDE_GROUP_LIST_C
 #include "group_list.h"
@@ -26,30 +27,57 @@
 
 static const volatile char* APP_NAME = "get_group";
 
+/*
+ * GetGroupOptions - Options parsed from the commandline
+ */
+typedef struct {
+    int isSummary;      /* Print totals per group, rather than each file */
+    int numAgeBounds;   /* Split the totals at these ages (days), if > 0 */
+    long ageBounds[ID_AGGREGATE_MAX_AGE_BOUNDS];
+    int isServe;        /* Answer batches of filenames until end of input, see --serve */
+    GatherOptions gather;
+
+} GetGroupOptions;
+
 /*
  * printUsage - Prints usage information to stderr
  */
 static void printUsage(void)
 {
-    fprintf(stderr, "Usage: %s (Options)\n  Takes input of filenames on stdin, and prints\n", APP_NAME);
+    fprintf(stderr, "Usage: %s (Options) [list files...]\n  Takes input of filenames on stdin (or [list files]), and prints\n", APP_NAME);
     fputs("   the 'filename<TAB>group name<TAB>group gid' to stdout.\n\n", stderr);
     fputs("    Options:\n\n", stderr);
+    fputs("      --summary     Instead of printing each file, print one line per group:\n", stderr);
+    fputs("                      'group name<TAB>gid<TAB>count<TAB>total size<TAB>oldest<TAB>newest'\n", stderr);
+    fputs("                      with oldest and newest mtime as epoch. Ordered by gid.\n\n", stderr);
+    fputs("      --by-age=D,.. Split each summary line by age in days, at each (ascending) D given,\n", stderr);
+    fputs("                      adding an age range column after the gid. Implies --summary.\n", stderr);
+    fputs("                      e.x. --by-age=30,90,365 gives ranges 0-30, 30-90, 90-365, and 365+\n\n", stderr);
+    fputs("      --serve       Run as a coprocess: read batches of filenames, each ended by an empty line,\n", stderr);
+    fputs("                      and answer each with its output followed by an empty line, until the\n", stderr);
+    fputs("                      end of input. Names of ids are looked up once for all batches.\n\n", stderr);
+    printGatherUsage();
     fputs("      --help     Print this help message.\n\n", stderr);
     fputs("      --version  Show version information\n\n", stderr);
 }
 
 
 /**
- * handleArgs - Handle args on commandline.
- *
- *   Sets isEpoch to 1 if -r was specified, otherwise 0.
+ * handleArgs - Handle args on commandline, filling #options
  *
+ *   Default is to print each file.
  *
  * If return is >= 0, the program should exit with that code.
  */
-static inline int handleArgs(int argc, char **argv)
+static inline int handleArgs(int argc, char **argv, GetGroupOptions *options)
 {
     int i;
+    int gatherRet;
+
+    options->isSummary = 0;
+    options->numAgeBounds = 0;
+    options->isServe = 0;
+    initGatherOptions(&options->gather);
 
     for( i=1; i < argc; i++ )
     {
@@ -63,6 +91,39 @@ static inline int handleArgs(int argc, char **argv)
             printVersion(APP_NAME);
             return 0;
         }
+        else if ( strcmp("--summary", argv[i]) == 0 )
+        {
+            options->isSummary = 1;
+        }
+        else if ( strcmp("--serve", argv[i]) == 0 )
+        {
+            options->isServe = 1;
+        }
+        else if ( strstr(argv[i], "--by-age=") == argv[i] )
+        {
+            options->numAgeBounds = parseAgeBounds(argv[i] + 9, options->ageBounds);
+            if ( options->numAgeBounds < 0 )
+            {
+                fprintf(stderr, "Invalid ages (expected ascending days, e.x. 30,90,365): %s\n\n", argv[i] + 9);
+                printUsage();
+                return 1;
+            }
+            options->isSummary = 1;
+        }
+        else if ( (gatherRet = handleGatherArg(&options->gather, argv[i])) != 0 )
+        {
+            if ( gatherRet < 0 )
+            {
+                fputs("\n", stderr);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( argv[i][0] != '-' || strcmp("-", argv[i]) == 0 )
+        {
+            if ( addGatherInputFile(&options->gather, argv[i]) < 0 )
+                return 1;
+        }
         else
         {
             fprintf(stderr, "Unknown argument: %s\n\n", argv[i]);
@@ -71,9 +132,58 @@ static inline int handleArgs(int argc, char **argv)
         }
     }
 
+    if ( options->isServe && options->isSummary )
+    {
+        fputs("--serve cannot be combined with --summary or --by-age\n", stderr);
+        return 1;
+    }
+
+    if ( options->isServe && !checkServeGatherOptions(&options->gather) )
+        return 1;
+
     return -1;
 }
 
+/*
+ * emitGroup - Print the name and group of #nameStat, if valid
+ */
+static void emitGroup(const NameStat *nameStat, void *_groupInfoList)
+{
+    GroupInfoList *groupInfoList = (GroupInfoList *)_groupInfoList;
+
+    if ( likely(NAMESTAT_IS_VALID(nameStat)) )
+        printf("%s\t%s\t%d\n", nameStat->fname, GroupInfoList_GetName(groupInfoList, nameStat->statBuf.st_gid), nameStat->statBuf.st_gid);
+}
+
+/**
+ * printGroupSummary - Aggregate everything on #stream by gid, and print one line per group (and age range),
+ *   resolving each distinct gid to a name only once.
+ */
+static void printGroupSummary(ReadNameStatBuffers *buffers, FILE *stream, const GetGroupOptions *options, GroupInfoList *groupInfoList)
+{
+    IdAggregateTable *table;
+    IdAggregate *group;
+    size_t i;
+
+    table = aggregateNameStatsById(buffers, stream, ID_FIELD_GID, options->ageBounds, options->numAgeBounds);
+
+    for( i=0; i < table->numGroups; i++ )
+    {
+        group = &table->groups[i];
+
+        printf("%s\t%u\t", GroupInfoList_GetName(groupInfoList, group->id), group->id);
+        if ( table->numAgeBounds > 0 )
+        {
+            printAgeRange(table, group->ageRange, stdout);
+            putchar('\t');
+        }
+        printf("%zu\t%lld\t%ld\t%ld\n", group->count, (long long)group->totalSize,
+            (long)group->minTime.tv_sec, (long)group->maxTime.tv_sec);
+    }
+
+    IdAggregateTable_Free(table);
+}
+
 /**
  * Ya, I heard you like main's dog, so I put a __start in your main now you can
  *   start your program while your program's startin, dog
@@ -81,44 +191,51 @@ static inline int handleArgs(int argc, char **argv)
 int main(int argc, char* argv[])
 {
     ReadNameStatBuffers *buffers;
-    NameStat *nameStats = NULL;
     GroupInfoList *groupInfoList;
-    size_t numEntries;
-    int i;
+    int i, ret;
+    GetGroupOptions options;
 
     /* Parse args.
      *  If return is >= 0, we should exit with that code.
      */
-    if ( (i = handleArgs ( argc, (char **)argv) ) >= 0 )
+    if ( (i = handleArgs ( argc, (char **)argv, &options ) ) >= 0 )
         return i;
 
     buffers = initReadNameStatBuffers();
     if ( buffers == NULL )
         return ERROR_ALLOC_MEMORY;
 
-    groupInfoList = GroupInfoList_New();
+    buffers->options = options.gather;
+    buffers->needFields = NEED_FIELD_GID;
+    if ( options.isSummary )
+        buffers->needFields |= NEED_FIELD_SIZE;
 
-    nameStats = readAndCreateNameStats(buffers, &numEntries, stdin);
-    if ( !nameStats )
-        goto cleanup_and_exit;
+    groupInfoList = GroupInfoList_New();
 
-    for(i=0; i < numEntries; i++ )
+    if ( options.isServe )
     {
-        if ( likely(nameStats[i].statBuf.st_mtime != 0) )
-        {
-            printf("%s\t%s\t%d\n", nameStats[i].fname, GroupInfoList_GetName(groupInfoList, nameStats[i].statBuf.st_gid), nameStats[i].statBuf.st_gid);
-
-        }
+        /* Stats, if asked for, are printed after each batch */
+        serveNameStats(buffers, stdin, emitGroup, NULL, groupInfoList, stdout);
+        options.gather.showStats = 0;
+    }
+    else if ( options.isSummary )
+    {
+        printGroupSummary(buffers, stdin, &options, groupInfoList);
+    }
+    else
+    {
+        streamNameStats(buffers, stdin, emitGroup, groupInfoList);
     }
 
-cleanup_and_exit:
+    if ( options.gather.showStats )
+        printGatherStats(buffers);
 
-    /* Final cleanup */
-    if ( nameStats != NULL )
-        free(nameStats);
+    /* Input which could not be read (as opposed to empty input) fails the run */
+    ret = buffers->hasInputError ? 1 : 0;
 
+    /* Final cleanup */
     GroupInfoList_Free(groupInfoList);
     destroyReadNameStatBuffers(buffers);
 
-    return 0;
+    return ret;
 }
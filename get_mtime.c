@@ -1,7 +1,7 @@
 /*
  * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
  *
- * sort_mtime.c - Sorts list of files by mtime
+ * get_mtime.c - Prints list of files with their mtime
  */
 
 #include <features.h>
@@ -17,9 +17,33 @@
 #include "mtime_utils.h"
 
 #include "gather_mtimes.h"
+#include "dir_aggregate.h"
+#include "age_sketch.h"
+#include "records.h"
+#include "partition_writer.h"
 
 #define ERROR_ALLOC_MEMORY 12
 
+/* Size of buffer used for a formatted time */
+#define TIME_BUFF_SIZE 64
+
+/*
+ * GetMtimeOptions - Options parsed from the commandline
+ */
+typedef struct {
+    int isEpoch;
+    char *customFormat;
+    int timeField;
+    int byDirDepth;     /* Directory depth to aggregate by, or -1 to print each file */
+    int isRecords;      /* Output a binary records stream (see records.h) */
+    int histogram;      /* One of AGE_BUCKETS_* to print a histogram of ages, or -1 to print each file */
+    int isServe;        /* Answer batches of filenames until end of input, see --serve */
+    int inputFormat;    /* One of INPUT_FORMAT_* */
+    PartitionOptions partition;
+    GatherOptions gather;
+
+} GetMtimeOptions;
+
 static const volatile char* APP_NAME = "get_mtime";
 
 /*
@@ -27,29 +51,71 @@ static const volatile char* APP_NAME = "get_mtime";
  */
 static void printUsage(void)
 {
-    fputs("Usage: get_mtime (Options)\n  Takes input of filenames on stdin, and prints the name,\n     followed by mtime to stdout\n\n", stderr);
+    fputs("Usage: get_mtime (Options) [list files...]\n  Takes input of filenames on stdin (or [list files]), and prints the name,\n     followed by mtime to stdout\n\n", stderr);
     fputs("    Options:\n\n", stderr);
     fputs("      -e  --epoch   Print epoch time.\n\n", stderr);
     fputs("      --format=X    Print time using strformat string, 'X'. See man strftime\n\n", stderr);
+    fputs("      --time=X      Print timestamp X instead of mtime. X is one of:\n", stderr);
+    fputs("                      mtime - Modification time (default)\n", stderr);
+    fputs("                      atime - Access time\n", stderr);
+    fputs("                      ctime - Status (metadata) change time\n", stderr);
+    fputs("                      btime - Birth (creation) time, where supported by the filesystem\n\n", stderr);
+    fputs("      --by-dir=N    Instead of printing each file, print one line per directory,\n", stderr);
+    fputs("                     grouping files by the first N components of their directory:\n", stderr);
+    fputs("                     'dir<TAB>count<TAB>total size<TAB>oldest<TAB>newest<TAB>newest file'\n", stderr);
+    fputs("                     Directories are printed in the order first seen. --by-dir is --by-dir=1\n\n", stderr);
+    fputs("      --histogram=X Instead of printing each file, print a report of how old the files are:\n", stderr);
+    fputs("                     the count, oldest and newest times, p50/p90/p99 ages (within 1%),\n", stderr);
+    fputs("                     and the number of files in each range of ages, given by X:\n", stderr);
+    fputs("                      day  - One range per day, up to a year\n", stderr);
+    fputs("                      week - One range per week, up to ten years\n", stderr);
+    fputs("                      log  - Doubling ranges, under 1 day, 1-2 days, 2-4 days, ...\n", stderr);
+    fputs("                     Runs in constant memory, no matter how many files.\n\n", stderr);
+    fputs("      --output=X    Output format. X is one of:\n", stderr);
+    fputs("                      text    - Tab-separated text (default)\n", stderr);
+    fputs("                      records - Binary record stream of path, time (ns), uid, gid, size\n", stderr);
+    fputs("                                  and mode. See records.h for the format.\n\n", stderr);
+    fputs("      --serve       Run as a coprocess: read batches of filenames, each ended by an empty line,\n", stderr);
+    fputs("                      and answer each with its output followed by an empty line, until the\n", stderr);
+    fputs("                      end of input. Saves starting a process per batch.\n\n", stderr);
+    fputs("      --input=X     Input format. X is one of:\n", stderr);
+    fputs("                      list  - One filename per line, each of which is stat'd (default)\n", stderr);
+    fputs("                      epoch - An epoch time (with optional fraction), a space, then a filename\n", stderr);
+    fputs("                                per line, e.x. from find -printf '%T@ %p\\n'. Nothing is stat'd,\n", stderr);
+    fputs("                                so only the time is known. Use --time to label which time it is.\n\n", stderr);
+    printPartitionUsage();
+    printGatherUsage();
     fputs("      --help     Print this help message.\n\n", stderr);
     fputs("      --version  Show version information\n\n", stderr);
+    fputs("Input may be a list of filenames, or a binary record stream (as written by --output=records),\n  in which case files are not stat'd again.\n\n", stderr);
     fputs("Default output format is ctime.\nIf you want to easily sort the output, pipe names to sort_mtime, then pipe output to get_mtime\n\n", stderr);
 }
 
 
 /**
- * handleArgs - Handle args on commandline.
- *
- *   Sets isEpoch to 1 if -r was specified, otherwise 0.
+ * handleArgs - Handle args on commandline, filling #options
  *
+ *   Defaults are: ctime output format, TIME_FIELD_MTIME, and no directory aggregation.
  *
  * If return is >= 0, the program should exit with that code.
  */
-static inline int handleArgs(int argc, char **argv, int *isEpoch, char **customFormat)
+static inline int handleArgs(int argc, char **argv, GetMtimeOptions *options)
 {
     int i;
+    int gatherRet;
+    int partitionRet;
+    char *endPtr;
 
-    *isEpoch = 0;
+    options->isEpoch = 0;
+    options->customFormat = NULL;
+    options->timeField = TIME_FIELD_MTIME;
+    options->byDirDepth = -1;
+    options->isRecords = 0;
+    options->histogram = -1;
+    options->isServe = 0;
+    options->inputFormat = INPUT_FORMAT_LIST;
+    initGatherOptions(&options->gather);
+    initPartitionOptions(&options->partition);
 
     for( i=1; i < argc; i++ )
     {
@@ -60,22 +126,101 @@ static inline int handleArgs(int argc, char **argv, int *isEpoch, char **customF
         }
         else if ( strcmp("-e", argv[i]) == 0 || strcmp("--epoch", argv[i]) == 0 )
         {
-            if ( *isEpoch == 1 )
+            if ( options->isEpoch == 1 )
             {
                 fputs("-e or --epoch provided more than once.\n", stderr);
                 return 1;
             }
-            *isEpoch = 1;
+            options->isEpoch = 1;
         }
         else if( strstr(argv[i], "--format=") == argv[i] )
         {
-            customFormat[0] = argv[i] + 9;
+            options->customFormat = argv[i] + 9;
+        }
+        else if ( strstr(argv[i], "--time=") == argv[i] )
+        {
+            options->timeField = getTimeFieldByName(argv[i] + 7);
+            if ( options->timeField < 0 )
+            {
+                fprintf(stderr, "Unknown or unsupported time field: %s\n\n", argv[i] + 7);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( strcmp("--by-dir", argv[i]) == 0 )
+        {
+            options->byDirDepth = 1;
+        }
+        else if ( strstr(argv[i], "--by-dir=") == argv[i] )
+        {
+            options->byDirDepth = strtol(argv[i] + 9, &endPtr, 10);
+            if ( *endPtr != '\0' || endPtr == argv[i] + 9 || options->byDirDepth < 0 )
+            {
+                fprintf(stderr, "Invalid directory depth: %s\n\n", argv[i] + 9);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( strstr(argv[i], "--histogram=") == argv[i] )
+        {
+            options->histogram = getAgeBucketModeByName(argv[i] + 12);
+            if ( options->histogram < 0 )
+            {
+                fprintf(stderr, "Unknown histogram buckets: %s\n\n", argv[i] + 12);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( strcmp("--serve", argv[i]) == 0 )
+        {
+            options->isServe = 1;
+        }
+        else if ( strstr(argv[i], "--input=") == argv[i] )
+        {
+            options->inputFormat = getInputFormatByName(argv[i] + 8);
+            if ( options->inputFormat < 0 )
+            {
+                fprintf(stderr, "Unknown input format: %s\n\n", argv[i] + 8);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( strcmp("--output=records", argv[i]) == 0 )
+        {
+            options->isRecords = 1;
+        }
+        else if ( strcmp("--output=text", argv[i]) == 0 )
+        {
+            options->isRecords = 0;
         }
         else if ( strcmp("--version", argv[i]) == 0 )
         {
             printVersion(APP_NAME);
             return 0;
         }
+        else if ( (partitionRet = handlePartitionArg(&options->partition, argv[i])) != 0 )
+        {
+            if ( partitionRet < 0 )
+            {
+                fputs("\n", stderr);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( (gatherRet = handleGatherArg(&options->gather, argv[i])) != 0 )
+        {
+            if ( gatherRet < 0 )
+            {
+                fputs("\n", stderr);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( argv[i][0] != '-' || strcmp("-", argv[i]) == 0 )
+        {
+            if ( addGatherInputFile(&options->gather, argv[i]) < 0 )
+                return 1;
+        }
         else
         {
             fprintf(stderr, "Unknown argument: %s\n\n", argv[i]);
@@ -84,9 +229,285 @@ static inline int handleArgs(int argc, char **argv, int *isEpoch, char **customF
         }
     }
 
+    if ( options->isRecords && options->byDirDepth >= 0 )
+    {
+        fputs("--output=records cannot be combined with --by-dir\n", stderr);
+        return 1;
+    }
+
+    if ( options->histogram >= 0 && ( options->isRecords || options->byDirDepth >= 0 ) )
+    {
+        fputs("--histogram cannot be combined with --output=records or --by-dir\n", stderr);
+        return 1;
+    }
+
+    if ( options->isServe && ( options->isRecords || options->byDirDepth >= 0 || options->histogram >= 0 ) )
+    {
+        fputs("--serve only prints each file, so cannot be combined with --output=records, --by-dir or --histogram\n", stderr);
+        return 1;
+    }
+
+    if ( options->isServe && !checkServeGatherOptions(&options->gather) )
+        return 1;
+
+    if ( !checkPartitionOptions(&options->partition) )
+        return 1;
+
+    if ( options->partition.partitionBy >= 0 && ( options->byDirDepth >= 0 || options->histogram >= 0 || options->isServe ) )
+    {
+        fputs("--partition-by writes each file, so cannot be combined with --by-dir, --histogram or --serve\n", stderr);
+        return 1;
+    }
+
+    if ( options->inputFormat == INPUT_FORMAT_EPOCH && options->byDirDepth >= 0 )
+    {
+        fputs("--input=epoch only provides a time, so cannot be combined with --by-dir\n", stderr);
+        return 1;
+    }
+
     return -1;
 }
 
+/**
+ * formatTime - Format #timeVal into #timeBuff according to #options, without a trailing newline
+ */
+static void formatTime(char *timeBuff, time_t timeVal, const GetMtimeOptions *options)
+{
+    struct tm tmpTm;
+    char *newline;
+
+    if ( options->isEpoch )
+    {
+        snprintf(timeBuff, TIME_BUFF_SIZE, "%ld", (long)timeVal);
+    }
+    else if ( options->customFormat == NULL )
+    {
+        ctime_r(&timeVal, timeBuff);
+        newline = strchr(timeBuff, '\n');
+        if ( newline != NULL )
+            *newline = '\0';
+    }
+    else
+    {
+        localtime_r(&timeVal, &tmpTm);
+        strftime(timeBuff, TIME_BUFF_SIZE, options->customFormat, &tmpTm);
+    }
+}
+
+/**
+ * printByDir - Aggregate the valid entries of #nameStats by directory prefix (in a single pass,
+ *   without sorting), and print one line per directory.
+ */
+static void printByDir(NameStat *nameStats, size_t numEntries, const GetMtimeOptions *options)
+{
+    DirAggregateTable *table;
+    DirAggregate *group;
+    char minTimeBuff[TIME_BUFF_SIZE], maxTimeBuff[TIME_BUFF_SIZE];
+    size_t i;
+
+    table = DirAggregateTable_New(options->byDirDepth);
+
+    for( i=0; i < numEntries; i++ )
+    {
+        if ( unlikely( !NAMESTAT_IS_VALID(&nameStats[i]) ) )
+            continue;
+
+        /* Each file is counted once, under the directory of its first name */
+        if ( options->gather.dedupInodes == DEDUP_INODES_NAMES && NAMESTAT_IS_REPEATED_INODE(&nameStats[i]) )
+            continue;
+
+        DirAggregateTable_Add(table, &nameStats[i]);
+    }
+
+    for( i=0; i < table->numGroups; i++ )
+    {
+        group = &table->groups[i];
+
+        formatTime(minTimeBuff, group->minTime.tv_sec, options);
+        formatTime(maxTimeBuff, group->maxTime.tv_sec, options);
+
+        printf("%.*s\t%zu\t%lld\t%s\t%s\t%s\n", (int)group->prefixLen, group->prefix, group->count,
+            (long long)group->totalSize, minTimeBuff, maxTimeBuff, group->newestName);
+    }
+
+    DirAggregateTable_Free(table);
+}
+
+/*
+ * HistogramState - Passed to reduceAge by reduceNameStats
+ */
+typedef struct {
+    const GetMtimeOptions *options;
+    AgeSketch *sketches;    /* One per worker */
+
+} HistogramState;
+
+/*
+ * reduceAge - Add the age of #nameStat, if valid, to the sketch of worker #workerIdx
+ */
+static void reduceAge(int workerIdx, const NameStat *nameStat, void *_state)
+{
+    HistogramState *state = (HistogramState *)_state;
+
+    if ( unlikely( !NAMESTAT_IS_VALID(nameStat) ) )
+        return;
+
+    /* Each file is counted once, as with --by-dir */
+    if ( state->options->gather.dedupInodes == DEDUP_INODES_NAMES && NAMESTAT_IS_REPEATED_INODE(nameStat) )
+        return;
+
+    AgeSketch_Add(&state->sketches[workerIdx], nameStat->fileTime.tv_sec);
+}
+
+/**
+ * printHistogram - Sketch the ages of everything on #stream (without holding on to any entry),
+ *   and print the report.
+ */
+static void printHistogram(ReadNameStatBuffers *buffers, FILE *stream, const GetMtimeOptions *options)
+{
+    HistogramState state;
+    int numSketches, i;
+    time_t now;
+
+    numSketches = getGatherNumThreads(buffers);
+    now = time(NULL);
+
+    state.options = options;
+    state.sketches = malloc( sizeof(AgeSketch) * numSketches );
+    for( i=0; i < numSketches; i++ )
+        AgeSketch_Init(&state.sketches[i], options->histogram, now);
+
+    reduceNameStats(buffers, stream, reduceAge, &state);
+
+    for( i=1; i < numSketches; i++ )
+        AgeSketch_Merge(&state.sketches[0], &state.sketches[i]);
+
+    AgeSketch_PrintReport(&state.sketches[0], stdout);
+
+    free(state.sketches);
+}
+
+/*
+ * EmitState - Passed to emitRecord by streamNameStats
+ */
+typedef struct {
+    const GetMtimeOptions *options;
+    ReadNameStatBuffers *buffers;
+    int wroteHeader;
+
+} EmitState;
+
+/*
+ * formatTimeLine - Append the name and formatted time of #nameStat, if valid, to #out.
+ *   Called on the stat workers by formatNameStats.
+ */
+static void formatTimeLine(const NameStat *nameStat, OutBuffer *out, void *_options)
+{
+    const GetMtimeOptions *options = (const GetMtimeOptions *)_options;
+    char timeBuff[TIME_BUFF_SIZE];
+
+    if ( likely(NAMESTAT_IS_VALID(nameStat)) )
+    {
+        formatTime(timeBuff, nameStat->fileTime.tv_sec, options);
+        OutBuffer_Printf(out, "%s\t%s\n", nameStat->fname, timeBuff);
+    }
+}
+
+/*
+ * emitRecord - Write #nameStat as a record, if valid, preceded by the header on the first call
+ */
+static void emitRecord(const NameStat *nameStat, void *_state)
+{
+    EmitState *state = (EmitState *)_state;
+
+    if ( unlikely( !state->wroteHeader ) )
+    {
+        writeRecordsHeader(stdout, state->options->timeField, state->buffers->gatheredFields);
+        state->wroteHeader = 1;
+    }
+
+    if ( likely(NAMESTAT_IS_VALID(nameStat)) )
+        writeRecord(stdout, nameStat);
+}
+
+/*
+ * PartitionState - Passed to emitPartitioned by streamNameStats
+ */
+typedef struct {
+    const GetMtimeOptions *options;
+    PartitionWriter *writer;
+    OutBuffer out;
+
+} PartitionState;
+
+/*
+ * writePartitionHeader - Start each --output=records partition file with the header
+ */
+static void writePartitionHeader(FILE *file, void *_buffers)
+{
+    ReadNameStatBuffers *buffers = (ReadNameStatBuffers *)_buffers;
+
+    writeRecordsHeader(file, buffers->timeField, buffers->gatheredFields);
+}
+
+/*
+ * emitPartitioned - Write #nameStat, if valid, to the partition file of its time
+ */
+static void emitPartitioned(const NameStat *nameStat, void *_state)
+{
+    PartitionState *state = (PartitionState *)_state;
+    size_t pathLen;
+
+    if ( unlikely( !NAMESTAT_IS_VALID(nameStat) ) )
+        return;
+
+    state->out.len = 0;
+
+    if ( state->options->isRecords )
+    {
+        pathLen = strlen(nameStat->fname);
+        encodeRecordFixed( (unsigned char *)OutBuffer_Reserve(&state->out, RECORD_FIXED_SIZE + pathLen), nameStat, pathLen );
+        state->out.len += RECORD_FIXED_SIZE;
+        OutBuffer_Append(&state->out, nameStat->fname, pathLen);
+    }
+    else
+    {
+        formatTimeLine(nameStat, &state->out, (void *)state->options);
+    }
+
+    PartitionWriter_Write(state->writer, nameStat->fileTime.tv_sec, state->out.data, state->out.len);
+}
+
+/**
+ * writePartitioned - Write everything on #stream into the --partition-by files, in a single pass
+ *
+ *   Returns 0 on success, or -1 if the files could not all be written.
+ */
+static int writePartitioned(ReadNameStatBuffers *buffers, FILE *stream, const GetMtimeOptions *options)
+{
+    PartitionState state;
+
+    state.options = options;
+    state.writer = PartitionWriter_New(&options->partition, options->isRecords ? ".records" : ".txt",
+        options->isRecords ? writePartitionHeader : NULL, buffers);
+    if ( state.writer == NULL )
+        return -1;
+
+    OutBuffer_Init(&state.out);
+
+    streamNameStats(buffers, stream, emitPartitioned, &state);
+
+    if ( options->gather.showStats )
+    {
+        fprintf(stderr, "stats: partitions: files=%zu reopens=%zu max_open=%d\n",
+            state.writer->numFiles, state.writer->numReopens, state.writer->maxOpen);
+    }
+
+    OutBuffer_Free(&state.out);
+
+    return PartitionWriter_Free(state.writer);
+}
+
 /**
  * Ya main' dog
  */
@@ -96,73 +517,85 @@ int main(int argc, char* argv[])
     NameStat *nameStats = NULL;
     size_t numEntries;
     int i;
-    int isEpoch;
-    char *customFormat = NULL;
+    int ret = 0;
+    GetMtimeOptions options;
+    EmitState emitState;
 
     /* Parse args.
      *  If return is >= 0, we should exit with that code.
      */
-    if ( (i = handleArgs ( argc, (char **)argv, &isEpoch, &customFormat ) ) >= 0 )
+    if ( (i = handleArgs ( argc, (char **)argv, &options ) ) >= 0 )
         return i;
 
     buffers = initReadNameStatBuffers();
     if ( buffers == NULL )
         return ERROR_ALLOC_MEMORY;
 
-    nameStats = readAndCreateNameStats(buffers, &numEntries, stdin);
-    if ( !nameStats )
+    buffers->timeField = options.timeField;
+    buffers->inputFormat = options.inputFormat;
+    buffers->options = options.gather;
+    if ( options.byDirDepth >= 0 )
+        buffers->needFields |= NEED_FIELD_SIZE;
+    if ( options.isRecords && options.inputFormat != INPUT_FORMAT_EPOCH )
+        buffers->needFields |= RECORD_FIELDS;
+
+    if ( options.isServe )
+    {
+        /* Load the timezone once, up front, rather than on the first batch */
+        tzset();
+
+        serveNameStats(buffers, stdin, NULL, formatTimeLine, &options, stdout);
         goto cleanup_and_exit;
+    }
+    else if ( options.histogram >= 0 )
+    {
+        printHistogram(buffers, stdin, &options);
+    }
+    else if ( options.partition.partitionBy >= 0 )
+    {
+        if ( writePartitioned(buffers, stdin, &options) < 0 )
+            ret = 1;
+    }
+    else if ( options.byDirDepth >= 0 )
+    {
+        /* Groups are only complete once everything is in, so there is nothing to stream */
+        nameStats = readAndCreateNameStats(buffers, &numEntries, stdin);
+        if ( !nameStats )
+            goto cleanup_and_exit;
 
-    if ( !isEpoch )
+        printByDir(nameStats, numEntries, &options);
+    }
+    else if ( options.isRecords )
     {
-        char *timeBuff = malloc(64);
-        if ( customFormat == NULL )
-        {
-            for(i=0; i < numEntries; i++)
-            {
-                if ( likely(nameStats[i].statBuf.st_mtime != 0) )
-                {
-                    ctime_r(&nameStats[i].statBuf.st_mtime, timeBuff);
-                    
-                    printf("%s\t%s", nameStats[i].fname, timeBuff);
-                }
-            }
-        }
-        else
-        {
-            struct tm *tmpTm;
-            for(i=0; i < numEntries; i++)
-            {
-                if ( likely(nameStats[i].statBuf.st_mtime != 0) )
-                {
-                    tmpTm = localtime(&nameStats[i].statBuf.st_mtime);
-                    strftime(timeBuff, 64, customFormat, tmpTm);
-                    
-                    printf("%s\t%s\n", nameStats[i].fname, timeBuff);
-                }
-            }
+        emitState.options = &options;
+        emitState.buffers = buffers;
+        emitState.wroteHeader = 0;
 
+        streamNameStats(buffers, stdin, emitRecord, &emitState);
 
-        }
-        free(timeBuff);
+        /* Empty input is still a valid (empty) records stream */
+        if ( !emitState.wroteHeader )
+            writeRecordsHeader(stdout, options.timeField, buffers->gatheredFields);
     }
     else
     {
-        for(i=0; i < numEntries; i++)
-        {
-            if ( likely(nameStats[i].statBuf.st_mtime != 0) )
-            {
-                printf("%s\t%ld\n", nameStats[i].fname, nameStats[i].statBuf.st_mtime);
-            }
-        }
+        /* Formatting times is the bulk of the work once stats are fast, so it is done on the workers */
+        formatNameStats(buffers, stdin, formatTimeLine, &options, stdout);
     }
 
+    if ( options.gather.showStats )
+        printGatherStats(buffers);
+
 cleanup_and_exit:
 
+    /* Input which could not be read (as opposed to empty input) fails the run */
+    if ( buffers->hasInputError )
+        ret = 1;
+
     /* Final cleanup */
     if ( nameStats != NULL )
         free(nameStats);
     destroyReadNameStatBuffers(buffers);
 
-    return 0;
+    return ret;
 }
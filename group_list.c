@@ -111,8 +111,18 @@ const char *GroupInfoList_GetName(GroupInfoList *groupInfoList, gid_t pw_gid)
     struct group *gr;
 
     gr = getgrgid(pw_gid);
+    if ( unlikely( gr == NULL ) )
+    {
+        /* No name for this id, so use the number itself (like ls does) */
+        char idStr[24];
 
-    cur = GroupInfoList_AddNode(groupInfoList, pw_gid, gr->gr_name);
+        snprintf(idStr, sizeof(idStr), "%u", (unsigned int)pw_gid);
+        cur = GroupInfoList_AddNode(groupInfoList, pw_gid, idStr);
+    }
+    else
+    {
+        cur = GroupInfoList_AddNode(groupInfoList, pw_gid, gr->gr_name);
+    }
 
     return cur->gr_name;
 }
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * huge_alloc.c - Large buffers backed by huge pages, to cut page faults on big inputs
+ */
+
+#ifndef _GNU_SOURCE
+  #define _GNU_SOURCE
+#endif
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include "mtime_utils.h"
+
+#include "huge_alloc.h"
+
+static const char *HUGE_KIND_NAMES[] = { "malloc", "thp", "hugetlb" };
+
+/*
+ * roundToHugePage - Round #size up to a whole number of huge pages
+ */
+static inline size_t roundToHugePage(size_t size)
+{
+    return (size + HUGE_PAGE_SIZE - 1) & ~( (size_t)HUGE_PAGE_SIZE - 1 );
+}
+
+/*
+ * adviseHugePages - Ask for transparent huge pages over #size bytes at #ptr, where supported
+ */
+static inline void adviseHugePages(void *ptr, size_t size)
+{
+    #if defined(MADV_HUGEPAGE)
+      madvise(ptr, size, MADV_HUGEPAGE);
+    #else
+      (void)ptr;
+      (void)size;
+    #endif
+}
+
+int HugeBuffer_Alloc(HugeBuffer *buffer, size_t size)
+{
+    void *ptr;
+
+    if ( size >= HUGE_ALLOC_MIN_SIZE )
+    {
+        size = roundToHugePage(size);
+
+        #if defined(MAP_HUGETLB)
+          /* Only succeeds if the administrator has reserved enough huge pages (vm.nr_hugepages) */
+          ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+          if ( ptr != MAP_FAILED )
+          {
+              buffer->ptr = ptr;
+              buffer->size = size;
+              buffer->kind = HUGE_KIND_HUGETLB;
+              return 0;
+          }
+        #endif
+
+        /* Only the pages touched are committed, so a generous size (e.x. from --expect-lines) costs nothing extra */
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if ( likely( ptr != MAP_FAILED ) )
+        {
+            adviseHugePages(ptr, size);
+
+            buffer->ptr = ptr;
+            buffer->size = size;
+            buffer->kind = HUGE_KIND_THP;
+            return 0;
+        }
+    }
+
+    ptr = malloc(size);
+    if ( unlikely( ptr == NULL ) )
+        return -1;
+
+    buffer->ptr = ptr;
+    buffer->size = size;
+    buffer->kind = HUGE_KIND_MALLOC;
+
+    return 0;
+}
+
+int HugeBuffer_Grow(HugeBuffer *buffer, size_t size)
+{
+    HugeBuffer newBuffer;
+    void *ptr;
+
+    if ( size <= buffer->size )
+        return 0;
+
+    if ( buffer->kind != HUGE_KIND_MALLOC )
+    {
+        /* Move the pages rather than copying them */
+        size = roundToHugePage(size);
+
+        ptr = mremap(buffer->ptr, buffer->size, size, MREMAP_MAYMOVE);
+        if ( likely( ptr != MAP_FAILED ) )
+        {
+            if ( buffer->kind == HUGE_KIND_THP )
+                adviseHugePages(ptr, size);
+
+            buffer->ptr = ptr;
+            buffer->size = size;
+            return 0;
+        }
+    }
+    else if ( size < HUGE_ALLOC_MIN_SIZE )
+    {
+        ptr = realloc(buffer->ptr, size);
+        if ( unlikely( ptr == NULL ) )
+            return -1;
+
+        buffer->ptr = ptr;
+        buffer->size = size;
+        return 0;
+    }
+
+    /* Outgrew malloc (or the mapping could not be remapped), switch to a new mapping */
+    if ( unlikely( HugeBuffer_Alloc(&newBuffer, size) < 0 ) )
+        return -1;
+
+    memcpy(newBuffer.ptr, buffer->ptr, buffer->size);
+    HugeBuffer_Free(buffer);
+
+    *buffer = newBuffer;
+
+    return 0;
+}
+
+void HugeBuffer_Free(HugeBuffer *buffer)
+{
+    if ( buffer->ptr == NULL )
+        return;
+
+    if ( buffer->kind == HUGE_KIND_MALLOC )
+        free(buffer->ptr);
+    else
+        munmap(buffer->ptr, buffer->size);
+
+    buffer->ptr = NULL;
+    buffer->size = 0;
+}
+
+const char *getHugeKindName(int kind)
+{
+    return HUGE_KIND_NAMES[kind];
+}
+
+void *hugeMalloc(size_t size, size_t alignment)
+{
+    void *ret;
+
+    if ( size >= HUGE_ALLOC_MIN_SIZE )
+        alignment = HUGE_PAGE_SIZE;
+
+    if ( alignment <= sizeof(void *) )
+        return malloc(size);
+
+    if ( unlikely( posix_memalign(&ret, alignment, size) != 0 ) )
+        return NULL;
+
+    /* Only whole huge pages within the allocation, the rest of the last page belongs to the heap */
+    if ( size >= HUGE_ALLOC_MIN_SIZE )
+        adviseHugePages(ret, size & ~( (size_t)HUGE_PAGE_SIZE - 1 ));
+
+    return ret;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * huge_alloc.h - Header for huge_alloc.c
+ *
+ */
+#ifndef __HUGE_ALLOC_H
+#define __HUGE_ALLOC_H
+
+#include <sys/types.h>
+
+/* Size of a (x86_64 / aarch64 default) huge page */
+#define HUGE_PAGE_SIZE ( 2 * 1024 * 1024 )
+
+/* Allocations smaller than this are left to malloc, as a huge page would be mostly unused */
+#define HUGE_ALLOC_MIN_SIZE ( HUGE_PAGE_SIZE * 2 )
+
+/*
+ * HUGE_KIND_* - How the memory of a HugeBuffer is backed
+ */
+#define HUGE_KIND_MALLOC    0   /* Plain malloc, for small buffers */
+#define HUGE_KIND_THP       1   /* Anonymous mapping advised for transparent huge pages */
+#define HUGE_KIND_HUGETLB   2   /* Mapping from the reserved huge page pool (MAP_HUGETLB) */
+
+/*
+ * HugeBuffer - A large, growable buffer, backed by huge pages where available.
+ *
+ *   Mapped buffers are only faulted in as they are touched, so over-sizing from a
+ *     size hint costs address space, not memory.
+ */
+typedef struct {
+    char *ptr;
+    size_t size;
+    int kind;           /* One of HUGE_KIND_* */
+
+} HugeBuffer;
+
+
+/**
+ * HugeBuffer_Alloc - Allocate #size bytes into #buffer.
+ *
+ *   Tries the reserved huge page pool, then a mapping advised for transparent huge pages
+ *     (not reserved up front, so only the pages touched are committed), then malloc.
+ *
+ *   Returns 0 on success, -1 on allocation failure.
+ */
+extern int HugeBuffer_Alloc(HugeBuffer *buffer, size_t size);
+
+/**
+ * HugeBuffer_Grow - Grow #buffer to at least #size bytes, keeping its contents (which may move)
+ *
+ *   Returns 0 on success, -1 on allocation failure (in which case #buffer is unchanged).
+ */
+extern int HugeBuffer_Grow(HugeBuffer *buffer, size_t size);
+
+/**
+ * HugeBuffer_Free - Free the memory of #buffer. Safe to call on a zeroed HugeBuffer.
+ */
+extern void HugeBuffer_Free(HugeBuffer *buffer);
+
+/**
+ * getHugeKindName - Get the name of a HUGE_KIND_* ("malloc", "thp", or "hugetlb")
+ */
+extern const char *getHugeKindName(int kind);
+
+/**
+ * hugeMalloc - Allocate #size bytes aligned to at least #alignment (a power of 2),
+ *   which may be released with free().
+ *
+ *   Allocations of HUGE_ALLOC_MIN_SIZE or more are aligned to HUGE_PAGE_SIZE,
+ *     and advised for transparent huge pages.
+ */
+extern void *hugeMalloc(size_t size, size_t alignment);
+
+#endif
@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * id_aggregate.c - Aggregate NameStats by uid or gid, and age
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "mtime_utils.h"
+
+#include "gather_mtimes.h"
+#include "id_aggregate.h"
+
+/* Initial number of hash slots. Must be a power of 2 */
+#define ID_AGGREGATE_INITIAL_SLOTS 256
+
+#define SECONDS_PER_DAY 86400
+
+/*
+ * hashKey - Mix #id and #ageRange into a slot hash
+ */
+static inline uint64_t hashKey(uint32_t id, int ageRange)
+{
+    uint64_t hash;
+
+    hash = ( ((uint64_t)id << 8) | (uint64_t)ageRange ) * 0x9E3779B97F4A7C15ULL;
+
+    return hash ^ (hash >> 29);
+}
+
+/*
+ * timespecCompare - Compare two timespecs, returning <0, 0, or >0
+ */
+static inline int timespecCompare(const struct timespec *ts1, const struct timespec *ts2)
+{
+    if ( ts1->tv_sec != ts2->tv_sec )
+        return ts1->tv_sec < ts2->tv_sec ? -1 : 1;
+
+    return (ts1->tv_nsec > ts2->tv_nsec) - (ts1->tv_nsec < ts2->tv_nsec);
+}
+
+int parseAgeBounds(const char *str, long *ageBounds)
+{
+    const char *cur;
+    char *endPtr;
+    int numBounds;
+
+    numBounds = 0;
+    cur = str;
+
+    for( ;; )
+    {
+        if ( numBounds == ID_AGGREGATE_MAX_AGE_BOUNDS )
+            return -1;
+
+        ageBounds[numBounds] = strtol(cur, &endPtr, 10);
+        if ( endPtr == cur || ageBounds[numBounds] <= 0 )
+            return -1;
+        if ( numBounds > 0 && ageBounds[numBounds] <= ageBounds[numBounds - 1] )
+            return -1;
+
+        numBounds += 1;
+
+        if ( *endPtr == '\0' )
+            return numBounds;
+        if ( *endPtr != ',' )
+            return -1;
+
+        cur = endPtr + 1;
+    }
+}
+
+IdAggregateTable *IdAggregateTable_New(int idField, const long *ageBounds, int numAgeBounds, time_t now)
+{
+    IdAggregateTable *ret;
+
+    ret = malloc( sizeof(IdAggregateTable) );
+
+    ret->numSlots = ID_AGGREGATE_INITIAL_SLOTS;
+    ret->slots = calloc( ret->numSlots, sizeof(size_t) );
+
+    ret->groupsCapacity = ID_AGGREGATE_INITIAL_SLOTS / 2;
+    ret->groups = malloc( sizeof(IdAggregate) * ret->groupsCapacity );
+    ret->numGroups = 0;
+
+    ret->idField = idField;
+    ret->now = now;
+    ret->numAgeBounds = numAgeBounds;
+    memcpy(ret->ageBounds, ageBounds, sizeof(long) * numAgeBounds);
+
+    return ret;
+}
+
+void IdAggregateTable_Free(IdAggregateTable *table)
+{
+    free(table->groups);
+    free(table->slots);
+    free(table);
+}
+
+/*
+ * IdAggregateTable_Grow - Double the number of slots, and rehash.
+ */
+static void IdAggregateTable_Grow(IdAggregateTable *table)
+{
+    size_t i, slot, mask;
+
+    free(table->slots);
+
+    table->numSlots *= 2;
+    table->slots = calloc( table->numSlots, sizeof(size_t) );
+
+    mask = table->numSlots - 1;
+
+    for( i=0; i < table->numGroups; i++ )
+    {
+        slot = hashKey(table->groups[i].id, table->groups[i].ageRange) & mask;
+        while ( table->slots[slot] != 0 )
+            slot = (slot + 1) & mask;
+
+        table->slots[slot] = i + 1;
+    }
+
+    table->groupsCapacity = table->numSlots / 2;
+    table->groups = realloc(table->groups, sizeof(IdAggregate) * table->groupsCapacity);
+}
+
+/*
+ * IdAggregateTable_GetGroup - Get the group for #id, #ageRange, adding an empty one if new
+ */
+static IdAggregate *IdAggregateTable_GetGroup(IdAggregateTable *table, uint32_t id, int ageRange)
+{
+    IdAggregate *group;
+    size_t slot, mask;
+
+    mask = table->numSlots - 1;
+    slot = hashKey(id, ageRange) & mask;
+
+    while ( table->slots[slot] != 0 )
+    {
+        group = &table->groups[ table->slots[slot] - 1 ];
+        if ( group->id == id && group->ageRange == ageRange )
+            return group;
+
+        slot = (slot + 1) & mask;
+    }
+
+    /* Keep load factor at or below 1/2 */
+    if ( unlikely( table->numGroups + 1 == table->groupsCapacity ) )
+    {
+        IdAggregateTable_Grow(table);
+        return IdAggregateTable_GetGroup(table, id, ageRange);
+    }
+
+    group = &table->groups[table->numGroups];
+    memset(group, 0x0, sizeof(IdAggregate));
+
+    group->id = id;
+    group->ageRange = ageRange;
+
+    table->numGroups += 1;
+    table->slots[slot] = table->numGroups;
+
+    return group;
+}
+
+/*
+ * getAgeRange - Get the index of the range of ages #fileTime falls in
+ */
+static inline int getAgeRange(const IdAggregateTable *table, time_t fileTime)
+{
+    long ageDays;
+    int ageRange;
+
+    if ( table->numAgeBounds == 0 )
+        return 0;
+
+    ageDays = (long)( (table->now - fileTime) / SECONDS_PER_DAY );
+
+    for( ageRange=0; ageRange < table->numAgeBounds; ageRange++ )
+    {
+        if ( ageDays < table->ageBounds[ageRange] )
+            break;
+    }
+
+    return ageRange;
+}
+
+/*
+ * IdAggregate_AddTotals - Add #count files of #totalSize, with times #minTime through #maxTime, to #group
+ */
+static inline void IdAggregate_AddTotals(IdAggregate *group, size_t count, off_t totalSize, const struct timespec *minTime, const struct timespec *maxTime)
+{
+    if ( group->count == 0 || timespecCompare(minTime, &group->minTime) < 0 )
+        group->minTime = *minTime;
+    if ( group->count == 0 || timespecCompare(maxTime, &group->maxTime) > 0 )
+        group->maxTime = *maxTime;
+
+    group->count += count;
+    group->totalSize += totalSize;
+}
+
+void IdAggregateTable_Add(IdAggregateTable *table, const NameStat *nameStat)
+{
+    IdAggregate *group;
+    uint32_t id;
+
+    id = table->idField == ID_FIELD_GID ? nameStat->statBuf.st_gid : nameStat->statBuf.st_uid;
+
+    group = IdAggregateTable_GetGroup(table, id, getAgeRange(table, nameStat->fileTime.tv_sec));
+
+    IdAggregate_AddTotals(group, 1, nameStat->statBuf.st_size, &nameStat->fileTime, &nameStat->fileTime);
+}
+
+void IdAggregateTable_Merge(IdAggregateTable *into, const IdAggregateTable *from)
+{
+    const IdAggregate *fromGroup;
+    size_t i;
+
+    for( i=0; i < from->numGroups; i++ )
+    {
+        fromGroup = &from->groups[i];
+
+        IdAggregate_AddTotals( IdAggregateTable_GetGroup(into, fromGroup->id, fromGroup->ageRange),
+            fromGroup->count, fromGroup->totalSize, &fromGroup->minTime, &fromGroup->maxTime );
+    }
+}
+
+/*
+ * compareIdAggregates - qsort comparator ordering by id, then age range
+ */
+static int compareIdAggregates(const void *_group1, const void *_group2)
+{
+    const IdAggregate *group1 = (const IdAggregate *)_group1;
+    const IdAggregate *group2 = (const IdAggregate *)_group2;
+
+    if ( group1->id != group2->id )
+        return group1->id < group2->id ? -1 : 1;
+
+    return group1->ageRange - group2->ageRange;
+}
+
+void IdAggregateTable_Sort(IdAggregateTable *table)
+{
+    qsort(table->groups, table->numGroups, sizeof(IdAggregate), compareIdAggregates);
+
+    /* Slots now point at the wrong groups */
+    free(table->slots);
+    table->slots = NULL;
+}
+
+/*
+ * AggregateState - Passed to reduceById by reduceNameStats
+ */
+typedef struct {
+    IdAggregateTable **tables;  /* One per worker */
+    int dedupInodes;
+
+} AggregateState;
+
+/*
+ * reduceById - Add #nameStat, if valid, to the table of worker #workerIdx
+ */
+static void reduceById(int workerIdx, const NameStat *nameStat, void *_state)
+{
+    AggregateState *state = (AggregateState *)_state;
+
+    if ( unlikely( !NAMESTAT_IS_VALID(nameStat) ) )
+        return;
+
+    /* Each file is counted once, under its first name */
+    if ( state->dedupInodes == DEDUP_INODES_NAMES && NAMESTAT_IS_REPEATED_INODE(nameStat) )
+        return;
+
+    IdAggregateTable_Add(state->tables[workerIdx], nameStat);
+}
+
+IdAggregateTable *aggregateNameStatsById(ReadNameStatBuffers *buffers, FILE *stream, int idField, const long *ageBounds, int numAgeBounds)
+{
+    AggregateState state;
+    IdAggregateTable *ret;
+    int numTables, i;
+    time_t now;
+
+    numTables = getGatherNumThreads(buffers);
+    now = time(NULL);
+
+    state.dedupInodes = buffers->options.dedupInodes;
+    state.tables = malloc( sizeof(IdAggregateTable *) * numTables );
+    for( i=0; i < numTables; i++ )
+        state.tables[i] = IdAggregateTable_New(idField, ageBounds, numAgeBounds, now);
+
+    reduceNameStats(buffers, stream, reduceById, &state);
+
+    ret = state.tables[0];
+    for( i=1; i < numTables; i++ )
+    {
+        IdAggregateTable_Merge(ret, state.tables[i]);
+        IdAggregateTable_Free(state.tables[i]);
+    }
+
+    free(state.tables);
+
+    IdAggregateTable_Sort(ret);
+
+    return ret;
+}
+
+void printAgeRange(const IdAggregateTable *table, int ageRange, FILE *stream)
+{
+    long start;
+
+    start = ageRange == 0 ? 0 : table->ageBounds[ageRange - 1];
+
+    if ( ageRange == table->numAgeBounds )
+        fprintf(stream, "%ld+", start);
+    else
+        fprintf(stream, "%ld-%ld", start, table->ageBounds[ageRange]);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * id_aggregate.h - Header for id_aggregate.c
+ *
+ */
+#ifndef __ID_AGGREGATE_H
+#define __ID_AGGREGATE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "gather_mtimes.h"
+
+/*
+ * ID_FIELD_* - Which id of each file an IdAggregateTable groups by
+ */
+#define ID_FIELD_UID 0
+#define ID_FIELD_GID 1
+
+/* Most age boundaries which may be given, so at most one more age range */
+#define ID_AGGREGATE_MAX_AGE_BOUNDS 32
+
+/*
+ * IdAggregate - Totals for all files with a single uid or gid, within a single age range
+ */
+typedef struct {
+    uint32_t id;
+    int ageRange;           /* Index of the range, 0 is the newest */
+
+    size_t count;
+    off_t totalSize;
+
+    struct timespec minTime;
+    struct timespec maxTime;
+
+} IdAggregate;
+
+/*
+ * IdAggregateTable - Hash aggregation of NameStats by (id, age range).
+ *
+ *   Age ranges are split at #ageBounds days old, so n bounds give n + 1 ranges.
+ */
+typedef struct {
+    IdAggregate *groups;
+    size_t numGroups;
+    size_t groupsCapacity;
+
+    size_t *slots;          /* Open-addressed hash table of (group index + 1), 0 is empty */
+    size_t numSlots;        /* Always a power of 2 */
+
+    int idField;            /* One of ID_FIELD_* */
+    time_t now;             /* Ages are relative to this */
+    int numAgeBounds;
+    long ageBounds[ID_AGGREGATE_MAX_AGE_BOUNDS];   /* In days, ascending */
+
+} IdAggregateTable;
+
+
+/**
+ * parseAgeBounds - Parse a comma-separated, ascending list of ages in days (e.x. "30,90,365")
+ *   into #ageBounds, which holds ID_AGGREGATE_MAX_AGE_BOUNDS.
+ *
+ *   Returns the number of bounds, or -1 if #str is invalid.
+ */
+extern int parseAgeBounds(const char *str, long *ageBounds);
+
+/**
+ * IdAggregateTable_New - Create a new table, grouping by #idField and, if #numAgeBounds > 0,
+ *   by the range of age (relative to #now) split at #ageBounds.
+ */
+extern IdAggregateTable *IdAggregateTable_New(int idField, const long *ageBounds, int numAgeBounds, time_t now);
+
+/**
+ * IdAggregateTable_Free - Free a table created by IdAggregateTable_New
+ */
+extern void IdAggregateTable_Free(IdAggregateTable *table);
+
+/**
+ * IdAggregateTable_Add - Add a (valid) NameStat to the group for its id and age range.
+ *
+ *   Requires statBuf.st_size and the id (NEED_FIELD_UID or NEED_FIELD_GID) to have been gathered.
+ */
+extern void IdAggregateTable_Add(IdAggregateTable *table, const NameStat *nameStat);
+
+/**
+ * IdAggregateTable_Merge - Add all the groups of #from into #into, which were created with the same arguments
+ */
+extern void IdAggregateTable_Merge(IdAggregateTable *into, const IdAggregateTable *from);
+
+/**
+ * IdAggregateTable_Sort - Sort groups by id, then age range. Nothing may be added after.
+ */
+extern void IdAggregateTable_Sort(IdAggregateTable *table);
+
+/**
+ * aggregateNameStatsById - Aggregate everything on #stream by id (and age range) into a new,
+ *   sorted table, without holding on to any entry.
+ *
+ *   Each worker gathering #buffers aggregates into its own table, and these are merged at the end.
+ */
+extern IdAggregateTable *aggregateNameStatsById(ReadNameStatBuffers *buffers, FILE *stream, int idField, const long *ageBounds, int numAgeBounds);
+
+/**
+ * printAgeRange - Print the days old covered by #ageRange of #table, e.x. "30-90" or "365+"
+ */
+extern void printAgeRange(const IdAggregateTable *table, int ageRange, FILE *stream);
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * inode_set.c - Hash set of (device, inode) pairs, for finding hard links
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+
+#include "mtime_utils.h"
+
+#include "inode_set.h"
+
+/* Fewest slots. Must be a power of 2 */
+#define INODE_SET_MIN_SLOTS 1024
+
+/*
+ * hashInode - Mix #dev and #ino into a slot hash
+ */
+static inline uint64_t hashInode(dev_t dev, ino_t ino)
+{
+    uint64_t hash;
+
+    hash = (uint64_t)ino * 0x9E3779B97F4A7C15ULL;
+    hash ^= (uint64_t)dev + 0x7F4A7C159E3779B9ULL + (hash << 6) + (hash >> 2);
+
+    return hash ^ (hash >> 31);
+}
+
+/*
+ * InodeSet_FindSlot - Find the slot holding #dev, #ino or the empty slot where it belongs
+ */
+static inline size_t InodeSet_FindSlot(const InodeSet *set, dev_t dev, ino_t ino)
+{
+    const InodeKey *key;
+    size_t slot, mask;
+
+    mask = set->numSlots - 1;
+    slot = hashInode(dev, ino) & mask;
+
+    for( ;; )
+    {
+        key = &set->slots[slot];
+        if ( key->ino == ino && key->dev == dev )
+            return slot;
+        if ( key->ino == 0 && key->dev == 0 )
+            return slot;
+
+        slot = (slot + 1) & mask;
+    }
+}
+
+InodeSet *InodeSet_New(void)
+{
+    InodeSet *ret;
+
+    ret = malloc( sizeof(InodeSet) );
+
+    ret->numSlots = INODE_SET_MIN_SLOTS;
+    ret->slots = calloc( ret->numSlots, sizeof(InodeKey) );
+    ret->numEntries = 0;
+
+    return ret;
+}
+
+void InodeSet_Free(InodeSet *set)
+{
+    free(set->slots);
+    free(set);
+}
+
+/*
+ * InodeSet_Grow - Double the number of slots, and rehash
+ */
+static void InodeSet_Grow(InodeSet *set)
+{
+    InodeKey *oldSlots;
+    size_t oldNumSlots, i;
+
+    oldSlots = set->slots;
+    oldNumSlots = set->numSlots;
+
+    set->numSlots *= 2;
+    set->slots = calloc( set->numSlots, sizeof(InodeKey) );
+
+    for( i=0; i < oldNumSlots; i++ )
+    {
+        if ( oldSlots[i].ino != 0 || oldSlots[i].dev != 0 )
+            set->slots[ InodeSet_FindSlot(set, oldSlots[i].dev, oldSlots[i].ino) ] = oldSlots[i];
+    }
+
+    free(oldSlots);
+}
+
+int InodeSet_Add(InodeSet *set, dev_t dev, ino_t ino)
+{
+    InodeKey *key;
+
+    /* The empty key, which no real file has */
+    if ( unlikely( dev == 0 && ino == 0 ) )
+        return 1;
+
+    key = &set->slots[ InodeSet_FindSlot(set, dev, ino) ];
+    if ( key->ino != 0 || key->dev != 0 )
+        return 0;
+
+    key->dev = dev;
+    key->ino = ino;
+
+    /* Keep load factor at or below 1/2 */
+    set->numEntries += 1;
+    if ( unlikely( set->numEntries * 2 > set->numSlots ) )
+        InodeSet_Grow(set);
+
+    return 1;
+}
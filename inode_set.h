@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * inode_set.h - Header for inode_set.c
+ *
+ */
+#ifndef __INODE_SET_H
+#define __INODE_SET_H
+
+#include <sys/types.h>
+
+/*
+ * InodeKey - Identity of a file, shared by all of its hard links
+ */
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+
+} InodeKey;
+
+/*
+ * InodeSet - Open-addressed hash set of (device, inode) pairs
+ *
+ *   Only files with more than one link ever need to be added, so the set stays
+ *     small even over very large trees.
+ */
+typedef struct {
+    InodeKey *slots;        /* An all-zero key is an empty slot */
+    size_t numSlots;        /* Always a power of 2 */
+    size_t numEntries;
+
+} InodeSet;
+
+
+/**
+ * InodeSet_New - Create a new, empty set
+ */
+extern InodeSet *InodeSet_New(void);
+
+/**
+ * InodeSet_Free - Free a set created by InodeSet_New
+ */
+extern void InodeSet_Free(InodeSet *set);
+
+/**
+ * InodeSet_Add - Add the inode #ino of device #dev to #set
+ *
+ *   Returns 1 if it was added, or 0 if it was already in the set.
+ */
+extern int InodeSet_Add(InodeSet *set, dev_t dev, ino_t ino);
+
+#endif
@@ -1,5 +1,9 @@
 
 #include <stdio.h>
+#include <time.h>
+
+#include <sys/time.h>
+#include <sys/resource.h>
 
 #include "mtime_utils.h"
 
@@ -10,3 +14,27 @@ extern void printVersion(const volatile char *appName)
 {
     fprintf(stderr, "%s %s by Timothy Savannah\n", appName, MTIME_UTILS_VERSION);
 }
+
+extern double getMonotonicSeconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec / 1000000000.0;
+}
+
+extern void getPageFaults(long *minorFaults, long *majorFaults)
+{
+    struct rusage usage;
+
+    if ( getrusage(RUSAGE_SELF, &usage) != 0 )
+    {
+        *minorFaults = 0;
+        *majorFaults = 0;
+        return;
+    }
+
+    *minorFaults = usage.ru_minflt;
+    *majorFaults = usage.ru_majflt;
+}
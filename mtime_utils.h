@@ -33,4 +33,15 @@ extern const volatile char *MTIME_UTILS_COPYRIGHT;
  */
 extern void printVersion(const volatile char *appName);
 
+/**
+ * getMonotonicSeconds - Get the current time of a monotonic clock, in seconds
+ *   ( For measuring intervals )
+ */
+extern double getMonotonicSeconds(void);
+
+/**
+ * getPageFaults - Get the number of minor (no I/O) and major (I/O) page faults taken by this process
+ */
+extern void getPageFaults(long *minorFaults, long *majorFaults);
+
 #endif
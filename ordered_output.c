@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * ordered_output.c - Format output on several threads, and write it in order
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+
+#include "mtime_utils.h"
+
+#include "ring_buffer.h"
+#include "ordered_output.h"
+
+/* Initial capacity of a non-empty OutBuffer */
+#define OUT_BUFFER_MIN_CAPACITY 4096
+
+void OutBuffer_Init(OutBuffer *out)
+{
+    out->data = NULL;
+    out->len = 0;
+    out->capacity = 0;
+}
+
+void OutBuffer_Free(OutBuffer *out)
+{
+    free(out->data);
+    OutBuffer_Init(out);
+}
+
+char *OutBuffer_Reserve(OutBuffer *out, size_t size)
+{
+    size_t newCapacity;
+
+    if ( unlikely( out->len + size > out->capacity ) )
+    {
+        newCapacity = out->capacity ? out->capacity : OUT_BUFFER_MIN_CAPACITY;
+        while ( newCapacity < out->len + size )
+            newCapacity *= 2;
+
+        out->data = realloc(out->data, newCapacity);
+        if ( unlikely( out->data == NULL ) )
+        {
+            /* Nothing sensible can be written past this point, exit as the tools do (ERROR_ALLOC_MEMORY) */
+            fputs("Err: Failed to allocate memory for output.\n", stderr);
+            exit(12);
+        }
+        out->capacity = newCapacity;
+    }
+
+    return out->data + out->len;
+}
+
+void OutBuffer_Printf(OutBuffer *out, const char *format, ...)
+{
+    va_list args;
+    size_t room;
+    int len;
+
+    room = out->capacity - out->len;
+
+    va_start(args, format);
+    len = vsnprintf(out->data + out->len, room, format, args);
+    va_end(args);
+
+    if ( unlikely( len < 0 ) )
+        return;
+
+    if ( (size_t)len >= room )
+    {
+        /* Did not fit (with the terminating null), make room and format again */
+        OutBuffer_Reserve(out, len + 1);
+
+        va_start(args, format);
+        vsnprintf(out->data + out->len, len + 1, format, args);
+        va_end(args);
+    }
+
+    out->len += len;
+}
+
+/*
+ * OutputChunk - A slot holding one formatted chunk, reused every #numSlots chunks
+ */
+typedef struct {
+    OutBuffer out;
+    size_t doneSeq;     /* (Chunk number + 1) of the last chunk formatted into #out */
+
+} OutputChunk;
+
+/*
+ * OrderedOutput - State shared by the threads of writeFormattedInOrder
+ */
+typedef struct {
+    OutputChunk *slots;
+    size_t numSlots;
+
+    size_t numItems;
+    size_t numChunks;
+    size_t nextChunk;   /* Next chunk to be claimed for formatting */
+    size_t numWritten;  /* Chunks written so far, chunks claimed are always below this + numSlots */
+
+    FormatItemFunc formatFunc;
+    void *arg;
+
+} OrderedOutput;
+
+/*
+ * claimChunk - Claim the next chunk to format, which must not be more than numSlots
+ *   ahead of the writer (so its slot is free).
+ *
+ *   Returns 1 and sets #chunk if claimed, or 0 if there is nothing to claim right now.
+ */
+static int claimChunk(OrderedOutput *output, size_t *chunk)
+{
+    size_t next;
+
+    next = __atomic_load_n(&output->nextChunk, __ATOMIC_RELAXED);
+
+    for( ;; )
+    {
+        if ( next >= output->numChunks || next >= __atomic_load_n(&output->numWritten, __ATOMIC_ACQUIRE) + output->numSlots )
+            return 0;
+
+        if ( __atomic_compare_exchange_n(&output->nextChunk, &next, next + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+            break;
+    }
+
+    *chunk = next;
+    return 1;
+}
+
+/*
+ * formatChunk - Format all items of #chunk into its slot
+ */
+static void formatChunk(OrderedOutput *output, size_t chunk)
+{
+    OutputChunk *slot;
+    size_t i, end;
+
+    slot = &output->slots[chunk % output->numSlots];
+    slot->out.len = 0;
+
+    end = (chunk + 1) * OUTPUT_CHUNK_ITEMS;
+    if ( end > output->numItems )
+        end = output->numItems;
+
+    for( i=chunk * OUTPUT_CHUNK_ITEMS; i < end; i++ )
+        output->formatFunc(i, &slot->out, output->arg);
+
+    __atomic_store_n(&slot->doneSeq, chunk + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * outputWorkerMain - Formats chunks until all have been claimed
+ */
+static void *outputWorkerMain(void *_output)
+{
+    OrderedOutput *output = (OrderedOutput *)_output;
+    size_t chunk;
+    unsigned int numAttempts = 0;
+
+    while ( __atomic_load_n(&output->nextChunk, __ATOMIC_RELAXED) < output->numChunks )
+    {
+        if ( claimChunk(output, &chunk) )
+        {
+            formatChunk(output, chunk);
+            numAttempts = 0;
+        }
+        else
+        {
+            /* Too far ahead of the writer */
+            ringBackoff(numAttempts++);
+        }
+    }
+
+    return NULL;
+}
+
+void writeFormattedInOrder(FILE *stream, size_t numItems, int numThreads, FormatItemFunc formatFunc, void *arg)
+{
+    OrderedOutput output;
+    OutputChunk *slot;
+    pthread_t *threads;
+    size_t chunk, i;
+    int numStarted;
+    unsigned int numAttempts;
+
+    memset(&output, 0x0, sizeof(OrderedOutput));
+
+    output.numItems = numItems;
+    output.numChunks = (numItems + OUTPUT_CHUNK_ITEMS - 1) / OUTPUT_CHUNK_ITEMS;
+    output.formatFunc = formatFunc;
+    output.arg = arg;
+
+    if ( numThreads < 1 )
+        numThreads = 1;
+    if ( (size_t)numThreads > output.numChunks )
+        numThreads = output.numChunks ? (int)output.numChunks : 1;
+
+    output.numSlots = (size_t)numThreads * OUTPUT_CHUNKS_PER_THREAD;
+    output.slots = calloc( output.numSlots, sizeof(OutputChunk) );
+    threads = malloc( sizeof(pthread_t) * numThreads );
+    if ( unlikely( output.slots == NULL || threads == NULL ) )
+    {
+        fputs("Err: Failed to allocate memory for output.\n", stderr);
+        free(output.slots);
+        free(threads);
+        return;
+    }
+
+    /* The calling thread is the first, and the writer */
+    for( numStarted=0; numStarted < numThreads - 1; numStarted++ )
+    {
+        if ( unlikely( pthread_create(&threads[numStarted], NULL, outputWorkerMain, &output) != 0 ) )
+            break;
+    }
+
+    numAttempts = 0;
+
+    while ( output.numWritten < output.numChunks )
+    {
+        slot = &output.slots[output.numWritten % output.numSlots];
+
+        if ( __atomic_load_n(&slot->doneSeq, __ATOMIC_ACQUIRE) == output.numWritten + 1 )
+        {
+            fwrite(slot->out.data, 1, slot->out.len, stream);
+            __atomic_store_n(&output.numWritten, output.numWritten + 1, __ATOMIC_RELEASE);
+            numAttempts = 0;
+        }
+        else if ( claimChunk(&output, &chunk) )
+        {
+            /* Help out rather than wait */
+            formatChunk(&output, chunk);
+            numAttempts = 0;
+        }
+        else
+        {
+            ringBackoff(numAttempts++);
+        }
+    }
+
+    for( i=0; i < (size_t)numStarted; i++ )
+        pthread_join(threads[i], NULL);
+
+    for( i=0; i < output.numSlots; i++ )
+        OutBuffer_Free(&output.slots[i].out);
+
+    free(output.slots);
+    free(threads);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * ordered_output.h - Header for ordered_output.c
+ *
+ */
+#ifndef __ORDERED_OUTPUT_H
+#define __ORDERED_OUTPUT_H
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+/* Items formatted together, and written with a single fwrite, by writeFormattedInOrder */
+#define OUTPUT_CHUNK_ITEMS 4096
+
+/* Chunks formatted ahead of the one being written, per thread */
+#define OUTPUT_CHUNKS_PER_THREAD 4
+
+/*
+ * OutBuffer - Growable buffer of formatted output
+ */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+
+} OutBuffer;
+
+/*
+ * FormatItemFunc - Called by writeFormattedInOrder to append item #idx to #out
+ *
+ *   Called from several threads at once, so must not share any state it changes.
+ */
+typedef void (*FormatItemFunc)(size_t idx, OutBuffer *out, void *arg);
+
+
+/**
+ * OutBuffer_Init - Initialize an empty #out
+ */
+extern void OutBuffer_Init(OutBuffer *out);
+
+/**
+ * OutBuffer_Free - Free the data of #out, leaving it empty
+ */
+extern void OutBuffer_Free(OutBuffer *out);
+
+/**
+ * OutBuffer_Reserve - Make room for at least #size more bytes after out->len
+ *
+ *   Returns a pointer to the room, which the caller fills then adds to out->len
+ */
+extern char *OutBuffer_Reserve(OutBuffer *out, size_t size);
+
+/**
+ * OutBuffer_Append - Append the #len bytes at #data to #out
+ */
+static inline void OutBuffer_Append(OutBuffer *out, const char *data, size_t len)
+{
+    memcpy(OutBuffer_Reserve(out, len), data, len);
+    out->len += len;
+}
+
+/**
+ * OutBuffer_Printf - Append printf-style formatted output to #out
+ */
+extern void OutBuffer_Printf(OutBuffer *out, const char *format, ...) __attribute__ (( format (printf, 2, 3) ));
+
+/**
+ * writeFormattedInOrder - Format items 0 through #numItems - 1 with #formatFunc, and write
+ *   them to #stream in order.
+ *
+ *   Items are formatted in chunks of OUTPUT_CHUNK_ITEMS, each into its own buffer, on up to
+ *     #numThreads threads (including the calling thread, which also writes each chunk as soon
+ *     as those before it are out). Output is byte-identical for any #numThreads.
+ */
+extern void writeFormattedInOrder(FILE *stream, size_t numItems, int numThreads, FormatItemFunc formatFunc, void *arg);
+
+#endif
@@ -111,8 +111,18 @@ const char *OwnerInfoList_GetName(OwnerInfoList *ownerInfoList, uid_t pw_uid)
     struct passwd *pw;
 
     pw = getpwuid(pw_uid);
+    if ( unlikely( pw == NULL ) )
+    {
+        /* No name for this id, so use the number itself (like ls does) */
+        char idStr[24];
 
-    cur = OwnerInfoList_AddNode(ownerInfoList, pw_uid, pw->pw_name);
+        snprintf(idStr, sizeof(idStr), "%u", (unsigned int)pw_uid);
+        cur = OwnerInfoList_AddNode(ownerInfoList, pw_uid, idStr);
+    }
+    else
+    {
+        cur = OwnerInfoList_AddNode(ownerInfoList, pw_uid, pw->pw_name);
+    }
 
     return cur->pw_name;
 }
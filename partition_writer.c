@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * partition_writer.c - Write output into one file per day, month or year, in a single pass
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "mtime_utils.h"
+
+#include "partition_writer.h"
+
+/* Hash slots for files, which is plenty for a century of days */
+#define PARTITION_NUM_SLOTS 4096
+
+/* Longest name of a file within the output directory, "YYYY-MM-DD" and the suffix */
+#define PARTITION_MAX_NAME 64
+
+void initPartitionOptions(PartitionOptions *options)
+{
+    options->partitionBy = -1;
+    options->outputDir = NULL;
+    options->maxOpen = PARTITION_DEFAULT_MAX_OPEN;
+}
+
+int handlePartitionArg(PartitionOptions *options, const char *arg)
+{
+    long maxOpen;
+    char *endPtr;
+
+    if ( strstr(arg, "--partition-by=") == arg )
+    {
+        if ( strcmp("day", arg + 15) == 0 )
+            options->partitionBy = PARTITION_BY_DAY;
+        else if ( strcmp("month", arg + 15) == 0 )
+            options->partitionBy = PARTITION_BY_MONTH;
+        else if ( strcmp("year", arg + 15) == 0 )
+            options->partitionBy = PARTITION_BY_YEAR;
+        else
+        {
+            fprintf(stderr, "Unknown partition: %s\n", arg + 15);
+            return -1;
+        }
+
+        return 1;
+    }
+    else if ( strstr(arg, "--output-dir=") == arg && arg[13] != '\0' )
+    {
+        options->outputDir = arg + 13;
+        return 1;
+    }
+    else if ( strstr(arg, "--max-open-files=") == arg )
+    {
+        maxOpen = strtol(arg + 17, &endPtr, 10);
+        if ( *endPtr != '\0' || endPtr == arg + 17 || maxOpen < 1 || maxOpen > 65536 )
+        {
+            fprintf(stderr, "Invalid number of open files: %s\n", arg + 17);
+            return -1;
+        }
+
+        options->maxOpen = (int)maxOpen;
+        return 1;
+    }
+
+    return 0;
+}
+
+int checkPartitionOptions(const PartitionOptions *options)
+{
+    if ( (options->partitionBy >= 0) != (options->outputDir != NULL) )
+    {
+        fputs("--partition-by and --output-dir must be given together\n", stderr);
+        return 0;
+    }
+
+    return 1;
+}
+
+void printPartitionUsage(void)
+{
+    fputs("      --partition-by=X  Instead of stdout, write each file's output into a file per\n", stderr);
+    fputs("                          period of its time (in local time) within --output-dir:\n", stderr);
+    fputs("                          day   - YYYY-MM-DD\n", stderr);
+    fputs("                          month - YYYY-MM\n", stderr);
+    fputs("                          year  - YYYY\n", stderr);
+    fputs("                          Files are named with .txt, or .records with --output=records,\n", stderr);
+    fputs("                          and are replaced if they already exist.\n\n", stderr);
+    fputs("      --output-dir=DIR  Directory to write --partition-by files in, created if needed.\n\n", stderr);
+    fputs("      --max-open-files=N  Most partition files held open at once (default 64). The least\n", stderr);
+    fputs("                            recently written is closed to open another.\n\n", stderr);
+}
+
+PartitionWriter *PartitionWriter_New(const PartitionOptions *options, const char *suffix, PartitionHeaderFunc headerFunc, void *headerArg)
+{
+    PartitionWriter *ret;
+
+    if ( mkdir(options->outputDir, 0777) != 0 && errno != EEXIST )
+    {
+        fprintf(stderr, "Err: Cannot create output directory %s: %s\n", options->outputDir, strerror(errno));
+        return NULL;
+    }
+
+    ret = calloc( 1, sizeof(PartitionWriter) );
+
+    ret->outputDir = options->outputDir;
+    ret->suffix = suffix;
+    ret->partitionBy = options->partitionBy;
+    ret->maxOpen = options->maxOpen;
+    ret->headerFunc = headerFunc;
+    ret->headerArg = headerArg;
+
+    ret->numSlots = PARTITION_NUM_SLOTS;
+    ret->slots = calloc( ret->numSlots, sizeof(PartitionFile *) );
+
+    return ret;
+}
+
+/*
+ * getPeriod - Get the key of the period #fileTime falls in, and the range of times [*start, *end) it spans
+ */
+static int getPeriod(int partitionBy, time_t fileTime, time_t *start, time_t *end)
+{
+    struct tm tm;
+    int key;
+
+    localtime_r(&fileTime, &tm);
+
+    tm.tm_sec = 0;
+    tm.tm_min = 0;
+    tm.tm_hour = 0;
+    tm.tm_isdst = -1;
+
+    switch ( partitionBy )
+    {
+        case PARTITION_BY_DAY:
+            key = (tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+            *start = mktime(&tm);
+            tm.tm_mday += 1;
+            break;
+
+        case PARTITION_BY_MONTH:
+            key = (tm.tm_year + 1900) * 100 + (tm.tm_mon + 1);
+            tm.tm_mday = 1;
+            *start = mktime(&tm);
+            tm.tm_mon += 1;
+            break;
+
+        default:
+            key = tm.tm_year + 1900;
+            tm.tm_mday = 1;
+            tm.tm_mon = 0;
+            *start = mktime(&tm);
+            tm.tm_year += 1;
+            break;
+    }
+
+    tm.tm_isdst = -1;
+    *end = mktime(&tm);
+
+    return key;
+}
+
+/*
+ * PartitionWriter_GetFile - Get (adding if new) the file of the period with #key
+ */
+static PartitionFile *PartitionWriter_GetFile(PartitionWriter *writer, int key)
+{
+    PartitionFile *file;
+    size_t slot;
+    char name[PARTITION_MAX_NAME];
+
+    slot = (size_t)key & (writer->numSlots - 1);
+
+    for( file=writer->slots[slot]; file != NULL; file=file->hashNext )
+    {
+        if ( file->key == key )
+            return file;
+    }
+
+    switch ( writer->partitionBy )
+    {
+        case PARTITION_BY_DAY:
+            snprintf(name, sizeof(name), "%04d-%02d-%02d%s", key / 10000, (key / 100) % 100, key % 100, writer->suffix);
+            break;
+        case PARTITION_BY_MONTH:
+            snprintf(name, sizeof(name), "%04d-%02d%s", key / 100, key % 100, writer->suffix);
+            break;
+        default:
+            snprintf(name, sizeof(name), "%04d%s", key, writer->suffix);
+            break;
+    }
+
+    file = calloc( 1, sizeof(PartitionFile) );
+    file->key = key;
+    file->path = malloc( strlen(writer->outputDir) + strlen(name) + 2 );
+    sprintf(file->path, "%s/%s", writer->outputDir, name);
+
+    file->hashNext = writer->slots[slot];
+    writer->slots[slot] = file;
+    writer->numFiles += 1;
+
+    return file;
+}
+
+/*
+ * PartitionWriter_Unlink - Remove the open #file from the LRU list
+ */
+static inline void PartitionWriter_Unlink(PartitionWriter *writer, PartitionFile *file)
+{
+    if ( file->lruPrev != NULL )
+        file->lruPrev->lruNext = file->lruNext;
+    else
+        writer->lruHead = file->lruNext;
+
+    if ( file->lruNext != NULL )
+        file->lruNext->lruPrev = file->lruPrev;
+    else
+        writer->lruTail = file->lruPrev;
+
+    file->lruPrev = NULL;
+    file->lruNext = NULL;
+}
+
+/*
+ * PartitionWriter_PushFront - Put the open #file at the front (most recent end) of the LRU list
+ */
+static inline void PartitionWriter_PushFront(PartitionWriter *writer, PartitionFile *file)
+{
+    file->lruPrev = NULL;
+    file->lruNext = writer->lruHead;
+
+    if ( writer->lruHead != NULL )
+        writer->lruHead->lruPrev = file;
+    else
+        writer->lruTail = file;
+
+    writer->lruHead = file;
+}
+
+/*
+ * PartitionWriter_Close - Flush and close the open #file
+ */
+static void PartitionWriter_Close(PartitionWriter *writer, PartitionFile *file)
+{
+    PartitionWriter_Unlink(writer, file);
+
+    if ( unlikely( fclose(file->file) != 0 ) && !writer->hasError )
+    {
+        fprintf(stderr, "Err: Cannot write %s: %s\n", file->path, strerror(errno));
+        writer->hasError = 1;
+    }
+
+    file->file = NULL;
+    free(file->buf);
+    file->buf = NULL;
+
+    writer->numOpen -= 1;
+}
+
+/*
+ * PartitionWriter_Open - Open #file, closing the least recently written file if too many are open.
+ *
+ *   The first open creates (or truncates) the file, and writes its header. Later opens append.
+ *
+ *   Returns 0 on success, or -1 if it cannot be opened.
+ */
+static int PartitionWriter_Open(PartitionWriter *writer, PartitionFile *file)
+{
+    if ( writer->numOpen >= writer->maxOpen )
+        PartitionWriter_Close(writer, writer->lruTail);
+
+    for( ;; )
+    {
+        file->file = fopen(file->path, file->isCreated ? "a" : "w");
+        if ( likely( file->file != NULL ) )
+            break;
+
+        /* Out of descriptors (e.x. a low ulimit), make room from our own */
+        if ( (errno == EMFILE || errno == ENFILE) && writer->numOpen > 0 )
+        {
+            PartitionWriter_Close(writer, writer->lruTail);
+            continue;
+        }
+
+        if ( !writer->hasError )
+            fprintf(stderr, "Err: Cannot open %s: %s\n", file->path, strerror(errno));
+        writer->hasError = 1;
+
+        return -1;
+    }
+
+    file->buf = malloc( PARTITION_BUFFER_SIZE );
+    setvbuf(file->file, file->buf, _IOFBF, PARTITION_BUFFER_SIZE);
+
+    if ( file->isCreated )
+    {
+        writer->numReopens += 1;
+    }
+    else
+    {
+        file->isCreated = 1;
+        if ( writer->headerFunc != NULL )
+            writer->headerFunc(file->file, writer->headerArg);
+    }
+
+    PartitionWriter_PushFront(writer, file);
+    writer->numOpen += 1;
+
+    return 0;
+}
+
+void PartitionWriter_Write(PartitionWriter *writer, time_t fileTime, const char *data, size_t len)
+{
+    PartitionFile *file;
+    int key;
+
+    /* Runs of the same period (e.x. sorted input) skip converting the time */
+    if ( likely( writer->rangeFile != NULL && fileTime >= writer->rangeStart && fileTime < writer->rangeEnd ) )
+    {
+        file = writer->rangeFile;
+    }
+    else
+    {
+        key = getPeriod(writer->partitionBy, fileTime, &writer->rangeStart, &writer->rangeEnd);
+        file = PartitionWriter_GetFile(writer, key);
+        writer->rangeFile = file;
+    }
+
+    if ( file->file == NULL )
+    {
+        if ( unlikely( PartitionWriter_Open(writer, file) < 0 ) )
+            return;
+    }
+    else if ( file != writer->lruHead )
+    {
+        PartitionWriter_Unlink(writer, file);
+        PartitionWriter_PushFront(writer, file);
+    }
+
+    fwrite(data, 1, len, file->file);
+}
+
+int PartitionWriter_Free(PartitionWriter *writer)
+{
+    PartitionFile *file, *next;
+    size_t i;
+    int ret;
+
+    while ( writer->lruHead != NULL )
+        PartitionWriter_Close(writer, writer->lruHead);
+
+    for( i=0; i < writer->numSlots; i++ )
+    {
+        for( file=writer->slots[i]; file != NULL; file=next )
+        {
+            next = file->hashNext;
+            free(file->path);
+            free(file);
+        }
+    }
+
+    ret = writer->hasError ? -1 : 0;
+
+    free(writer->slots);
+    free(writer);
+
+    return ret;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * partition_writer.h - Header for partition_writer.c
+ *
+ */
+#ifndef __PARTITION_WRITER_H
+#define __PARTITION_WRITER_H
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+
+/*
+ * PARTITION_BY_* - Which (local) calendar period of a file's time picks its output file
+ */
+#define PARTITION_BY_DAY   0    /* DIR/YYYY-MM-DD */
+#define PARTITION_BY_MONTH 1    /* DIR/YYYY-MM */
+#define PARTITION_BY_YEAR  2    /* DIR/YYYY */
+
+/* Most output files held open at once, unless given by --max-open-files */
+#define PARTITION_DEFAULT_MAX_OPEN 64
+
+/* Size of the write buffer of each open output file */
+#define PARTITION_BUFFER_SIZE (64 * 1024)
+
+/*
+ * PartitionOptions - Options common to tools which can partition their output, parsed by handlePartitionArg
+ */
+typedef struct {
+    int partitionBy;        /* One of PARTITION_BY_*, or -1 to write to stdout */
+    const char *outputDir;  /* Directory the output files are written in */
+    int maxOpen;            /* Most output files held open at once */
+
+} PartitionOptions;
+
+/*
+ * PartitionFile - A single output file of a PartitionWriter
+ */
+typedef struct PartitionFile {
+    int key;                /* e.x. 20240315, 202403 or 2024, see PARTITION_BY_* */
+    char *path;
+
+    FILE *file;             /* NULL while closed */
+    char *buf;              /* Write buffer, while open */
+    int isCreated;          /* Created (and truncated) by this writer, so later opens append */
+
+    /* Among the open files, most recently written first */
+    struct PartitionFile *lruPrev;
+    struct PartitionFile *lruNext;
+
+    struct PartitionFile *hashNext;
+
+} PartitionFile;
+
+/**
+ * PartitionHeaderFunc - Called with each output file as it is created, to write any header
+ */
+typedef void (*PartitionHeaderFunc)(FILE *file, void *arg);
+
+/*
+ * PartitionWriter - Writes data into one file per calendar period, in a single pass.
+ *
+ *   At most maxOpen files are held open, and the least recently written is closed
+ *     to make room for another. A closed file is reopened to append.
+ */
+typedef struct {
+    const char *outputDir;
+    const char *suffix;
+    int partitionBy;
+    int maxOpen;
+
+    PartitionHeaderFunc headerFunc;
+    void *headerArg;
+
+    PartitionFile **slots;      /* Hash of files by key, each slot a chain */
+    size_t numSlots;            /* Always a power of 2 */
+    size_t numFiles;
+
+    PartitionFile *lruHead;
+    PartitionFile *lruTail;
+    int numOpen;
+
+    /* The last file written, which times in [rangeStart, rangeEnd) also go to */
+    PartitionFile *rangeFile;
+    time_t rangeStart;
+    time_t rangeEnd;
+
+    size_t numReopens;          /* Times a file closed to make room was opened again */
+    int hasError;
+
+} PartitionWriter;
+
+
+/**
+ * initPartitionOptions - Set #options to their defaults (no partitioning)
+ */
+extern void initPartitionOptions(PartitionOptions *options);
+
+/**
+ * handlePartitionArg - Handle #arg if it is one of the partitioning options, filling #options
+ *
+ *   Returns 1 if handled, 0 if not a partitioning option, or -1 (after printing why) if invalid.
+ */
+extern int handlePartitionArg(PartitionOptions *options, const char *arg);
+
+/**
+ * checkPartitionOptions - Check --partition-by and --output-dir were given together (or not at all)
+ *
+ *   Returns 1 if usable, else 0 (after printing why)
+ */
+extern int checkPartitionOptions(const PartitionOptions *options);
+
+/**
+ * printPartitionUsage - Print usage of the partitioning options to stderr
+ */
+extern void printPartitionUsage(void);
+
+/**
+ * PartitionWriter_New - Create a writer of the files named by #options, each ending in #suffix,
+ *   creating the output directory if needed.
+ *
+ *   #headerFunc (if not NULL) is called with #headerArg as each file is created.
+ *
+ *   Returns the writer, or NULL (after printing why) if the directory cannot be created.
+ */
+extern PartitionWriter *PartitionWriter_New(const PartitionOptions *options, const char *suffix, PartitionHeaderFunc headerFunc, void *headerArg);
+
+/**
+ * PartitionWriter_Write - Write the #len bytes at #data to the file for #fileTime
+ */
+extern void PartitionWriter_Write(PartitionWriter *writer, time_t fileTime, const char *data, size_t len);
+
+/**
+ * PartitionWriter_Free - Close every file of a writer created by PartitionWriter_New, and free it.
+ *
+ *   Returns 0 if everything was written, or -1 if any write failed.
+ */
+extern int PartitionWriter_Free(PartitionWriter *writer);
+
+#endif
@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * path_filter.c - Include and exclude patterns, matched against paths before they are stat'd
+ */
+
+#ifndef _GNU_SOURCE
+  /* For memmem */
+  #define _GNU_SOURCE
+#endif
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+
+#include "mtime_utils.h"
+
+#include "path_filter.h"
+
+/*
+ * isGlobSpecial - Check if #ch has meaning in a glob (other than as itself)
+ */
+static inline int isGlobSpecial(char ch)
+{
+    return ch == '*' || ch == '?' || ch == '[' || ch == ']' || ch == '\\';
+}
+
+/*
+ * findClassEnd - Find the ] closing the character class which starts at the [ at #pat,
+ *   or NULL if it is never closed
+ */
+static const char *findClassEnd(const char *pat)
+{
+    pat++;
+    if ( *pat == '!' || *pat == '^' )
+        pat++;
+
+    /* A ] first in the class is itself */
+    if ( *pat == ']' )
+        pat++;
+
+    while ( *pat != '\0' && *pat != ']' )
+    {
+        if ( *pat == '\\' && pat[1] != '\0' )
+            pat++;
+        pat++;
+    }
+
+    return ( *pat == ']' ) ? pat : NULL;
+}
+
+/*
+ * matchToken - Match the character #ch against the single token (not a *) at #pat
+ *
+ *   Returns the pattern following the token if it matches, else NULL
+ */
+static inline const char *matchToken(const char *pat, unsigned char ch)
+{
+    unsigned char low, high;
+    int isNegated, isMatch;
+
+    switch ( *pat )
+    {
+        case '\0':
+            return NULL;
+
+        case '?':
+            return pat + 1;
+
+        case '\\':
+            if ( pat[1] == '\0' )
+                return ( ch == '\\' ) ? pat + 1 : NULL;
+
+            return ( (unsigned char)pat[1] == ch ) ? pat + 2 : NULL;
+
+        case '[':
+            /* Classes were checked to be closed when compiled */
+            pat++;
+            isNegated = ( *pat == '!' || *pat == '^' );
+            if ( isNegated )
+                pat++;
+
+            isMatch = 0;
+            do
+            {
+                if ( *pat == '\\' && pat[1] != '\0' )
+                    pat++;
+                low = high = (unsigned char)*pat++;
+
+                if ( *pat == '-' && pat[1] != ']' && pat[1] != '\0' )
+                {
+                    pat++;
+                    if ( *pat == '\\' && pat[1] != '\0' )
+                        pat++;
+                    high = (unsigned char)*pat++;
+                }
+
+                if ( ch >= low && ch <= high )
+                    isMatch = 1;
+
+            } while ( *pat != ']' );
+
+            return ( isMatch != isNegated ) ? pat + 1 : NULL;
+
+        default:
+            return ( (unsigned char)*pat == ch ) ? pat + 1 : NULL;
+    }
+}
+
+/*
+ * globMatch - Match all of #path against the glob #pat
+ *
+ *   * matches any run of characters (including /), ? any one character, and [...] one of a class.
+ *
+ *   Only the most recent * is ever backtracked to, so this never recurses, and takes at most
+ *     (length of #path) x (length of #pat) steps.
+ */
+static int globMatch(const char *pat, const char *path)
+{
+    const char *starPat, *starPath, *next;
+
+    starPat = NULL;
+    starPath = NULL;
+
+    while ( *path != '\0' )
+    {
+        if ( *pat == '*' )
+        {
+            while ( *pat == '*' )
+                pat++;
+
+            if ( *pat == '\0' )
+                return 1;
+
+            starPat = pat;
+            starPath = path;
+            continue;
+        }
+
+        next = matchToken(pat, (unsigned char)*path);
+        if ( next != NULL )
+        {
+            pat = next;
+            path++;
+            continue;
+        }
+
+        /* Let the last * take one more character, and try again after it */
+        if ( starPat == NULL )
+            return 0;
+
+        pat = starPat;
+        path = ++starPath;
+    }
+
+    while ( *pat == '*' )
+        pat++;
+
+    return *pat == '\0';
+}
+
+/*
+ * compileGlob - Compile the glob #glob into #pattern, using a plain string compare
+ *   where it is a literal with at most a leading and a trailing *
+ *
+ *   Returns 0 on success, or -1 if #glob is invalid
+ */
+static int compileGlob(PathPattern *pattern, const char *glob)
+{
+    const char *cur, *end;
+    size_t len;
+    int hasLeadingStar, hasTrailingStar;
+
+    for( cur=glob; *cur != '\0'; cur++ )
+    {
+        if ( *cur == '\\' && cur[1] != '\0' )
+        {
+            cur++;
+        }
+        else if ( *cur == '[' )
+        {
+            cur = findClassEnd(cur);
+            if ( cur == NULL )
+            {
+                fprintf(stderr, "Unterminated [ in pattern: %s\n", glob);
+                return -1;
+            }
+        }
+    }
+
+    len = strlen(glob);
+    pattern->text = malloc( len + 1 );
+
+    /* Unescape into text, for as long as it stays a literal between optional stars */
+    hasLeadingStar = 0;
+    hasTrailingStar = 0;
+
+    cur = glob;
+    while ( *cur == '*' )
+    {
+        hasLeadingStar = 1;
+        cur++;
+    }
+
+    pattern->textLen = 0;
+    pattern->kind = -1;
+
+    while ( *cur != '\0' )
+    {
+        if ( *cur == '\\' && cur[1] != '\0' )
+        {
+            pattern->text[pattern->textLen++] = cur[1];
+            cur += 2;
+            continue;
+        }
+
+        if ( *cur == '*' )
+        {
+            for( end=cur; *end == '*'; end++ );
+
+            if ( *end != '\0' )
+            {
+                pattern->kind = PATH_PATTERN_GLOB;
+                break;
+            }
+
+            hasTrailingStar = 1;
+            break;
+        }
+
+        if ( *cur == '?' || *cur == '[' )
+        {
+            pattern->kind = PATH_PATTERN_GLOB;
+            break;
+        }
+
+        pattern->text[pattern->textLen++] = *cur++;
+    }
+
+    if ( pattern->kind == PATH_PATTERN_GLOB )
+    {
+        /* Matched by globMatch, after the literal ends are compared */
+        strcpy(pattern->text, glob);
+        pattern->textLen = len;
+
+        for( pattern->prefixLen=0; pattern->prefixLen < len && !isGlobSpecial(glob[pattern->prefixLen]); pattern->prefixLen++ );
+        for( pattern->suffixLen=0; pattern->suffixLen < len && !isGlobSpecial(glob[len - 1 - pattern->suffixLen]); pattern->suffixLen++ );
+
+        return 0;
+    }
+
+    pattern->text[pattern->textLen] = '\0';
+
+    if ( hasLeadingStar && hasTrailingStar )
+        pattern->kind = PATH_PATTERN_CONTAINS;
+    else if ( hasLeadingStar )
+        pattern->kind = PATH_PATTERN_SUFFIX;
+    else if ( hasTrailingStar )
+        pattern->kind = PATH_PATTERN_PREFIX;
+    else
+        pattern->kind = PATH_PATTERN_EXACT;
+
+    return 0;
+}
+
+/*
+ * PathPattern_Match - Check if #path (of #pathLen chars) matches #pattern
+ */
+static inline int PathPattern_Match(const PathPattern *pattern, const char *path, size_t pathLen)
+{
+    switch ( pattern->kind )
+    {
+        case PATH_PATTERN_EXACT:
+            return pathLen == pattern->textLen && memcmp(path, pattern->text, pathLen) == 0;
+
+        case PATH_PATTERN_PREFIX:
+            return pathLen >= pattern->textLen && memcmp(path, pattern->text, pattern->textLen) == 0;
+
+        case PATH_PATTERN_SUFFIX:
+            return pathLen >= pattern->textLen && memcmp(path + pathLen - pattern->textLen, pattern->text, pattern->textLen) == 0;
+
+        case PATH_PATTERN_CONTAINS:
+            return memmem(path, pathLen, pattern->text, pattern->textLen) != NULL;
+
+        case PATH_PATTERN_GLOB:
+            if ( pathLen < pattern->prefixLen + pattern->suffixLen ||
+                 memcmp(path, pattern->text, pattern->prefixLen) != 0 ||
+                 memcmp(path + pathLen - pattern->suffixLen, pattern->text + pattern->textLen - pattern->suffixLen, pattern->suffixLen) != 0 )
+            {
+                return 0;
+            }
+
+            return globMatch(pattern->text + pattern->prefixLen, path + pattern->prefixLen);
+
+        case PATH_PATTERN_REGEX:
+            return regexec(&pattern->regex, path, 0, NULL, 0) == 0;
+    }
+
+    return 0;
+}
+
+PathFilter *PathFilter_New(void)
+{
+    PathFilter *ret;
+
+    ret = malloc( sizeof(PathFilter) );
+
+    ret->includes = NULL;
+    ret->numIncludes = 0;
+    ret->excludes = NULL;
+    ret->numExcludes = 0;
+
+    return ret;
+}
+
+/*
+ * freePatterns - Free the #numPatterns patterns at #patterns, and the array itself
+ */
+static void freePatterns(PathPattern *patterns, int numPatterns)
+{
+    int i;
+
+    for( i=0; i < numPatterns; i++ )
+    {
+        if ( patterns[i].kind == PATH_PATTERN_REGEX )
+            regfree(&patterns[i].regex);
+        free(patterns[i].text);
+    }
+
+    free(patterns);
+}
+
+void PathFilter_Free(PathFilter *filter)
+{
+    freePatterns(filter->includes, filter->numIncludes);
+    freePatterns(filter->excludes, filter->numExcludes);
+    free(filter);
+}
+
+int PathFilter_Add(PathFilter *filter, const char *pattern, int isExclude, int isRegex)
+{
+    PathPattern compiled;
+    PathPattern **patterns;
+    int *numPatterns;
+    int err;
+    char errBuf[256];
+
+    memset(&compiled, 0x0, sizeof(PathPattern));
+
+    if ( isRegex )
+    {
+        err = regcomp(&compiled.regex, pattern, REG_EXTENDED | REG_NOSUB);
+        if ( err != 0 )
+        {
+            regerror(err, &compiled.regex, errBuf, sizeof(errBuf));
+            fprintf(stderr, "Invalid regular expression '%s': %s\n", pattern, errBuf);
+            return -1;
+        }
+
+        compiled.kind = PATH_PATTERN_REGEX;
+    }
+    else if ( compileGlob(&compiled, pattern) < 0 )
+    {
+        free(compiled.text);
+        return -1;
+    }
+
+    patterns = isExclude ? &filter->excludes : &filter->includes;
+    numPatterns = isExclude ? &filter->numExcludes : &filter->numIncludes;
+
+    *patterns = realloc(*patterns, sizeof(PathPattern) * (*numPatterns + 1));
+    (*patterns)[(*numPatterns)++] = compiled;
+
+    return 0;
+}
+
+int PathFilter_Keep(const PathFilter *filter, const char *path)
+{
+    size_t pathLen;
+    int i;
+
+    pathLen = strlen(path);
+
+    if ( filter->numIncludes > 0 )
+    {
+        for( i=0; i < filter->numIncludes; i++ )
+        {
+            if ( PathPattern_Match(&filter->includes[i], path, pathLen) )
+                break;
+        }
+
+        if ( i == filter->numIncludes )
+            return 0;
+    }
+
+    for( i=0; i < filter->numExcludes; i++ )
+    {
+        if ( PathPattern_Match(&filter->excludes[i], path, pathLen) )
+            return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * path_filter.h - Header for path_filter.c
+ *
+ */
+#ifndef __PATH_FILTER_H
+#define __PATH_FILTER_H
+
+#include <sys/types.h>
+#include <regex.h>
+
+/*
+ * PATH_PATTERN_* - How a PathPattern is matched, chosen when it is compiled
+ */
+#define PATH_PATTERN_EXACT    0  /* Glob without wildcards, the whole path */
+#define PATH_PATTERN_PREFIX   1  /* "literal*" */
+#define PATH_PATTERN_SUFFIX   2  /* "*literal" */
+#define PATH_PATTERN_CONTAINS 3  /* "*literal*" */
+#define PATH_PATTERN_GLOB     4  /* Any other glob */
+#define PATH_PATTERN_REGEX    5  /* POSIX extended regular expression */
+
+/*
+ * PathPattern - A single compiled --include or --exclude pattern
+ */
+typedef struct {
+    int kind;           /* One of PATH_PATTERN_* */
+
+    char *text;         /* The literal (unescaped) for EXACT, PREFIX, SUFFIX and CONTAINS, else the glob */
+    size_t textLen;
+
+    /* With GLOB, the lengths of the literal text before the first and after the last wildcard,
+     *   checked before running the full match
+     */
+    size_t prefixLen;
+    size_t suffixLen;
+
+    regex_t regex;      /* With REGEX */
+
+} PathPattern;
+
+/*
+ * PathFilter - Sets of patterns paths are kept or dropped by.
+ *
+ *   A path is kept if it matches any include (or there are none), and matches no exclude.
+ */
+typedef struct {
+    PathPattern *includes;
+    int numIncludes;
+
+    PathPattern *excludes;
+    int numExcludes;
+
+} PathFilter;
+
+
+/**
+ * PathFilter_New - Create a new, empty filter (which keeps everything)
+ */
+extern PathFilter *PathFilter_New(void);
+
+/**
+ * PathFilter_Free - Free a filter created by PathFilter_New, and its patterns
+ */
+extern void PathFilter_Free(PathFilter *filter);
+
+/**
+ * PathFilter_Add - Compile #pattern, and add it to the includes (or excludes, if #isExclude) of #filter
+ *
+ *   #pattern is a glob, or with #isRegex a POSIX extended regular expression. It is copied.
+ *
+ *   Returns 0 on success, or -1 (after printing why) if #pattern is invalid.
+ */
+extern int PathFilter_Add(PathFilter *filter, const char *pattern, int isExclude, int isRegex);
+
+/**
+ * PathFilter_Keep - Check if the null-terminated #path is kept by #filter
+ *
+ *   Safe to call from many threads at once.
+ */
+extern int PathFilter_Keep(const PathFilter *filter, const char *path);
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * path_index.c - Hash index of paths
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+
+#include "mtime_utils.h"
+
+#include "path_index.h"
+
+/* Fewest hash slots. Must be a power of 2 */
+#define PATH_INDEX_MIN_SLOTS 1024
+
+/*
+ * hashPath - FNV-1a hash of the null-terminated #path
+ */
+static inline uint64_t hashPath(const char *path)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for( ; *path != '\0'; path++ )
+    {
+        hash ^= (unsigned char)*path;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+PathIndex *PathIndex_New(size_t expectedEntries)
+{
+    PathIndex *ret;
+
+    ret = malloc( sizeof(PathIndex) );
+
+    /* Keep load factor at or below 1/2 */
+    ret->numSlots = PATH_INDEX_MIN_SLOTS;
+    while ( ret->numSlots / 2 <= expectedEntries )
+        ret->numSlots *= 2;
+
+    ret->slots = calloc( ret->numSlots, sizeof(size_t) );
+
+    ret->entriesCapacity = ret->numSlots / 2;
+    ret->entries = malloc( sizeof(PathIndexEntry) * ret->entriesCapacity );
+    ret->numEntries = 0;
+
+    return ret;
+}
+
+void PathIndex_Free(PathIndex *index)
+{
+    free(index->entries);
+    free(index->slots);
+    free(index);
+}
+
+/*
+ * PathIndex_Grow - Double the number of slots, and rehash.
+ */
+static void PathIndex_Grow(PathIndex *index)
+{
+    size_t i, slot, mask;
+
+    free(index->slots);
+
+    index->numSlots *= 2;
+    index->slots = calloc( index->numSlots, sizeof(size_t) );
+
+    mask = index->numSlots - 1;
+
+    for( i=0; i < index->numEntries; i++ )
+    {
+        slot = index->entries[i].hash & mask;
+        while ( index->slots[slot] != 0 )
+            slot = (slot + 1) & mask;
+
+        index->slots[slot] = i + 1;
+    }
+
+    index->entriesCapacity = index->numSlots / 2;
+    index->entries = realloc(index->entries, sizeof(PathIndexEntry) * index->entriesCapacity);
+}
+
+/*
+ * PathIndex_FindSlot - Find the slot holding #path, or the empty slot where it belongs
+ */
+static inline size_t PathIndex_FindSlot(const PathIndex *index, const char *path, uint64_t hash)
+{
+    const PathIndexEntry *entry;
+    size_t slot, mask;
+
+    mask = index->numSlots - 1;
+    slot = hash & mask;
+
+    while ( index->slots[slot] != 0 )
+    {
+        entry = &index->entries[ index->slots[slot] - 1 ];
+        if ( entry->hash == hash && strcmp(entry->path, path) == 0 )
+            break;
+
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+size_t PathIndex_Insert(PathIndex *index, const char *path, size_t value)
+{
+    PathIndexEntry *entry;
+    uint64_t hash;
+    size_t slot;
+
+    hash = hashPath(path);
+    slot = PathIndex_FindSlot(index, path, hash);
+
+    if ( index->slots[slot] != 0 )
+        return index->entries[ index->slots[slot] - 1 ].value;
+
+    entry = &index->entries[index->numEntries];
+
+    entry->path = path;
+    entry->hash = hash;
+    entry->value = value;
+
+    index->numEntries += 1;
+    index->slots[slot] = index->numEntries;
+
+    if ( unlikely( index->numEntries == index->entriesCapacity ) )
+        PathIndex_Grow(index);
+
+    return value;
+}
+
+size_t PathIndex_Find(const PathIndex *index, const char *path)
+{
+    size_t slot;
+
+    slot = PathIndex_FindSlot(index, path, hashPath(path));
+    if ( index->slots[slot] == 0 )
+        return PATH_INDEX_NOT_FOUND;
+
+    return index->entries[ index->slots[slot] - 1 ].value;
+}
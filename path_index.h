@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * path_index.h - Header for path_index.c
+ *
+ */
+#ifndef __PATH_INDEX_H
+#define __PATH_INDEX_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Returned by PathIndex_Find when a path is not in the index */
+#define PATH_INDEX_NOT_FOUND ((size_t)-1)
+
+/*
+ * PathIndexEntry - A single path, and the value associated with it
+ */
+typedef struct {
+    const char *path;   /* Not copied, must remain allocated for the life of the index */
+    uint64_t hash;
+    size_t value;
+
+} PathIndexEntry;
+
+/*
+ * PathIndex - Hash index of paths to values (e.x. positions within a NameStat array)
+ *
+ *   entries are kept in the order they were inserted.
+ */
+typedef struct {
+    PathIndexEntry *entries;
+    size_t numEntries;
+    size_t entriesCapacity;
+
+    size_t *slots;          /* Open-addressed hash table of (entry index + 1), 0 is empty */
+    size_t numSlots;        /* Always a power of 2 */
+
+} PathIndex;
+
+
+/**
+ * PathIndex_New - Create a new index, sized to hold #expectedEntries without growing.
+ */
+extern PathIndex *PathIndex_New(size_t expectedEntries);
+
+/**
+ * PathIndex_Free - Free an index created by PathIndex_New
+ */
+extern void PathIndex_Free(PathIndex *index);
+
+/**
+ * PathIndex_Insert - Associate #value with #path, unless #path is already in the index.
+ *
+ *   Returns the value already associated with #path, or #value if it was inserted.
+ */
+extern size_t PathIndex_Insert(PathIndex *index, const char *path, size_t value);
+
+/**
+ * PathIndex_Find - Get the value associated with #path, or PATH_INDEX_NOT_FOUND
+ */
+extern size_t PathIndex_Find(const PathIndex *index, const char *path);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * path_store.c - Compact storage of paths, with each directory held once
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+
+#include "mtime_utils.h"
+
+#include "path_index.h"
+#include "path_store.h"
+
+/* Bytes of names held by each block of the arena */
+#define PATH_STORE_BLOCK_SIZE ( 1024 * 1024 )
+
+/* Directories expected up front, see PathIndex_New */
+#define PATH_STORE_INITIAL_DIRS 1024
+
+/*
+ * PathStore_Reserve - Get room for #size bytes at the end of the current block,
+ *   starting a new block if it is full. The room is not used until PathStore_Commit.
+ */
+static char *PathStore_Reserve(PathStore *store, size_t size)
+{
+    PathStoreBlock *block;
+    size_t blockSize;
+
+    block = store->block;
+    if ( likely( block != NULL && block->used + size <= block->size ) )
+        return &block->data[block->used];
+
+    blockSize = size > PATH_STORE_BLOCK_SIZE ? size : PATH_STORE_BLOCK_SIZE;
+
+    block = malloc( sizeof(PathStoreBlock) + blockSize );
+    if ( unlikely( block == NULL ) )
+    {
+        fputs("Err: Failed to allocate memory for paths.\n", stderr);
+        exit(12);
+    }
+
+    block->prev = store->block;
+    block->size = blockSize;
+    block->used = 0;
+
+    store->block = block;
+
+    return block->data;
+}
+
+/*
+ * PathStore_Commit - Keep the #size bytes last reserved by PathStore_Reserve
+ */
+static inline void PathStore_Commit(PathStore *store, size_t size)
+{
+    store->block->used += size;
+    store->numBytes += size;
+}
+
+PathStore *PathStore_New(void)
+{
+    PathStore *ret;
+
+    ret = calloc( 1, sizeof(PathStore) );
+
+    ret->dirIndex = PathIndex_New(PATH_STORE_INITIAL_DIRS);
+
+    ret->dirsCapacity = PATH_STORE_INITIAL_DIRS;
+    ret->dirs = malloc( sizeof(const char *) * ret->dirsCapacity );
+
+    /* Paths without any directory */
+    ret->dirs[0] = "";
+    ret->numDirs = 1;
+    ret->lastDirId = 0;
+    ret->lastDirLen = 0;
+
+    return ret;
+}
+
+void PathStore_Free(PathStore *store)
+{
+    PathStoreBlock *block, *prev;
+
+    for( block = store->block; block != NULL; block = prev )
+    {
+        prev = block->prev;
+        free(block);
+    }
+
+    PathIndex_Free(store->dirIndex);
+    free(store->dirs);
+    free(store);
+}
+
+/*
+ * PathStore_AddDir - Get the id of the #dirLen byte directory at the start of #path,
+ *   storing it if new.
+ */
+static uint32_t PathStore_AddDir(PathStore *store, const char *path, size_t dirLen)
+{
+    char *dir;
+    size_t dirId;
+
+    /* Copy, terminated, to look it up. Dropped again if already stored */
+    dir = PathStore_Reserve(store, dirLen + 1);
+    memcpy(dir, path, dirLen);
+    dir[dirLen] = '\0';
+
+    dirId = PathIndex_Insert(store->dirIndex, dir, store->numDirs);
+    if ( dirId != store->numDirs )
+        return (uint32_t)dirId;
+
+    PathStore_Commit(store, dirLen + 1);
+
+    if ( unlikely( store->numDirs == store->dirsCapacity ) )
+    {
+        store->dirsCapacity *= 2;
+        store->dirs = realloc(store->dirs, sizeof(const char *) * store->dirsCapacity);
+    }
+
+    store->dirs[store->numDirs++] = dir;
+
+    return (uint32_t)dirId;
+}
+
+uint32_t PathStore_Add(PathStore *store, const char *path, const char **baseName)
+{
+    const char *lastSlash;
+    char *base;
+    size_t dirLen, baseLen;
+    uint32_t dirId;
+
+    lastSlash = strrchr(path, '/');
+    dirLen = lastSlash != NULL ? (size_t)(lastSlash - path) + 1 : 0;
+
+    /* find lists every file of a directory together, so it is usually the last one */
+    if ( dirLen == 0 )
+        dirId = 0;
+    else if ( dirLen == store->lastDirLen && memcmp(path, store->dirs[store->lastDirId], dirLen) == 0 )
+        dirId = store->lastDirId;
+    else
+        dirId = PathStore_AddDir(store, path, dirLen);
+
+    store->lastDirId = dirId;
+    store->lastDirLen = dirLen;
+
+    baseLen = strlen(path + dirLen);
+
+    base = PathStore_Reserve(store, baseLen + 1);
+    memcpy(base, path + dirLen, baseLen + 1);
+    PathStore_Commit(store, baseLen + 1);
+
+    *baseName = base;
+
+    store->numPaths += 1;
+    store->numPathBytes += dirLen + baseLen + 1;
+
+    return dirId;
+}
+
+char *PathStore_Join(const PathStore *store, uint32_t dirId, const char *baseName, char **buf, size_t *bufSize)
+{
+    const char *dir;
+    size_t dirLen, baseLen;
+
+    dir = store->dirs[dirId];
+    dirLen = strlen(dir);
+    baseLen = strlen(baseName);
+
+    if ( unlikely( dirLen + baseLen + 1 > *bufSize ) )
+    {
+        *bufSize = ( dirLen + baseLen + 1 ) * 2;
+        *buf = realloc(*buf, *bufSize);
+    }
+
+    memcpy(*buf, dir, dirLen);
+    memcpy(*buf + dirLen, baseName, baseLen + 1);
+
+    return *buf;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * path_store.h - Header for path_store.c
+ *
+ */
+#ifndef __PATH_STORE_H
+#define __PATH_STORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "path_index.h"
+
+/*
+ * PathStoreBlock - A block of the arena holding directory and base names.
+ *   Blocks never move once allocated, so names within them may be pointed to.
+ */
+typedef struct PathStoreBlock {
+    struct PathStoreBlock *prev;
+    size_t size;
+    size_t used;
+    char data[];
+
+} PathStoreBlock;
+
+/*
+ * PathStore - Compact storage of many paths, as (directory id, base name)
+ *
+ *   Each distinct directory is stored once, so paths from find (which repeat the same
+ *     long prefixes over and over) take little more than their base names.
+ *
+ *   Directory ids are 32 bits, so at most 4294967295 distinct directories are held.
+ */
+typedef struct {
+    PathStoreBlock *block;  /* Current (newest) block */
+
+    PathIndex *dirIndex;    /* Directory (with trailing '/') to id */
+    const char **dirs;      /* Directory of each id. Id 0 is the empty directory */
+    size_t numDirs;
+    size_t dirsCapacity;
+
+    /* The last directory added, which is usually the next one too */
+    uint32_t lastDirId;
+    size_t lastDirLen;
+
+    size_t numPaths;
+    size_t numBytes;        /* Bytes of names stored */
+    size_t numPathBytes;    /* Bytes the paths would take whole (including terminators) */
+
+} PathStore;
+
+
+/**
+ * PathStore_New - Create an empty PathStore
+ */
+extern PathStore *PathStore_New(void);
+
+/**
+ * PathStore_Free - Free a PathStore, and all of the names within it
+ */
+extern void PathStore_Free(PathStore *store);
+
+/**
+ * PathStore_Add - Store #path, returning the id of its directory,
+ *   and setting #baseName to the stored copy of its base name.
+ *
+ *   #baseName remains valid for the life of #store.
+ */
+extern uint32_t PathStore_Add(PathStore *store, const char *path, const char **baseName);
+
+/**
+ * PathStore_GetDir - Get the directory (with trailing '/', or "" for none) of #dirId
+ */
+static inline const char *PathStore_GetDir(const PathStore *store, uint32_t dirId)
+{
+    return store->dirs[dirId];
+}
+
+/**
+ * PathStore_Join - Write the full path of #dirId and #baseName to #buf, growing it as needed.
+ *
+ *   #buf and #bufSize may start as NULL and 0, and should be freed when done.
+ *
+ *   Returns the full path (*buf)
+ */
+extern char *PathStore_Join(const PathStore *store, uint32_t dirId, const char *baseName, char **buf, size_t *bufSize);
+
+#endif
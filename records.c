@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * records.c - Read and write the binary record stream format (see records.h)
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "mtime_utils.h"
+
+#include "gather_mtimes.h"
+#include "records.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+static inline void putLE32(unsigned char *dst, uint32_t val)
+{
+    dst[0] = val & 0xFF;
+    dst[1] = (val >> 8) & 0xFF;
+    dst[2] = (val >> 16) & 0xFF;
+    dst[3] = (val >> 24) & 0xFF;
+}
+
+static inline void putLE64(unsigned char *dst, uint64_t val)
+{
+    putLE32(dst, (uint32_t)val);
+    putLE32(dst + 4, (uint32_t)(val >> 32));
+}
+
+static inline uint32_t getLE32(const unsigned char *src)
+{
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+static inline uint64_t getLE64(const unsigned char *src)
+{
+    return (uint64_t)getLE32(src) | ((uint64_t)getLE32(src + 4) << 32);
+}
+
+int isRecordsStream(const char *buf, size_t size)
+{
+    return size >= RECORDS_HEADER_SIZE && memcmp(buf, RECORDS_MAGIC, RECORDS_MAGIC_LEN) == 0;
+}
+
+void writeRecordsHeader(FILE *stream, int timeField, int fields)
+{
+    unsigned char header[RECORDS_HEADER_SIZE];
+
+    memcpy(header, RECORDS_MAGIC, RECORDS_MAGIC_LEN);
+    header[6] = RECORDS_VERSION;
+    header[7] = (unsigned char)timeField;
+    putLE32(&header[8], (uint32_t)(fields & RECORD_FIELDS));
+    putLE32(&header[12], 0);
+
+    fwrite(header, 1, RECORDS_HEADER_SIZE, stream);
+}
+
+void encodeRecordFixed(unsigned char *fixed, const NameStat *nameStat, size_t pathLen)
+{
+    int64_t timeNs;
+
+    timeNs = (int64_t)nameStat->fileTime.tv_sec * NSEC_PER_SEC + nameStat->fileTime.tv_nsec;
+
+    putLE32(&fixed[0], (uint32_t)pathLen);
+    putLE32(&fixed[4], (uint32_t)nameStat->statBuf.st_mode);
+    putLE64(&fixed[8], (uint64_t)timeNs);
+    putLE64(&fixed[16], (uint64_t)nameStat->statBuf.st_size);
+    putLE32(&fixed[24], (uint32_t)nameStat->statBuf.st_uid);
+    putLE32(&fixed[28], (uint32_t)nameStat->statBuf.st_gid);
+}
+
+void writeRecord(FILE *stream, const NameStat *nameStat)
+{
+    unsigned char fixed[RECORD_FIXED_SIZE];
+    size_t pathLen;
+
+    pathLen = strlen(nameStat->fname);
+    encodeRecordFixed(fixed, nameStat, pathLen);
+
+    fwrite(fixed, 1, RECORD_FIXED_SIZE, stream);
+    fwrite(nameStat->fname, 1, pathLen, stream);
+}
+
+/*
+ * decodeRecord - Fill #nameStat from the fixed portion of a record at #src
+ */
+static inline void decodeRecord(NameStat *nameStat, const unsigned char *src, int timeField)
+{
+    int64_t timeNs;
+    struct timespec fileTime;
+
+    memset(&nameStat->statBuf, 0x0, sizeof(struct stat));
+
+    nameStat->statBuf.st_mode = getLE32(&src[4]);
+    nameStat->statBuf.st_size = (off_t)(int64_t)getLE64(&src[16]);
+    nameStat->statBuf.st_uid = getLE32(&src[24]);
+    nameStat->statBuf.st_gid = getLE32(&src[28]);
+
+    timeNs = (int64_t)getLE64(&src[8]);
+    fileTime.tv_sec = timeNs / NSEC_PER_SEC;
+    fileTime.tv_nsec = timeNs % NSEC_PER_SEC;
+    if ( fileTime.tv_nsec < 0 )
+    {
+        fileTime.tv_sec -= 1;
+        fileTime.tv_nsec += NSEC_PER_SEC;
+    }
+
+    nameStat->fileTime = fileTime;
+
+    switch( timeField )
+    {
+        case TIME_FIELD_ATIME:
+            nameStat->statBuf.st_atim = fileTime;
+            break;
+        case TIME_FIELD_CTIME:
+            nameStat->statBuf.st_ctim = fileTime;
+            break;
+        case TIME_FIELD_MTIME:
+            nameStat->statBuf.st_mtim = fileTime;
+            break;
+    }
+}
+
+NameStat *parseRecords(char *buf, size_t size, RecordsHeader *header, size_t *numEntries)
+{
+    unsigned char *cur, *end, *pathEnd;
+    const unsigned char *ubuf;
+    NameStat *ret;
+    size_t numRecords, pathLen, i;
+
+    *numEntries = 0;
+
+    if ( unlikely( !isRecordsStream(buf, size) ) )
+        return NULL;
+
+    ubuf = (const unsigned char *)buf;
+
+    header->version = ubuf[6];
+    header->timeField = ubuf[7];
+    header->fields = getLE32(&ubuf[8]) & RECORD_FIELDS;
+
+    if ( unlikely( header->version != RECORDS_VERSION || header->timeField > TIME_FIELD_BTIME ) )
+    {
+        fprintf(stderr, "Err: Unsupported record stream version %d\n", header->version);
+        return NULL;
+    }
+
+    end = (unsigned char *)buf + size;
+
+    /* First pass, count the complete records */
+    numRecords = 0;
+    for( cur = (unsigned char *)buf + RECORDS_HEADER_SIZE; end - cur >= RECORD_FIXED_SIZE; cur += RECORD_FIXED_SIZE + pathLen )
+    {
+        pathLen = getLE32(cur);
+        if ( unlikely( (size_t)(end - cur - RECORD_FIXED_SIZE) < pathLen ) )
+            break;
+
+        numRecords += 1;
+    }
+
+    if ( unlikely( cur != end ) )
+        fputs("Err: Input record stream is truncated, dropping final record.\n", stderr);
+
+    ret = malloc( sizeof(NameStat) * (numRecords + 1) );
+
+    /*
+     * Second pass, decode.
+     *
+     *   Each path ends where the next record starts, so once the fixed portion of the
+     *     next record has been decoded, its first byte is overwritten to terminate the
+     *     previous path. The final path is terminated by the null byte after #buf
+     *     (or the start of a truncated record)
+     */
+    pathEnd = NULL;
+    cur = (unsigned char *)buf + RECORDS_HEADER_SIZE;
+
+    for( i=0; i < numRecords; i++ )
+    {
+        pathLen = getLE32(cur);
+        decodeRecord(&ret[i], cur, header->timeField);
+
+        if ( pathEnd != NULL )
+            *pathEnd = '\0';
+
+        ret[i].fname = (char *)cur + RECORD_FIXED_SIZE;
+
+        pathEnd = cur + RECORD_FIXED_SIZE + pathLen;
+        cur = pathEnd;
+    }
+
+    if ( pathEnd != NULL )
+        *pathEnd = '\0';
+
+    *numEntries = numRecords;
+
+    return ret;
+}
+
+/*
+ * readWholeFile - Read all of #filename into a malloc'd buffer, followed by a null byte
+ *
+ *   Returns the buffer, or NULL on error (with errno set)
+ */
+static char *readWholeFile(const char *filename, size_t *size)
+{
+    FILE *file;
+    struct stat statBuf;
+    char *buf;
+
+    file = fopen(filename, "r");
+    if ( file == NULL )
+        return NULL;
+
+    if ( unlikely( fstat(fileno(file), &statBuf) < 0 ) )
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    buf = malloc( statBuf.st_size + 1 );
+    if ( unlikely( buf == NULL ) )
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    *size = fread(buf, 1, statBuf.st_size, file);
+    buf[*size] = '\0';
+
+    fclose(file);
+
+    return buf;
+}
+
+NameStat *loadRecordsFile(const char *filename, RecordsHeader *header, size_t *numEntries, char **buf)
+{
+    size_t size;
+
+    *numEntries = 0;
+
+    *buf = readWholeFile(filename, &size);
+    if ( *buf == NULL )
+        return NULL;
+
+    return parseRecords(*buf, size, header, numEntries);
+}
@@ -0,0 +1,118 @@
+/**
+ * records.h - Part of mtime_utils
+ *
+ *   Copyright (c) 2017 Timothy Savannah all rights reserved
+ *     Licensed under terms of the GNU General Purpose License (GPL) Version 3
+ *
+ *
+ * Binary record stream format
+ * ---------------------------
+ *
+ *   All integers are little-endian, regardless of host.
+ *
+ *   Header (16 bytes, once at start of stream):
+ *
+ *     offset  size  field
+ *       0       6   magic, "MTUREC"
+ *       6       1   version, currently 1
+ *       7       1   time field (TIME_FIELD_*) held in the time_ns of each record
+ *       8       4   fields, bitmask of NEED_FIELD_* which hold valid data in each record
+ *      12       4   reserved, 0
+ *
+ *   Record (32 bytes + path, repeated until end of stream):
+ *
+ *     offset  size  field
+ *       0       4   path_len, number of bytes in path
+ *       4       4   mode (st_mode)
+ *       8       8   time_ns, signed nanoseconds since the epoch
+ *      16       8   size (st_size), signed
+ *      24       4   uid
+ *      28       4   gid
+ *      32  path_len path, NOT null-terminated
+ *
+ *   Only files which were successfully stat'd are written (except in checkpoints, see checkpoint.h,
+ *     where those records have a time_ns of 0 and are skipped when read).
+ */
+
+#ifndef _RECORDS_H
+#define _RECORDS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "gather_mtimes.h"
+
+#define RECORDS_MAGIC        "MTUREC"
+#define RECORDS_MAGIC_LEN    6
+#define RECORDS_VERSION      1
+
+#define RECORDS_HEADER_SIZE  16
+#define RECORD_FIXED_SIZE    32
+
+/* The NEED_FIELD_* attributes which a record is able to carry */
+#define RECORD_FIELDS ( NEED_FIELD_UID | NEED_FIELD_GID | NEED_FIELD_SIZE | NEED_FIELD_MODE )
+
+/*
+ * RecordsHeader - The decoded stream header
+ */
+typedef struct {
+    int version;
+    int timeField;
+    int fields;
+
+} RecordsHeader;
+
+
+/**
+ * isRecordsStream - Check if the #size bytes at #buf start with a records header
+ */
+extern int isRecordsStream(const char *buf, size_t size);
+
+/**
+ * writeRecordsHeader - Write a stream header to #stream
+ *
+ *   timeField - The TIME_FIELD_* being written as each record's time_ns
+ *
+ *   fields    - NEED_FIELD_* bitmask of attributes which were gathered (masked by RECORD_FIELDS)
+ */
+extern void writeRecordsHeader(FILE *stream, int timeField, int fields);
+
+/**
+ * writeRecord - Write a single NameStat as a record to #stream
+ */
+extern void writeRecord(FILE *stream, const NameStat *nameStat);
+
+/**
+ * encodeRecordFixed - Encode the fixed portion of a record for #nameStat into #fixed (RECORD_FIXED_SIZE bytes),
+ *   for a path of #pathLen bytes. The path follows it in the stream.
+ */
+extern void encodeRecordFixed(unsigned char *fixed, const NameStat *nameStat, size_t pathLen);
+
+/**
+ * parseRecords - Parse a records stream held in #buf (of #size bytes, followed by a null byte)
+ *   into a NameStat array.
+ *
+ *   The fname of each NameStat points within #buf, which is modified to null-terminate them,
+ *     so #buf must remain allocated while the NameStats are used.
+ *
+ *   header     - Filled with the decoded stream header
+ *
+ *   numEntries - Filled with the number of entries in return
+ *
+ *   Returns a malloc'd NameStat array, or NULL if the header is invalid.
+ *     A truncated final record is reported to stderr and dropped.
+ */
+extern NameStat *parseRecords(char *buf, size_t size, RecordsHeader *header, size_t *numEntries);
+
+/**
+ * loadRecordsFile - Read the whole of #filename, and parse it as a records stream (see parseRecords)
+ *
+ *   buf - Filled with the malloc'd contents of the file, which the fname of each NameStat points within.
+ *           Free it once done with the NameStats. Set to NULL (with errno set) if the file cannot be read.
+ *
+ *   Returns a malloc'd NameStat array, or NULL if the file cannot be read or is not a records stream.
+ */
+extern NameStat *loadRecordsFile(const char *filename, RecordsHeader *header, size_t *numEntries, char **buf);
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * ring_buffer.c - Bounded lock-free MPMC queue (after Dmitry Vyukov's design)
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
+
+#include <sys/types.h>
+
+#include "mtime_utils.h"
+
+#include "ring_buffer.h"
+
+/* Attempts spent spinning, then yielding, before sleeping between attempts */
+#define RING_SPIN_ATTEMPTS 64
+#define RING_YIELD_ATTEMPTS 128
+
+/* Nanoseconds slept per attempt, once spinning and yielding have not helped */
+#define RING_SLEEP_NSEC 50000
+
+int RingBuffer_Init(RingBuffer *ring, size_t capacity)
+{
+    size_t numCells, i;
+
+    numCells = 2;
+    while ( numCells < capacity )
+        numCells *= 2;
+
+    ring->cells = malloc( sizeof(RingCell) * numCells );
+    if ( unlikely( ring->cells == NULL ) )
+        return -1;
+
+    for( i=0; i < numCells; i++ )
+    {
+        ring->cells[i].sequence = i;
+        ring->cells[i].item = NULL;
+    }
+
+    ring->mask = numCells - 1;
+    ring->pushPos = 0;
+    ring->popPos = 0;
+
+    return 0;
+}
+
+void RingBuffer_Destroy(RingBuffer *ring)
+{
+    free(ring->cells);
+    ring->cells = NULL;
+}
+
+int RingBuffer_TryPush(RingBuffer *ring, void *item)
+{
+    RingCell *cell;
+    size_t pos, sequence;
+    intptr_t diff;
+
+    pos = __atomic_load_n(&ring->pushPos, __ATOMIC_RELAXED);
+
+    for( ;; )
+    {
+        cell = &ring->cells[pos & ring->mask];
+        sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        diff = (intptr_t)sequence - (intptr_t)pos;
+
+        if ( diff == 0 )
+        {
+            /* Cell is free at our position, claim the position */
+            if ( __atomic_compare_exchange_n(&ring->pushPos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+                break;
+        }
+        else if ( diff < 0 )
+        {
+            /* Cell still holds the item from a lap ago */
+            return 0;
+        }
+        else
+        {
+            /* Another producer took this position */
+            pos = __atomic_load_n(&ring->pushPos, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->item = item;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+int RingBuffer_TryPop(RingBuffer *ring, void **item)
+{
+    RingCell *cell;
+    size_t pos, sequence;
+    intptr_t diff;
+
+    pos = __atomic_load_n(&ring->popPos, __ATOMIC_RELAXED);
+
+    for( ;; )
+    {
+        cell = &ring->cells[pos & ring->mask];
+        sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+
+        if ( diff == 0 )
+        {
+            /* Cell holds an item for our position, claim the position */
+            if ( __atomic_compare_exchange_n(&ring->popPos, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+                break;
+        }
+        else if ( diff < 0 )
+        {
+            /* Nothing pushed here yet */
+            return 0;
+        }
+        else
+        {
+            /* Another consumer took this position */
+            pos = __atomic_load_n(&ring->popPos, __ATOMIC_RELAXED);
+        }
+    }
+
+    *item = cell->item;
+
+    /* Free the cell for the push one lap from now */
+    __atomic_store_n(&cell->sequence, pos + ring->mask + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+void ringBackoff(unsigned int numAttempts)
+{
+    struct timespec sleepTime;
+
+    if ( numAttempts < RING_SPIN_ATTEMPTS )
+    {
+        #if defined(__x86_64__) || defined(__i386__)
+          __asm__ __volatile__ ( "pause" );
+        #endif
+    }
+    else if ( numAttempts < RING_SPIN_ATTEMPTS + RING_YIELD_ATTEMPTS )
+    {
+        sched_yield();
+    }
+    else
+    {
+        /* Whoever we wait on is blocked (e.x. on a slow stat or a full pipe), stop burning cpu */
+        sleepTime.tv_sec = 0;
+        sleepTime.tv_nsec = RING_SLEEP_NSEC;
+        nanosleep(&sleepTime, NULL);
+    }
+}
+
+void RingBuffer_Push(RingBuffer *ring, void *item)
+{
+    unsigned int numAttempts = 0;
+
+    while ( !RingBuffer_TryPush(ring, item) )
+        ringBackoff(numAttempts++);
+}
+
+void *RingBuffer_Pop(RingBuffer *ring)
+{
+    unsigned int numAttempts = 0;
+    void *item;
+
+    while ( !RingBuffer_TryPop(ring, &item) )
+        ringBackoff(numAttempts++);
+
+    return item;
+}
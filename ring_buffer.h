@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * ring_buffer.h - Header for ring_buffer.c
+ *
+ */
+#ifndef __RING_BUFFER_H
+#define __RING_BUFFER_H
+
+#include <sys/types.h>
+
+/* Size of a cache line, which the producer and consumer positions are kept apart by */
+#define RING_CACHE_LINE 64
+
+/*
+ * RingCell - A single slot of a RingBuffer
+ */
+typedef struct {
+    size_t sequence;    /* Position this cell is next ready to be pushed (== pos) or popped (== pos + 1) at */
+    void *item;
+
+} RingCell;
+
+/*
+ * RingBuffer - Bounded, lock-free, multi-producer multi-consumer FIFO queue of pointers
+ *
+ *   Each cell carries a sequence number, so producers and consumers each claim a position
+ *     with a single compare-and-swap, and never wait on one another's locks.
+ */
+typedef struct {
+    RingCell *cells;
+    size_t mask;        /* Number of cells - 1, number of cells is always a power of 2 */
+
+    char pad0[RING_CACHE_LINE];
+    size_t pushPos;
+    char pad1[RING_CACHE_LINE];
+    size_t popPos;
+    char pad2[RING_CACHE_LINE];
+
+} RingBuffer;
+
+
+/**
+ * RingBuffer_Init - Initialize #ring to hold at least #capacity items
+ *
+ *   Returns 0 on success, -1 on allocation failure.
+ */
+extern int RingBuffer_Init(RingBuffer *ring, size_t capacity);
+
+/**
+ * RingBuffer_Destroy - Free the cells of a ring initialized by RingBuffer_Init
+ */
+extern void RingBuffer_Destroy(RingBuffer *ring);
+
+/**
+ * RingBuffer_TryPush - Push #item on the end of #ring
+ *
+ *   Returns 1 if pushed, or 0 if the ring is full.
+ */
+extern int RingBuffer_TryPush(RingBuffer *ring, void *item);
+
+/**
+ * RingBuffer_TryPop - Pop the item from the front of #ring into #item
+ *
+ *   Returns 1 if popped, or 0 if the ring is empty.
+ */
+extern int RingBuffer_TryPop(RingBuffer *ring, void **item);
+
+/**
+ * RingBuffer_Push - Push #item, waiting (spinning, then yielding, then sleeping) while the ring is full
+ */
+extern void RingBuffer_Push(RingBuffer *ring, void *item);
+
+/**
+ * RingBuffer_Pop - Pop an item, waiting (spinning, then yielding, then sleeping) while the ring is empty
+ */
+extern void *RingBuffer_Pop(RingBuffer *ring);
+
+/**
+ * ringBackoff - Wait a little, for the #numAttempts'th time, before retrying a ring operation
+ */
+extern void ringBackoff(unsigned int numAttempts);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * shards.c - Splitting arrays into per-worker (and per-NUMA node) shards
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+
+#if defined(HAVE_LIBNUMA)
+  #include <numa.h>
+#endif
+
+#include "mtime_utils.h"
+
+#include "shards.h"
+#include "huge_alloc.h"
+
+/* Alignment of sharded arrays, and granularity of shard boundaries */
+#define SHARD_PAGE_SIZE 4096
+
+/*
+ * ShardWorkerArgs - Arguments passed to each worker thread
+ */
+typedef struct {
+    int shardIdx;
+    NameStatShard *shard;
+    ShardWorkerFunc func;
+    void *arg;
+
+} ShardWorkerArgs;
+
+int getNumCpus(void)
+{
+    long numCpus;
+
+    numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if ( numCpus < 1 )
+        return 1;
+
+    return (int)numCpus;
+}
+
+int getNumNumaNodes(void)
+{
+    #if defined(HAVE_LIBNUMA)
+      if ( numa_available() >= 0 )
+          return numa_max_node() + 1;
+    #endif
+
+    return 1;
+}
+
+/*
+ * gcd - Greatest common divisor
+ */
+static size_t gcd(size_t a, size_t b)
+{
+    size_t tmp;
+
+    while ( b != 0 )
+    {
+        tmp = a % b;
+        a = b;
+        b = tmp;
+    }
+
+    return a;
+}
+
+int splitShards(size_t numEntries, size_t entrySize, int numShards, NameStatShard *shards)
+{
+    size_t entriesPerPage, numUnits, unitsPerShard, cur;
+    int i, numNodes;
+
+    if ( numShards < 1 )
+        numShards = 1;
+
+    /* Smallest number of entries which spans a whole number of pages */
+    entriesPerPage = SHARD_PAGE_SIZE / gcd(entrySize, SHARD_PAGE_SIZE);
+
+    numUnits = (numEntries + entriesPerPage - 1) / entriesPerPage;
+    if ( numUnits < (size_t)numShards )
+        numShards = numUnits > 0 ? (int)numUnits : 1;
+
+    unitsPerShard = numUnits / numShards;
+
+    numNodes = getNumNumaNodes();
+
+    cur = 0;
+    for( i=0; i < numShards; i++ )
+    {
+        shards[i].start = cur;
+
+        /* Spread the remainder over the first shards */
+        cur += ( unitsPerShard + ( (size_t)i < numUnits % numShards ? 1 : 0 ) ) * entriesPerPage;
+        if ( cur > numEntries || i == numShards - 1 )
+            cur = numEntries;
+
+        shards[i].end = cur;
+
+        /* Consecutive shards share a node, so that neighbours are local to each other */
+        shards[i].node = numNodes > 1 ? (int)( ((long)i * numNodes) / numShards ) : -1;
+    }
+
+    return numShards;
+}
+
+void *allocShardedArray(size_t numEntries, size_t entrySize, int *numShards, NameStatShard *shards)
+{
+    void *ret;
+
+    *numShards = splitShards(numEntries, entrySize, *numShards, shards);
+
+    /* Always allocate at least one entry, callers may write a terminator.
+     *   Large arrays are aligned to, and advised for, huge pages (which are also page-aligned)
+     */
+    ret = hugeMalloc(entrySize * (numEntries + 1), SHARD_PAGE_SIZE);
+    if ( unlikely( ret == NULL ) )
+        return NULL;
+
+    #if defined(HAVE_LIBNUMA)
+    {
+        int i;
+
+        if ( *numShards > 1 && numa_available() >= 0 )
+        {
+            for( i=0; i < *numShards; i++ )
+            {
+                if ( shards[i].node >= 0 && shards[i].end > shards[i].start )
+                    numa_tonode_memory( (char *)ret + shards[i].start * entrySize, (shards[i].end - shards[i].start) * entrySize, shards[i].node );
+            }
+        }
+    }
+    #endif
+
+    return ret;
+}
+
+/*
+ * shardWorkerMain - Thread entry point for runShardWorkers
+ */
+static void *shardWorkerMain(void *_args)
+{
+    ShardWorkerArgs *args = (ShardWorkerArgs *)_args;
+
+    #if defined(HAVE_LIBNUMA)
+      if ( args->shard->node >= 0 )
+          numa_run_on_node(args->shard->node);
+    #endif
+
+    args->func(args->shardIdx, args->shard, args->arg);
+
+    return NULL;
+}
+
+void runShardWorkers(NameStatShard *shards, int numShards, ShardWorkerFunc func, void *arg)
+{
+    pthread_t *threads;
+    ShardWorkerArgs *workerArgs;
+    int i;
+
+    if ( numShards <= 1 )
+    {
+        func(0, &shards[0], arg);
+        return;
+    }
+
+    threads = malloc( sizeof(pthread_t) * numShards );
+    workerArgs = malloc( sizeof(ShardWorkerArgs) * numShards );
+
+    for( i=0; i < numShards; i++ )
+    {
+        workerArgs[i].shardIdx = i;
+        workerArgs[i].shard = &shards[i];
+        workerArgs[i].func = func;
+        workerArgs[i].arg = arg;
+
+        if ( unlikely( pthread_create(&threads[i], NULL, shardWorkerMain, &workerArgs[i]) != 0 ) )
+        {
+            /* Could not create a thread, do this shard's work here */
+            threads[i] = pthread_self();
+            shardWorkerMain(&workerArgs[i]);
+        }
+    }
+
+    for( i=0; i < numShards; i++ )
+    {
+        if ( !pthread_equal(threads[i], pthread_self()) )
+            pthread_join(threads[i], NULL);
+    }
+
+    free(workerArgs);
+    free(threads);
+}
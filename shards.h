@@ -0,0 +1,78 @@
+/**
+ * shards.h - Part of mtime_utils
+ *
+ *   Copyright (c) 2017 Timothy Savannah all rights reserved
+ *     Licensed under terms of the GNU General Purpose License (GPL) Version 3
+ */
+
+#ifndef _SHARDS_H
+#define _SHARDS_H
+
+#include <sys/types.h>
+
+/*
+ * NameStatShard - A contiguous range of a NameStat array, owned by a single worker thread.
+ *
+ *   Shard boundaries are page-aligned, so the pages of each shard are first touched
+ *     (and thus placed on the NUMA node of) the worker which owns it.
+ *     When built with libnuma (WITH_LIBNUMA=1), the range is additionally bound to #node
+ *     and the worker is run on that node.
+ */
+typedef struct {
+    size_t start;   /* First index within the array */
+    size_t end;     /* One past the last index */
+    int node;       /* NUMA node this shard is placed on, or -1 if not bound */
+
+} NameStatShard;
+
+/*
+ * ShardWorkerFunc - Function run by each worker of #runShardWorkers
+ *
+ *   shardIdx - Index of the shard this worker owns
+ *   arg      - The #arg passed to runShardWorkers
+ */
+typedef void (*ShardWorkerFunc)(int shardIdx, NameStatShard *shard, void *arg);
+
+
+/**
+ * getNumCpus - Get the number of online processors
+ */
+extern int getNumCpus(void);
+
+/**
+ * getNumNumaNodes - Get the number of NUMA nodes (1 if not built with libnuma, or not NUMA)
+ */
+extern int getNumNumaNodes(void);
+
+/**
+ * splitShards - Split #numEntries entries of #entrySize bytes each into #numShards shards,
+ *   with each boundary falling on a page boundary (for an array which is itself page-aligned),
+ *   and assign each shard a NUMA node.
+ *
+ *   Returns the number of shards actually used, which may be less than #numShards
+ *     for small arrays (but is always at least 1)
+ */
+extern int splitShards(size_t numEntries, size_t entrySize, int numShards, NameStatShard *shards);
+
+/**
+ * allocShardedArray - Allocate a page-aligned array of #numEntries entries of #entrySize bytes,
+ *   split into shards (see splitShards).
+ *
+ *   The memory is NOT touched, so that each shard's pages are placed by its worker.
+ *     When built with libnuma, each shard's range is bound to its node.
+ *
+ *   numShards - On input the requested number of shards, on output the number used.
+ *
+ *   Returns the array (to be released with free), or NULL on failure
+ */
+extern void *allocShardedArray(size_t numEntries, size_t entrySize, int *numShards, NameStatShard *shards);
+
+/**
+ * runShardWorkers - Run #func once per shard, each on its own thread (bound to the shard's node),
+ *   and wait for them all to complete.
+ *
+ *   With a single shard, #func is run on the calling thread.
+ */
+extern void runShardWorkers(NameStatShard *shards, int numShards, ShardWorkerFunc func, void *arg);
+
+#endif
@@ -0,0 +1,763 @@
+/*
+ * Copyright (c) 2017 Timothy Savannah under terms of GPLv3
+ *
+ * sort_keys.c - Composite-key sorting of NameStat objects
+ */
+
+#include <features.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "mtime_utils.h"
+
+#include "gather_mtimes.h"
+#include "sort_keys.h"
+
+/* Size of the runs insertion sorted by mergeSortTuples before merging */
+#define MERGE_SORT_RUN 16
+
+/* Tuning for chooseSortEngine */
+#define AUTO_RADIX_MIN_ENTRIES 65536    /* Always radix sort at least this many entries */
+#define AUTO_MERGE_MAX_ENTRIES 64       /* Always merge sort at most this many entries */
+#define AUTO_MERGE_PASS_COST 2          /* Cost of a merge pass relative to a radix pass */
+
+/* Flip the sign bit of signed values so they order correctly as unsigned */
+#define SIGNED_TO_ORDERED(_val) ( ((uint64_t)(_val)) ^ (((uint64_t)1) << 63) )
+
+void initSortKeyList(SortKeyList *keyList)
+{
+    keyList->keys[0].field = SORT_KEY_FIELD_TIME;
+    keyList->keys[0].isDescending = 0;
+    keyList->numKeys = 1;
+    keyList->timeField = -1;
+}
+
+int parseSortKeyList(const char *str, SortKeyList *keyList)
+{
+    char *strCopy, *token, *savePtr;
+    SortKeySpec *spec;
+    int timeField;
+    int ret = 0;
+
+    keyList->numKeys = 0;
+    keyList->timeField = -1;
+
+    strCopy = strdup(str);
+
+    for( token = strtok_r(strCopy, ",", &savePtr); token != NULL; token = strtok_r(NULL, ",", &savePtr) )
+    {
+        if ( keyList->numKeys == MAX_SORT_KEYS )
+        {
+            fprintf(stderr, "Too many sort keys (max %d): %s\n", MAX_SORT_KEYS, str);
+            ret = -1;
+            break;
+        }
+
+        spec = &keyList->keys[keyList->numKeys];
+        spec->isDescending = 0;
+
+        if ( *token == '-' )
+        {
+            spec->isDescending = 1;
+            token += 1;
+        }
+        else if ( *token == '+' )
+        {
+            token += 1;
+        }
+
+        if ( strcmp("time", token) == 0 )
+        {
+            spec->field = SORT_KEY_FIELD_TIME;
+        }
+        else if ( strcmp("size", token) == 0 )
+        {
+            spec->field = SORT_KEY_FIELD_SIZE;
+        }
+        else if ( strcmp("uid", token) == 0 )
+        {
+            spec->field = SORT_KEY_FIELD_UID;
+        }
+        else if ( strcmp("gid", token) == 0 )
+        {
+            spec->field = SORT_KEY_FIELD_GID;
+        }
+        else if ( (timeField = getTimeFieldByName(token)) >= 0 )
+        {
+            if ( keyList->timeField >= 0 && keyList->timeField != timeField )
+            {
+                fprintf(stderr, "Only one timestamp may be used as a sort key: %s\n", str);
+                ret = -1;
+                break;
+            }
+            keyList->timeField = timeField;
+            spec->field = SORT_KEY_FIELD_TIME;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown or unsupported sort key: %s\n", token);
+            ret = -1;
+            break;
+        }
+
+        keyList->numKeys += 1;
+    }
+
+    if ( ret == 0 && keyList->numKeys == 0 )
+    {
+        fprintf(stderr, "No sort keys given: %s\n", str);
+        ret = -1;
+    }
+
+    free(strCopy);
+
+    return ret;
+}
+
+int getSortKeyListNeedFields(const SortKeyList *keyList)
+{
+    int i;
+    int needFields = NEED_FIELD_NONE;
+
+    for( i=0; i < keyList->numKeys; i++ )
+    {
+        switch( keyList->keys[i].field )
+        {
+            case SORT_KEY_FIELD_SIZE:
+                needFields |= NEED_FIELD_SIZE;
+                break;
+            case SORT_KEY_FIELD_UID:
+                needFields |= NEED_FIELD_UID;
+                break;
+            case SORT_KEY_FIELD_GID:
+                needFields |= NEED_FIELD_GID;
+                break;
+        }
+    }
+
+    return needFields;
+}
+
+/*
+ * getKeyValue - Get the value of #field for #nameStat, mapped to an unsigned
+ *   value which orders the same as the original.
+ */
+static inline uint64_t getKeyValue(const NameStat *nameStat, int field)
+{
+    switch( field )
+    {
+        case SORT_KEY_FIELD_SIZE:
+            return SIGNED_TO_ORDERED(nameStat->statBuf.st_size);
+        case SORT_KEY_FIELD_UID:
+            return (uint64_t)nameStat->statBuf.st_uid;
+        case SORT_KEY_FIELD_GID:
+            return (uint64_t)nameStat->statBuf.st_gid;
+        default:
+            return SIGNED_TO_ORDERED(nameStat->fileTime.tv_sec);
+    }
+}
+
+/*
+ * numBits - Return the number of bits required to hold #value
+ */
+static inline int numBits(uint64_t value)
+{
+    int bits = 0;
+
+    while ( value != 0 )
+    {
+        bits += 1;
+        value >>= 1;
+    }
+
+    return bits;
+}
+
+/*
+ * putBits - OR #width bits of #value into #tuple (of #numWords words, most significant first)
+ *   starting at bit #bitPos (counted from the least significant bit of the whole tuple)
+ */
+static inline void putBits(uint64_t *tuple, int numWords, int bitPos, int width, uint64_t value)
+{
+    int wordIdx, bitInWord, bitsHere;
+
+    while ( width > 0 )
+    {
+        wordIdx = numWords - 1 - (bitPos / 64);
+        bitInWord = bitPos % 64;
+
+        bitsHere = 64 - bitInWord;
+        if ( bitsHere > width )
+            bitsHere = width;
+
+        tuple[wordIdx] |= value << bitInWord;
+
+        /* Shift in two steps, as shifting a 64-bit value by 64 is undefined */
+        value = (value >> (bitsHere / 2)) >> (bitsHere - (bitsHere / 2));
+        bitPos += bitsHere;
+        width -= bitsHere;
+    }
+}
+
+/*
+ * radixSortTuples - LSD radix sort #numTuples tuples, each of #numWords 64-bit words
+ *   (most significant word first), of which only the low #totalBits bits are used.
+ *
+ *   Passes where every tuple has the same byte are skipped.
+ *
+ *   Returns 0 on success, -1 on allocation failure.
+ */
+static int radixSortTuples(uint64_t *tuples, size_t numTuples, int numWords, int totalBits)
+{
+    uint64_t *src, *dst, *tmp;
+    size_t counts[256];
+    size_t i, pos, sum;
+    int wordIdx, shift, bitPos;
+    unsigned int byteVal;
+
+    tmp = malloc( sizeof(uint64_t) * numWords * numTuples );
+    if ( unlikely( tmp == NULL ) )
+        return -1;
+
+    src = tuples;
+    dst = tmp;
+
+    for( bitPos = 0; bitPos < totalBits; bitPos += 8 )
+    {
+        wordIdx = numWords - 1 - (bitPos / 64);
+        shift = bitPos % 64;
+
+        memset(counts, 0x0, sizeof(counts));
+
+        for( i=0; i < numTuples; i++ )
+            counts[ (src[i * numWords + wordIdx] >> shift) & 0xFF ] += 1;
+
+        /* All tuples share this byte, nothing to do for this pass */
+        if ( counts[ (src[wordIdx] >> shift) & 0xFF ] == numTuples )
+            continue;
+
+        sum = 0;
+        for( i=0; i < 256; i++ )
+        {
+            pos = counts[i];
+            counts[i] = sum;
+            sum += pos;
+        }
+
+        for( i=0; i < numTuples; i++ )
+        {
+            byteVal = (src[i * numWords + wordIdx] >> shift) & 0xFF;
+            pos = counts[byteVal]++;
+
+            memcpy(&dst[pos * numWords], &src[i * numWords], sizeof(uint64_t) * numWords);
+        }
+
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if ( src != tuples )
+    {
+        memcpy(tuples, src, sizeof(uint64_t) * numWords * numTuples);
+        free(src);
+    }
+    else
+    {
+        free(dst);
+    }
+
+    return 0;
+}
+
+static const char *SORT_ENGINE_NAMES[] = { "auto", "radix", "merge" };
+
+int getSortEngineByName(const char *name)
+{
+    int i;
+
+    for( i=0; i < sizeof(SORT_ENGINE_NAMES) / sizeof(SORT_ENGINE_NAMES[0]); i++ )
+    {
+        if ( strcmp(SORT_ENGINE_NAMES[i], name) == 0 )
+            return i;
+    }
+
+    return -1;
+}
+
+const char *getSortEngineName(int sortEngine)
+{
+    return SORT_ENGINE_NAMES[sortEngine];
+}
+
+/*
+ * chooseSortEngine - Pick the sort engine for SORT_ENGINE_AUTO
+ *
+ *   A radix sort makes one pass over every tuple per byte of the tuple's width, while a merge
+ *     sort makes about log2(n) (more costly) passes. Merge sort wins only for very few entries,
+ *     or keys so wide that the radix passes outnumber the merge passes.
+ */
+static int chooseSortEngine(size_t numPerShard, int totalBits)
+{
+    int numRadixPasses;
+
+    numRadixPasses = (totalBits + 7) / 8;
+
+    if ( numPerShard >= AUTO_RADIX_MIN_ENTRIES )
+        return SORT_ENGINE_RADIX;
+
+    if ( numPerShard <= AUTO_MERGE_MAX_ENTRIES || numBits(numPerShard) * AUTO_MERGE_PASS_COST < numRadixPasses )
+        return SORT_ENGINE_MERGE;
+
+    return SORT_ENGINE_RADIX;
+}
+
+/* State used by the name tiebreak compare function */
+static NameStat *tiebreakNameStats;
+
+/**
+ * compare_index_name - Function called by qsort for comparing two indexes into #tiebreakNameStats
+ *   by filename, then by index.
+ */
+static int compare_index_name(const void *_idx1, const void *_idx2)
+{
+    size_t idx1, idx2;
+    int ret;
+
+    idx1 = *(const size_t *)_idx1;
+    idx2 = *(const size_t *)_idx2;
+
+    ret = strcmp(tiebreakNameStats[idx1].fname, tiebreakNameStats[idx2].fname);
+    if ( ret != 0 )
+        return ret;
+
+    return (idx1 > idx2) - (idx1 < idx2);
+}
+
+/*
+ * keysEqual - Check if two NameStats have equal values for every key in #keyList
+ */
+static inline int keysEqual(const NameStat *nameStat1, const NameStat *nameStat2, const SortKeyList *keyList)
+{
+    int k;
+
+    for( k=0; k < keyList->numKeys; k++ )
+    {
+        if ( getKeyValue(nameStat1, keyList->keys[k].field) != getKeyValue(nameStat2, keyList->keys[k].field) )
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * compareTuples - Compare two tuples of #numWords words, most significant first
+ */
+static inline int compareTuples(const uint64_t *tuple1, const uint64_t *tuple2, int numWords)
+{
+    int i;
+
+    for( i=0; i < numWords; i++ )
+    {
+        if ( tuple1[i] != tuple2[i] )
+            return tuple1[i] < tuple2[i] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/*
+ * mergeTuples - Merge two sorted tuple arrays into #dst
+ */
+static void mergeTuples(uint64_t *dst, const uint64_t *src1, size_t num1, const uint64_t *src2, size_t num2, int numWords)
+{
+    size_t i1 = 0, i2 = 0;
+    size_t tupleSize = sizeof(uint64_t) * numWords;
+
+    while ( i1 < num1 && i2 < num2 )
+    {
+        if ( compareTuples(&src1[i1 * numWords], &src2[i2 * numWords], numWords) <= 0 )
+        {
+            memcpy(dst, &src1[i1 * numWords], tupleSize);
+            i1 += 1;
+        }
+        else
+        {
+            memcpy(dst, &src2[i2 * numWords], tupleSize);
+            i2 += 1;
+        }
+        dst += numWords;
+    }
+
+    memcpy(dst, &src1[i1 * numWords], tupleSize * (num1 - i1));
+    dst += numWords * (num1 - i1);
+    memcpy(dst, &src2[i2 * numWords], tupleSize * (num2 - i2));
+}
+
+/*
+ * mergeSortTuples - Stable bottom-up merge sort of #numTuples tuples of #numWords words
+ *
+ *   Cheaper than radixSortTuples when there are few tuples relative to the number of
+ *     radix passes their width requires.
+ *
+ *   Returns 0 on success, -1 on allocation failure.
+ */
+static int mergeSortTuples(uint64_t *tuples, size_t numTuples, int numWords)
+{
+    uint64_t *src, *dst, *tmp;
+    uint64_t key[MAX_SORT_KEYS + 1];   /* A tuple is at most a word per key, plus the index */
+    size_t tupleSize = sizeof(uint64_t) * numWords;
+    size_t i, j, runStart, width, mid, runEnd;
+
+    /* Insertion sort runs of MERGE_SORT_RUN tuples */
+    for( runStart = 0; runStart < numTuples; runStart += MERGE_SORT_RUN )
+    {
+        runEnd = runStart + MERGE_SORT_RUN;
+        if ( runEnd > numTuples )
+            runEnd = numTuples;
+
+        for( i=runStart + 1; i < runEnd; i++ )
+        {
+            memcpy(key, &tuples[i * numWords], tupleSize);
+            for( j=i; j > runStart && compareTuples(&tuples[(j - 1) * numWords], key, numWords) > 0; j-- )
+                memcpy(&tuples[j * numWords], &tuples[(j - 1) * numWords], tupleSize);
+            memcpy(&tuples[j * numWords], key, tupleSize);
+        }
+    }
+
+    if ( numTuples <= MERGE_SORT_RUN )
+        return 0;
+
+    tmp = malloc( tupleSize * numTuples );
+    if ( unlikely( tmp == NULL ) )
+        return -1;
+
+    src = tuples;
+    dst = tmp;
+
+    for( width = MERGE_SORT_RUN; width < numTuples; width *= 2 )
+    {
+        for( runStart = 0; runStart < numTuples; runStart += 2 * width )
+        {
+            mid = runStart + width;
+            if ( mid > numTuples )
+                mid = numTuples;
+            runEnd = runStart + 2 * width;
+            if ( runEnd > numTuples )
+                runEnd = numTuples;
+
+            mergeTuples(&dst[runStart * numWords], &src[runStart * numWords], mid - runStart, &src[mid * numWords], runEnd - mid, numWords);
+        }
+
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if ( src != tuples )
+    {
+        memcpy(tuples, src, tupleSize * numTuples);
+        free(src);
+    }
+    else
+    {
+        free(dst);
+    }
+
+    return 0;
+}
+
+/*
+ * ShardSortState - Per-shard state of a sharded sort
+ */
+typedef struct {
+    uint64_t minVals[MAX_SORT_KEYS];
+    uint64_t maxVals[MAX_SORT_KEYS];
+    size_t numValid;
+
+    uint64_t *tuples;   /* Packed and sorted tuples of this shard, allocated by its worker */
+    int failed;
+
+} ShardSortState;
+
+/*
+ * SortContext - State shared by all workers of a sharded sort
+ */
+typedef struct {
+    NameStat *nameStats;
+    const SortKeyList *keyList;
+    ShardSortState *states;
+
+    /* Packing layout, common to all shards */
+    uint64_t minVals[MAX_SORT_KEYS];
+    uint64_t maxVals[MAX_SORT_KEYS];
+    int widths[MAX_SORT_KEYS];
+    int isDescending[MAX_SORT_KEYS];
+    int idxBits;
+    int totalBits;
+    int numWords;
+
+    int sortEngine;     /* SORT_ENGINE_RADIX or SORT_ENGINE_MERGE */
+
+} SortContext;
+
+/*
+ * rangeShardWorker - Gather the number of valid entries, and range of each key, within a shard
+ */
+static void rangeShardWorker(int shardIdx, NameStatShard *shard, void *_ctx)
+{
+    SortContext *ctx = (SortContext *)_ctx;
+    ShardSortState *state = &ctx->states[shardIdx];
+    const SortKeyList *keyList = ctx->keyList;
+    uint64_t value;
+    size_t i;
+    int k;
+
+    state->numValid = 0;
+
+    for( i=shard->start; i < shard->end; i++ )
+    {
+        if ( unlikely( !NAMESTAT_IS_VALID(&ctx->nameStats[i]) ) )
+            continue;
+
+        for( k=0; k < keyList->numKeys; k++ )
+        {
+            value = getKeyValue(&ctx->nameStats[i], keyList->keys[k].field);
+            if ( state->numValid == 0 || value < state->minVals[k] )
+                state->minVals[k] = value;
+            if ( state->numValid == 0 || value > state->maxVals[k] )
+                state->maxVals[k] = value;
+        }
+
+        state->numValid += 1;
+    }
+}
+
+/*
+ * packShardWorker - Pack the valid entries of a shard into tuples (in memory local
+ *   to this worker), and sort them.
+ */
+static void packShardWorker(int shardIdx, NameStatShard *shard, void *_ctx)
+{
+    SortContext *ctx = (SortContext *)_ctx;
+    ShardSortState *state = &ctx->states[shardIdx];
+    const SortKeyList *keyList = ctx->keyList;
+    uint64_t value, *tuple;
+    size_t i;
+    int k, bitPos;
+
+    state->tuples = NULL;
+    state->failed = 0;
+
+    if ( state->numValid == 0 )
+        return;
+
+    state->tuples = calloc( state->numValid * ctx->numWords, sizeof(uint64_t) );
+    if ( unlikely( state->tuples == NULL ) )
+    {
+        state->failed = 1;
+        return;
+    }
+
+    /* Most significant key in the highest bits, index in the lowest. */
+    tuple = state->tuples;
+    for( i=shard->start; i < shard->end; i++ )
+    {
+        if ( unlikely( !NAMESTAT_IS_VALID(&ctx->nameStats[i]) ) )
+            continue;
+
+        putBits(tuple, ctx->numWords, 0, ctx->idxBits, (uint64_t)i);
+
+        bitPos = ctx->totalBits;
+        for( k=0; k < keyList->numKeys; k++ )
+        {
+            bitPos -= ctx->widths[k];
+
+            value = getKeyValue(&ctx->nameStats[i], keyList->keys[k].field);
+            if ( ctx->isDescending[k] )
+                value = ctx->maxVals[k] - value;
+            else
+                value = value - ctx->minVals[k];
+
+            putBits(tuple, ctx->numWords, bitPos, ctx->widths[k], value);
+        }
+
+        tuple += ctx->numWords;
+    }
+
+    if ( ctx->sortEngine == SORT_ENGINE_MERGE )
+    {
+        if ( unlikely( mergeSortTuples(state->tuples, state->numValid, ctx->numWords) < 0 ) )
+            state->failed = 1;
+    }
+    else
+    {
+        if ( unlikely( radixSortTuples(state->tuples, state->numValid, ctx->numWords, ctx->totalBits) < 0 ) )
+            state->failed = 1;
+    }
+}
+
+size_t *sortNameStatIndexes(NameStat *nameStats, size_t numEntries, NameStatShard *shards, int numShards, const SortKeyList *keyList, int isReverse, int tiebreak, int *sortEngine, size_t *numSorted)
+{
+    SortContext ctx;
+    ShardSortState *states;
+    NameStatShard wholeShard;
+    uint64_t idxMask, *merged;
+    size_t *ret;
+    size_t i, numValid, runStart, numMerged;
+    int k, s, numLists, failed;
+
+    *numSorted = 0;
+
+    if ( shards == NULL || numShards < 1 )
+    {
+        wholeShard.start = 0;
+        wholeShard.end = numEntries;
+        wholeShard.node = -1;
+
+        shards = &wholeShard;
+        numShards = 1;
+    }
+
+    states = calloc( numShards, sizeof(ShardSortState) );
+
+    ctx.nameStats = nameStats;
+    ctx.keyList = keyList;
+    ctx.states = states;
+
+    /* Gather the range of each key over the valid entries, shard-locally, then combine */
+    runShardWorkers(shards, numShards, rangeShardWorker, &ctx);
+
+    numValid = 0;
+    for( s=0; s < numShards; s++ )
+    {
+        if ( states[s].numValid == 0 )
+            continue;
+
+        for( k=0; k < keyList->numKeys; k++ )
+        {
+            if ( numValid == 0 || states[s].minVals[k] < ctx.minVals[k] )
+                ctx.minVals[k] = states[s].minVals[k];
+            if ( numValid == 0 || states[s].maxVals[k] > ctx.maxVals[k] )
+                ctx.maxVals[k] = states[s].maxVals[k];
+        }
+
+        numValid += states[s].numValid;
+    }
+
+    ret = malloc( sizeof(size_t) * (numValid + 1) );
+    if ( unlikely( ret == NULL ) || numValid == 0 )
+    {
+        free(states);
+        return ret;
+    }
+
+    /* Each key only needs as many bits as its range of values */
+    ctx.idxBits = numBits(numEntries - 1);
+    ctx.totalBits = ctx.idxBits;
+    for( k=0; k < keyList->numKeys; k++ )
+    {
+        ctx.widths[k] = numBits(ctx.maxVals[k] - ctx.minVals[k]);
+        ctx.isDescending[k] = keyList->keys[k].isDescending ^ (isReverse ? 1 : 0);
+        ctx.totalBits += ctx.widths[k];
+    }
+
+    ctx.numWords = ctx.totalBits / 64 + ( (ctx.totalBits % 64) ? 1 : 0 );
+    if ( ctx.numWords == 0 )
+        ctx.numWords = 1;
+
+    if ( *sortEngine == SORT_ENGINE_AUTO )
+        *sortEngine = chooseSortEngine(numValid / numShards, ctx.totalBits);
+    ctx.sortEngine = *sortEngine;
+
+    /* Pack and sort each shard locally */
+    runShardWorkers(shards, numShards, packShardWorker, &ctx);
+
+    failed = 0;
+    numLists = 0;
+    for( s=0; s < numShards; s++ )
+    {
+        failed |= states[s].failed;
+
+        /* Compact the non-empty lists to the front */
+        if ( states[s].numValid != 0 )
+            states[numLists++] = states[s];
+    }
+
+    /* Merge the shards' sorted tuples in pairs, until a single list remains */
+    while ( !failed && numLists > 1 )
+    {
+        for( s=0; s + 1 < numLists; s += 2 )
+        {
+            numMerged = states[s].numValid + states[s + 1].numValid;
+
+            merged = malloc( sizeof(uint64_t) * ctx.numWords * numMerged );
+            if ( unlikely( merged == NULL ) )
+            {
+                failed = 1;
+                break;
+            }
+
+            mergeTuples(merged, states[s].tuples, states[s].numValid, states[s + 1].tuples, states[s + 1].numValid, ctx.numWords);
+
+            free(states[s].tuples);
+            free(states[s + 1].tuples);
+
+            states[s / 2].tuples = merged;
+            states[s / 2].numValid = numMerged;
+        }
+
+        if ( failed )
+            break;
+
+        if ( numLists % 2 )
+            states[numLists / 2] = states[numLists - 1];
+
+        numLists = (numLists + 1) / 2;
+    }
+
+    if ( unlikely( failed ) )
+    {
+        for( s=0; s < numLists; s++ )
+            free(states[s].tuples);
+        free(states);
+        free(ret);
+        return NULL;
+    }
+
+    /* The index is held in the low bits of the last word
+     *   ( The index is never wider than 63 bits )
+     */
+    idxMask = ctx.idxBits == 0 ? 0 : ( ~((uint64_t)0) >> (64 - ctx.idxBits) );
+    for( i=0; i < numValid; i++ )
+        ret[i] = (size_t)( states[0].tuples[i * ctx.numWords + ctx.numWords - 1] & idxMask );
+
+    free(states[0].tuples);
+    free(states);
+
+    if ( tiebreak == TIEBREAK_NAME )
+    {
+        /* Runs of equal keys are in input order, reorder each by name */
+        tiebreakNameStats = nameStats;
+
+        runStart = 0;
+        for( i=1; i <= numValid; i++ )
+        {
+            if ( i == numValid || !keysEqual(&nameStats[ret[runStart]], &nameStats[ret[i]], keyList) )
+            {
+                if ( i - runStart > 1 )
+                    qsort( &ret[runStart], i - runStart, sizeof(size_t), compare_index_name );
+                runStart = i;
+            }
+        }
+    }
+
+    *numSorted = numValid;
+
+    return ret;
+}
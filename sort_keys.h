@@ -0,0 +1,131 @@
+/**
+ * sort_keys.h - Part of mtime_utils
+ *
+ *   Copyright (c) 2017 Timothy Savannah all rights reserved
+ *     Licensed under terms of the GNU General Purpose License (GPL) Version 3
+ */
+
+#ifndef _SORT_KEYS_H
+#define _SORT_KEYS_H
+
+#include <sys/types.h>
+
+#include "gather_mtimes.h"
+#include "shards.h"
+
+/*
+ * Sort key fields - Attributes of a NameStat which may be sorted upon
+ */
+#define SORT_KEY_FIELD_TIME 0   /* NameStat.fileTime (seconds) */
+#define SORT_KEY_FIELD_SIZE 1
+#define SORT_KEY_FIELD_UID  2
+#define SORT_KEY_FIELD_GID  3
+
+/* Maximum number of keys in a --key list */
+#define MAX_SORT_KEYS 8
+
+/*
+ * Tiebreak modes - How entries with equal keys are ordered.
+ *
+ *   Ordering is always stable. TIEBREAK_INPUT orders ties by position in the input,
+ *     TIEBREAK_NAME orders ties by filename, then by position in the input.
+ */
+#define TIEBREAK_INPUT 0
+#define TIEBREAK_NAME  1
+
+/*
+ * Sort engines - How the packed tuples of each shard are sorted
+ *
+ *   SORT_ENGINE_AUTO picks one by the number of entries and the width of the packed keys.
+ */
+#define SORT_ENGINE_AUTO  0
+#define SORT_ENGINE_RADIX 1   /* LSD radix sort, one pass per byte of key width */
+#define SORT_ENGINE_MERGE 2   /* Merge sort, about log2(n) passes */
+
+/*
+ * SortKeySpec - A single key of a composite sort
+ */
+typedef struct {
+    int field;          /* One of SORT_KEY_FIELD_* */
+    int isDescending;
+
+} SortKeySpec;
+
+/*
+ * SortKeyList - A composite sort, most significant key first.
+ */
+typedef struct {
+    SortKeySpec keys[MAX_SORT_KEYS];
+    int numKeys;
+
+    /* The TIME_FIELD_* named in the list (e.x. "ctime"), or -1 if only
+     *   the generic "time" (or no time key) was used
+     */
+    int timeField;
+
+} SortKeyList;
+
+
+/**
+ * initSortKeyList - Initialize #keyList to the default sort, ascending by time.
+ */
+extern void initSortKeyList(SortKeyList *keyList);
+
+/**
+ * parseSortKeyList - Parse a comma-separated list of keys into #keyList
+ *
+ *   Each key is one of: time, mtime, atime, ctime, btime, size, uid, gid
+ *     and may be prefixed with '-' for descending order (or '+' for ascending, the default).
+ *
+ *   "time" is the timestamp selected by --time. Only one timestamp may be used in a single list.
+ *
+ *   Returns 0 on success, otherwise prints an error to stderr and returns -1
+ */
+extern int parseSortKeyList(const char *str, SortKeyList *keyList);
+
+/**
+ * getSortKeyListNeedFields - Get the NEED_FIELD_* bitmask required to sort by #keyList
+ */
+extern int getSortKeyListNeedFields(const SortKeyList *keyList);
+
+/**
+ * sortNameStatIndexes - Sort the valid entries (see NAMESTAT_IS_VALID) of #nameStats
+ *
+ *   Each entry's keys are packed into a fixed-width tuple of 64-bit words
+ *     (each key using only as many bits as the range of its values requires),
+ *     with the entry's index in the lowest bits, and the tuples are sorted by #sortEngine.
+ *
+ *   Because the index is unique the sort is stable, with ties broken by input position,
+ *     and a composite key costs no more than a single key of the same total width.
+ *
+ *   shards    - If more than one, each shard (see ReadNameStatBuffers.shards) is packed and sorted
+ *                 by its own worker, in memory local to that worker, and the results are merged.
+ *                 May be NULL to sort the whole array on the calling thread.
+ *
+ *   keyList   - The keys to sort by
+ *
+ *   isReverse - If 1, every key's direction is inverted. Ties remain ordered by #tiebreak.
+ *
+ *   tiebreak  - One of TIEBREAK_*
+ *
+ *   sortEngine - One of SORT_ENGINE_*. If SORT_ENGINE_AUTO, will be set to the engine chosen.
+ *
+ *   numSorted - Will be filled with the number of valid entries (size of return)
+ *
+ *   Returns a malloc'd array of indexes into #nameStats, in sorted order, or NULL on allocation failure.
+ */
+extern size_t *sortNameStatIndexes(NameStat *nameStats, size_t numEntries, NameStatShard *shards, int numShards, const SortKeyList *keyList, int isReverse, int tiebreak, int *sortEngine, size_t *numSorted);
+
+/**
+ * getSortEngineByName - Get the SORT_ENGINE_* value associated with a name ( "auto", "radix" or "merge" )
+ *
+ *   Returns -1 if name is not a known engine.
+ */
+extern int getSortEngineByName(const char *name);
+
+/**
+ * getSortEngineName - Get the name associated with a SORT_ENGINE_* value
+ */
+extern const char *getSortEngineName(int sortEngine);
+
+#endif
@@ -16,9 +16,48 @@
 #include "mtime_utils.h"
 
 #include "gather_mtimes.h"
+#include "sort_keys.h"
+#include "records.h"
+#include "partition_writer.h"
+#include "path_store.h"
+#include "ordered_output.h"
 
 #define ERROR_ALLOC_MEMORY 12
 
+/* With --auto, fewest files for which sorting in parallel (one worker per shard) pays off */
+#define AUTO_SHARDED_SORT_MIN_ENTRIES 65536
+
+/*
+ * SortMtimeOptions - Options parsed from the commandline
+ */
+typedef struct {
+    int isReverse;
+    int tiebreak;       /* One of TIEBREAK_* */
+    int sortEngine;     /* One of SORT_ENGINE_*, or -1 if not given (radix, or auto with --auto) */
+    int timeField;      /* One of TIME_FIELD_* */
+    SortKeyList keyList;
+    int isRecords;      /* Output a binary records stream (see records.h) */
+    int inputFormat;    /* One of INPUT_FORMAT_* */
+    int isCompactPaths; /* Hold paths as (directory, base name) in a PathStore, rather than the input */
+    PartitionOptions partition;
+    GatherOptions gather;
+
+} SortMtimeOptions;
+
+/*
+ * CompactNameStats - The valid entries of the input, with each fname being a base name
+ *   in #store, within the directory #dirIds[i]. See --compact-paths
+ */
+typedef struct {
+    NameStat *nameStats;
+    uint32_t *dirIds;
+    size_t numEntries;
+    size_t capacity;
+
+    PathStore *store;
+
+} CompactNameStats;
+
 static const volatile char* APP_NAME = "sort_mtime";
 
 /*
@@ -26,42 +65,324 @@ static const volatile char* APP_NAME = "sort_mtime";
  */
 static void printUsage(void)
 {
-    fputs("Usage: sort_mtime (Options)\n  Takes input of filenames on stdin, sorts based on mtime, and prints to stdout\n\n", stderr);
+    fputs("Usage: sort_mtime (Options) [list files...]\n  Takes input of filenames on stdin (or [list files]), sorts based on mtime, and prints to stdout\n\n", stderr);
     fputs("    Options:\n\n", stderr);
+    fputs("      --time=X   Sort by timestamp X instead of mtime. X is one of:\n", stderr);
+    fputs("                   mtime - Modification time (default)\n", stderr);
+    fputs("                   atime - Access time\n", stderr);
+    fputs("                   ctime - Status (metadata) change time\n", stderr);
+    fputs("                   btime - Birth (creation) time, where supported by the filesystem\n\n", stderr);
     fputs("      -r         Reverse. Show newest on top. Default is newest on bottom.\n\n", stderr);
+    fputs("      --tiebreak=X  How to order files with equal mtimes. X is one of:\n", stderr);
+    fputs("                      input - Keep the order they were given on stdin (default)\n", stderr);
+    fputs("                      name  - Order by filename (byte order), then input order\n\n", stderr);
+    fputs("      --key=X    Sort by a comma-separated list of keys, most significant first.\n", stderr);
+    fputs("                   Keys are: time (the --time field), mtime, atime, ctime, btime,\n", stderr);
+    fputs("                   size, uid, gid. Prefix a key with - to sort it descending.\n", stderr);
+    fputs("                   Default is \"time\". Example: --key=mtime,-size\n\n", stderr);
+    fputs("      --sort=X   How to sort. X is one of:\n", stderr);
+    fputs("                   radix - Radix sort on the packed keys (default)\n", stderr);
+    fputs("                   merge - Merge sort, faster for very few files, or very wide keys\n", stderr);
+    fputs("                   auto  - Choose by number of files and key width (default with --auto)\n\n", stderr);
+    fputs("      --output=X Output format. X is one of:\n", stderr);
+    fputs("                   text    - Filenames, one per line (default)\n", stderr);
+    fputs("                   records - Binary record stream of path, time (ns), uid, gid, size and mode,\n", stderr);
+    fputs("                               which get_mtime, get_owner and get_group read without\n", stderr);
+    fputs("                               stat'ing the files again. See records.h for the format.\n\n", stderr);
+    fputs("      --input=X  Input format. X is one of:\n", stderr);
+    fputs("                   list  - One filename per line, each of which is stat'd (default)\n", stderr);
+    fputs("                   epoch - An epoch time (with optional fraction), a space, then a filename\n", stderr);
+    fputs("                             per line, e.x. from find -printf '%T@ %p\\n'. Nothing is stat'd,\n", stderr);
+    fputs("                             so only the time is known. Use --time to label which time it is.\n\n", stderr);
+    fputs("      --compact-paths  Hold each directory once, and each file as just its base name within it,\n", stderr);
+    fputs("                         rather than keeping all of the input. Uses far less memory for\n", stderr);
+    fputs("                         large lists from find. Cannot be combined with --tiebreak=name.\n\n", stderr);
+    printPartitionUsage();
+    printGatherUsage();
     fputs("      --help     Print this help message.\n\n", stderr);
     fputs("      --version  Show version information\n\n", stderr);
-    fputs("Example:  find . -name '*.gcda' | sort_mtime\n\n", stderr);
+    fputs("Input may be a list of filenames, or a binary record stream (as written by get_mtime --output=records),\n  in which case files are not stat'd again.\n\n", stderr);
+    fputs("Example:  find . -name '*.gcda' | sort_mtime\n", stderr);
+    fputs("          find . -name '*.gcda' | sort_mtime --output=records | get_mtime\n\n", stderr);
+}
+
+
+
+/*
+ * SortedOutput - Passed to formatSortedName and formatSortedRecord by writeFormattedInOrder
+ */
+typedef struct {
+    const NameStat *nameStats;
+    const size_t *sortedIdxs;
+    const CompactNameStats *compact;    /* If set, paths are joined from here */
+
+} SortedOutput;
+
+/*
+ * appendPath - Append the full path of entry #idx to #out
+ */
+static inline void appendPath(OutBuffer *out, const SortedOutput *output, size_t idx)
+{
+    const char *dir, *fname;
+
+    fname = output->nameStats[idx].fname;
+
+    if ( output->compact != NULL )
+    {
+        dir = PathStore_GetDir(output->compact->store, output->compact->dirIds[idx]);
+        OutBuffer_Append(out, dir, strlen(dir));
+    }
+
+    OutBuffer_Append(out, fname, strlen(fname));
 }
 
+/*
+ * formatSortedName - Append the path of the #sortedPos'th sorted entry, and a newline, to #out
+ */
+static void formatSortedName(size_t sortedPos, OutBuffer *out, void *_output)
+{
+    SortedOutput *output = (SortedOutput *)_output;
+
+    appendPath(out, output, output->sortedIdxs[sortedPos]);
+    OutBuffer_Append(out, "\n", 1);
+}
+
+/*
+ * formatSortedRecord - Append the #sortedPos'th sorted entry as a record to #out
+ */
+static void formatSortedRecord(size_t sortedPos, OutBuffer *out, void *_output)
+{
+    SortedOutput *output = (SortedOutput *)_output;
+    size_t idx, pathLen;
+
+    idx = output->sortedIdxs[sortedPos];
 
+    pathLen = strlen(output->nameStats[idx].fname);
+    if ( output->compact != NULL )
+        pathLen += strlen( PathStore_GetDir(output->compact->store, output->compact->dirIds[idx]) );
+
+    encodeRecordFixed( (unsigned char *)OutBuffer_Reserve(out, RECORD_FIXED_SIZE), &output->nameStats[idx], pathLen );
+    out->len += RECORD_FIXED_SIZE;
+
+    appendPath(out, output, idx);
+}
+
+/*
+ * writePartitionHeader - Start each --output=records partition file with the header
+ */
+static void writePartitionHeader(FILE *file, void *_buffers)
+{
+    ReadNameStatBuffers *buffers = (ReadNameStatBuffers *)_buffers;
+
+    writeRecordsHeader(file, buffers->timeField, buffers->gatheredFields);
+}
 
 /**
- * compare_NameStat_mtime - Function called by qsort for comparing two NameStat objects.
+ * writePartitioned - Write the #numSorted sorted entries of #output into the --partition-by files,
+ *   so each file is itself sorted.
+ *
+ *   Returns 0 on success, or -1 if the files could not all be written.
+ */
+static int writePartitioned(const SortedOutput *output, size_t numSorted, ReadNameStatBuffers *buffers, const SortMtimeOptions *options)
+{
+    PartitionWriter *writer;
+    OutBuffer out;
+    size_t i;
+
+    writer = PartitionWriter_New(&options->partition, options->isRecords ? ".records" : ".txt",
+        options->isRecords ? writePartitionHeader : NULL, buffers);
+    if ( writer == NULL )
+        return -1;
+
+    OutBuffer_Init(&out);
+
+    for( i=0; i < numSorted; i++ )
+    {
+        out.len = 0;
+        if ( options->isRecords )
+            formatSortedRecord(i, &out, (void *)output);
+        else
+            formatSortedName(i, &out, (void *)output);
+
+        PartitionWriter_Write(writer, output->nameStats[ output->sortedIdxs[i] ].fileTime.tv_sec, out.data, out.len);
+    }
+
+    if ( options->gather.showStats )
+    {
+        fprintf(stderr, "stats: partitions: files=%zu reopens=%zu max_open=%d\n",
+            writer->numFiles, writer->numReopens, writer->maxOpen);
+    }
+
+    OutBuffer_Free(&out);
+
+    return PartitionWriter_Free(writer);
+}
+
+/**
+ * sortAndPrint - Sort the valid entries in #nameStats by the keys in #options, and print them.
+ *
+ *   Oldest (smallest) is printed first, unless isReverse is set in which case newest is first.
+ *
+ *   Ordering is stable. Entries with equal keys are always printed
+ *     in the order given by the tiebreak (see TIEBREAK_* ), regardless of isReverse.
+ *
+ *   Entries which could not be stat'd (see NAMESTAT_IS_VALID) are skipped.
+ *
+ *   If isRecords is set, a records stream is written carrying the gathered fields (see records.h)
+ *
+ *   If #compact is not NULL, the entries are those of #compact, and paths are joined from it for output.
+ *
+ *   With --partition-by, output is written to the partition files instead of stdout.
+ *
+ *   Returns 0 on success, 1 if the partition files could not be written, or ERROR_ALLOC_MEMORY.
+ */
+static int sortAndPrint(NameStat *nameStats, size_t numEntries, ReadNameStatBuffers *buffers, const SortMtimeOptions *options, const CompactNameStats *compact)
+{
+    size_t *sortedIdxs;
+    size_t numSorted;
+    double startTime;
+    int sortEngine, numShards, ret;
+    SortedOutput output;
+
+    startTime = getMonotonicSeconds();
+
+    sortEngine = options->sortEngine;
+    if ( sortEngine < 0 )
+        sortEngine = options->gather.autoTune ? SORT_ENGINE_AUTO : SORT_ENGINE_RADIX;
+
+    /* Sort each shard on the worker which gathered it, then merge.
+     *   With --auto, small inputs are not worth the threads and are sorted whole.
+     */
+    numShards = buffers->numShards;
+    if ( options->gather.autoTune && numEntries < AUTO_SHARDED_SORT_MIN_ENTRIES )
+        numShards = 0;
+
+    sortedIdxs = sortNameStatIndexes(nameStats, numEntries, buffers->shards, numShards,
+        &options->keyList, options->isReverse, options->tiebreak, &sortEngine, &numSorted);
+    if ( unlikely( sortedIdxs == NULL ) )
+        return ERROR_ALLOC_MEMORY;
+
+    if ( options->gather.showStats )
+    {
+        fprintf(stderr, "stats: sort=%.6fs engine=%s shards=%d\n", getMonotonicSeconds() - startTime,
+            getSortEngineName(sortEngine), numShards > 1 ? numShards : 1);
+    }
+
+    output.nameStats = nameStats;
+    output.sortedIdxs = sortedIdxs;
+    output.compact = compact;
+
+    if ( options->partition.partitionBy >= 0 )
+    {
+        ret = writePartitioned(&output, numSorted, buffers, options) < 0 ? 1 : 0;
+        free(sortedIdxs);
+        return ret;
+    }
+
+    if ( options->isRecords )
+        writeRecordsHeader(stdout, options->timeField, buffers->gatheredFields);
+
+    /* Fast once sorted, but large. Format in chunks on the gather workers, written in order */
+    fflush(stdout);
+    writeFormattedInOrder(stdout, numSorted, getGatherNumThreads(buffers),
+        options->isRecords ? formatSortedRecord : formatSortedName, &output);
+
+    free(sortedIdxs);
+
+    return 0;
+}
+
+/*
+ * collectCompact - Append #nameStat to the CompactNameStats #_compact, if valid.
+ *   Called by streamNameStats for each entry.
+ */
+static void collectCompact(const NameStat *nameStat, void *_compact)
+{
+    CompactNameStats *compact = (CompactNameStats *)_compact;
+    NameStat *entry;
+    const char *baseName;
+
+    /* Invalid entries are never printed */
+    if ( unlikely( !NAMESTAT_IS_VALID(nameStat) ) )
+        return;
+
+    if ( unlikely( compact->numEntries == compact->capacity ) )
+    {
+        compact->capacity = compact->capacity ? compact->capacity * 2 : 4096;
+        compact->nameStats = realloc(compact->nameStats, sizeof(NameStat) * (compact->capacity + 1));
+        compact->dirIds = realloc(compact->dirIds, sizeof(uint32_t) * (compact->capacity + 1));
+        if ( unlikely( compact->nameStats == NULL || compact->dirIds == NULL ) )
+        {
+            fputs("Err: Failed to allocate memory for files.\n", stderr);
+            exit(ERROR_ALLOC_MEMORY);
+        }
+    }
+
+    entry = &compact->nameStats[compact->numEntries];
+
+    *entry = *nameStat;
+    compact->dirIds[compact->numEntries] = PathStore_Add(compact->store, nameStat->fname, &baseName);
+    entry->fname = (char *)baseName;
+
+    compact->numEntries += 1;
+}
+
+/*
+ * gatherCompact - Gather the files on stdin into #compact, streaming input
+ *   through the pipeline so that it is never all held at once (see streamNameStats)
  */
-int compare_NameStat_mtime(const void *_item1, const void *_item2)
+static void gatherCompact(ReadNameStatBuffers *buffers, CompactNameStats *compact)
 {
-    NameStat *item1, *item2;
+    int numThreads;
 
-    item1 = (NameStat *)_item1;
-    item2 = (NameStat *)_item2;
+    memset(compact, 0x0, sizeof(CompactNameStats));
+    compact->store = PathStore_New();
 
-    return item1->statBuf.st_mtime - item2->statBuf.st_mtime;
+    streamNameStats(buffers, stdin, collectCompact, compact);
+
+    /* Shard what was kept for sorting, with as many shards as there were gather workers */
+    numThreads = buffers->plan.isAutoTuned ? buffers->plan.numThreads : buffers->options.numThreads;
+    if ( numThreads == 0 )
+        numThreads = getNumCpus();
+
+    buffers->numShards = splitShards(compact->numEntries, sizeof(NameStat), numThreads, buffers->shards);
 }
 
 /**
- * handleArgs - Handle args on commandline.
+ * handleArgs - Handle args on commandline, filling #options
  *
  *   Sets isReverse to 1 if -r was specified, otherwise 0.
  *
+ *   Sets tiebreak to one of the TIEBREAK_* modes, default TIEBREAK_INPUT
+ *
+ *   Sets sortEngine to one of the SORT_ENGINE_* values, or -1 if not given
+ *
+ *   Sets timeField to one of the TIME_FIELD_* values, default TIME_FIELD_MTIME
+ *
+ *   Fills keyList from --key, default is ascending by time.
+ *
+ *   Sets isRecords to 1 if --output=records was specified, otherwise 0.
  *
  * If return is >= 0, the program should exit with that code.
  */
-static inline int handleArgs(int argc, char **argv, int *isReverse)
+static inline int handleArgs(int argc, char **argv, SortMtimeOptions *options)
 {
     int i;
+    int gatherRet;
+    int partitionRet;
+    char *tiebreakStr;
+    int hasTimeArg = 0;
 
-    *isReverse = 0;
+    options->isReverse = 0;
+    options->tiebreak = TIEBREAK_INPUT;
+    options->sortEngine = -1;
+    options->timeField = TIME_FIELD_MTIME;
+    options->isRecords = 0;
+    options->inputFormat = INPUT_FORMAT_LIST;
+    options->isCompactPaths = 0;
+    initGatherOptions(&options->gather);
+    initPartitionOptions(&options->partition);
+    initSortKeyList(&options->keyList);
 
     for( i=1; i < argc; i++ )
     {
@@ -73,18 +394,107 @@ static inline int handleArgs(int argc, char **argv, int *isReverse)
 
         else if ( strcmp("-r", argv[i]) == 0 )
         {
-            if ( *isReverse == 1 )
+            if ( options->isReverse == 1 )
             {
                 fputs("-r provided more than once.\n", stderr);
                 return 1;
             }
-            *isReverse = 1;
+            options->isReverse = 1;
+        }
+        else if ( strstr(argv[i], "--time=") == argv[i] )
+        {
+            options->timeField = getTimeFieldByName(argv[i] + 7);
+            if ( options->timeField < 0 )
+            {
+                fprintf(stderr, "Unknown or unsupported time field: %s\n\n", argv[i] + 7);
+                printUsage();
+                return 1;
+            }
+            hasTimeArg = 1;
+        }
+        else if ( strstr(argv[i], "--key=") == argv[i] )
+        {
+            if ( parseSortKeyList(argv[i] + 6, &options->keyList) < 0 )
+            {
+                fputs("\n", stderr);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( strstr(argv[i], "--tiebreak=") == argv[i] )
+        {
+            tiebreakStr = argv[i] + 11;
+            if ( strcmp("input", tiebreakStr) == 0 )
+                options->tiebreak = TIEBREAK_INPUT;
+            else if ( strcmp("name", tiebreakStr) == 0 )
+                options->tiebreak = TIEBREAK_NAME;
+            else
+            {
+                fprintf(stderr, "Unknown tiebreak mode: %s\n\n", tiebreakStr);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( strstr(argv[i], "--sort=") == argv[i] )
+        {
+            options->sortEngine = getSortEngineByName(argv[i] + 7);
+            if ( options->sortEngine < 0 )
+            {
+                fprintf(stderr, "Unknown sort: %s\n\n", argv[i] + 7);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( strstr(argv[i], "--input=") == argv[i] )
+        {
+            options->inputFormat = getInputFormatByName(argv[i] + 8);
+            if ( options->inputFormat < 0 )
+            {
+                fprintf(stderr, "Unknown input format: %s\n\n", argv[i] + 8);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( strcmp("--output=records", argv[i]) == 0 )
+        {
+            options->isRecords = 1;
+        }
+        else if ( strcmp("--output=text", argv[i]) == 0 )
+        {
+            options->isRecords = 0;
+        }
+        else if ( strcmp("--compact-paths", argv[i]) == 0 )
+        {
+            options->isCompactPaths = 1;
         }
         else if ( strcmp("--version", argv[i]) == 0 )
         {
             printVersion(APP_NAME);
             return 0;
         }
+        else if ( (partitionRet = handlePartitionArg(&options->partition, argv[i])) != 0 )
+        {
+            if ( partitionRet < 0 )
+            {
+                fputs("\n", stderr);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( (gatherRet = handleGatherArg(&options->gather, argv[i])) != 0 )
+        {
+            if ( gatherRet < 0 )
+            {
+                fputs("\n", stderr);
+                printUsage();
+                return 1;
+            }
+        }
+        else if ( argv[i][0] != '-' || strcmp("-", argv[i]) == 0 )
+        {
+            if ( addGatherInputFile(&options->gather, argv[i]) < 0 )
+                return 1;
+        }
         else
         {
             fprintf(stderr, "Unknown argument: %s\n\n", argv[i]);
@@ -93,6 +503,32 @@ static inline int handleArgs(int argc, char **argv, int *isReverse)
         }
     }
 
+    /* A named timestamp in --key selects the time field */
+    if ( options->keyList.timeField >= 0 )
+    {
+        if ( hasTimeArg && options->keyList.timeField != options->timeField )
+        {
+            fprintf(stderr, "--key uses %s, which conflicts with --time=%s\n", getTimeFieldName(options->keyList.timeField), getTimeFieldName(options->timeField));
+            return 1;
+        }
+        options->timeField = options->keyList.timeField;
+    }
+
+    if ( !checkPartitionOptions(&options->partition) )
+        return 1;
+
+    if ( options->isCompactPaths && options->tiebreak == TIEBREAK_NAME )
+    {
+        fputs("--tiebreak=name needs whole paths, so cannot be combined with --compact-paths\n", stderr);
+        return 1;
+    }
+
+    if ( options->inputFormat == INPUT_FORMAT_EPOCH && getSortKeyListNeedFields(&options->keyList) != NEED_FIELD_NONE )
+    {
+        fputs("--input=epoch only provides a time, so cannot sort by size, uid, or gid\n", stderr);
+        return 1;
+    }
+
     return -1;
 }
 
@@ -105,54 +541,70 @@ int main(int argc, char* argv[])
     NameStat *nameStats = NULL;
     size_t numEntries;
     int i;
-    int isReverse;
+    SortMtimeOptions options;
+    CompactNameStats compact;
+    int ret = 0;
 
     /* Parse args.
      *  If return is >= 0, we should exit with that code.
      */
-    if ( (i = handleArgs ( argc, (char **)argv, &isReverse ) ) >= 0 )
+    if ( (i = handleArgs ( argc, (char **)argv, &options ) ) >= 0 )
         return i;
 
     buffers = initReadNameStatBuffers();
     if ( buffers == NULL )
         return ERROR_ALLOC_MEMORY;
 
+    buffers->timeField = options.timeField;
+    buffers->inputFormat = options.inputFormat;
+    buffers->options = options.gather;
+    buffers->needFields = getSortKeyListNeedFields(&options.keyList);
+
+    /* Carry every attribute a following tool could need, so it does not have to stat again */
+    if ( options.isRecords && options.inputFormat != INPUT_FORMAT_EPOCH )
+        buffers->needFields |= RECORD_FIELDS;
+
+    if ( options.isCompactPaths )
+    {
+        gatherCompact(buffers, &compact);
+
+        if ( options.gather.showStats )
+        {
+            printGatherStats(buffers);
+            fprintf(stderr, "stats: paths: compact dirs=%zu bytes=%zu (whole paths: %zu)\n",
+                compact.store->numDirs, compact.store->numBytes, compact.store->numPathBytes);
+        }
+
+        ret = sortAndPrint(compact.nameStats, compact.numEntries, buffers, &options, &compact);
+
+        free(compact.nameStats);
+        free(compact.dirIds);
+        PathStore_Free(compact.store);
+
+        goto cleanup_and_exit;
+    }
+
     nameStats = readAndCreateNameStats(buffers, &numEntries, stdin);
     if ( nameStats == NULL )
         goto cleanup_and_exit;
 
     /*
-     * Sort the times. We always sort in the same direction, but
-     *   depending on #isReverse we may iterate backwards.
+     * Sort the times and print results in order expected
      */
-    qsort( nameStats, numEntries, sizeof(NameStat), compare_NameStat_mtime );
-
+    if ( options.gather.showStats )
+        printGatherStats(buffers);
 
-    /*
-     * Print results in order expected
-     */
-    if ( !isReverse )
-    {
-        for(i=0; i < numEntries; i++)
-        {
-            if( likely(nameStats[i].statBuf.st_mtime != 0) )
-                printf("%s\n", nameStats[i].fname);
-        }
-    }
-    else
-    {
-        for( i=numEntries-1; i >= 0; i--)
-        {
-            if( likely(nameStats[i].statBuf.st_mtime != 0) )
-                printf("%s\n", nameStats[i].fname);
-        }
-    }
+    ret = sortAndPrint(nameStats, numEntries, buffers, &options, NULL);
 
 cleanup_and_exit:
+    /* Input which could not be read (as opposed to empty input) fails the run */
+    if ( buffers->hasInputError )
+        ret = 1;
+
     /* Final cleanup */
     if ( nameStats != NULL )
         free(nameStats);
     destroyReadNameStatBuffers(buffers);
 
-    return 0;
+    return ret;
 }